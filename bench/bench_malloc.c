@@ -0,0 +1,581 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "../include/my_malloc.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_RDTSC 1
+#endif
+
+/*
+ * Microbenchmarks: pseudo-malloc (standard and metabuddy) against glibc malloc, all in this binary.
+ * Each (benchmark, allocator) pair runs in a child process of its own, so the peak RSS
+ * reported (ru_maxrss of the child) belongs to that run only; the child sends its
+ * numbers back through a pipe. One operation (a malloc or a free) in LATENCY_SAMPLE_EVERY
+ * is timed, with rdtsc on x86 and CLOCK_MONOTONIC elsewhere
+ *
+ *     make bench                                  # everything
+ *     ./bench/bench_malloc [name filter] [threads]
+ */
+
+#define LATENCY_SAMPLE_EVERY 8 // Power of two
+#define LATENCY_SAMPLES_PER_THREAD (1 << 20) // Samples kept per thread, the rest are dropped
+#define MAX_THREADS 64
+
+typedef struct {
+    const char* name;
+    void* (*malloc_fn)(size_t);
+    void (*free_fn)(void*);
+} Allocator;
+
+static const Allocator allocators[] = {
+    {"pseudo", my_malloc, my_free},
+    {"meta", my_malloc_metabuddy, my_free_metabuddy},
+    {"glibc", malloc, free},
+};
+
+typedef struct {
+    size_t ops; // Mallocs and frees done
+    double seconds; // Wall time of the whole benchmark
+    double p50_ns, p99_ns, p999_ns; // Latency of a single operation
+} Result;
+
+static const Allocator* allocator; // Allocator of the running child
+static int threads = 4; // Threads of the multithreaded benchmarks
+static double ns_per_tick = 1.0;
+
+/* Time */
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint64_t ticks(void) {
+#ifdef BENCH_HAVE_RDTSC
+    return __rdtsc();
+#else
+    return now_ns();
+#endif
+}
+
+static void calibrate_ticks(void) {
+#ifdef BENCH_HAVE_RDTSC
+    uint64_t ns0 = now_ns();
+    uint64_t t0 = ticks();
+    while (now_ns() - ns0 < 50000000ULL) {
+        // Spin for 50 ms
+    }
+    ns_per_tick = (double)(now_ns() - ns0) / (double)(ticks() - t0);
+#endif
+}
+
+/* Latency samples, kept in mmap'd memory so that neither allocator is involved */
+
+typedef struct {
+    uint64_t* samples;
+    size_t count;
+    unsigned int counter;
+} Recorder;
+
+static Recorder recorders[MAX_THREADS];
+
+static void recorders_init(int count) {
+    for (int i = 0; i < count; i++) {
+        recorders[i].samples = mmap(NULL, LATENCY_SAMPLES_PER_THREAD * sizeof(uint64_t), PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        recorders[i].count = 0;
+        recorders[i].counter = 0;
+    }
+}
+
+static inline int sample_now(Recorder* recorder) {
+    return (++recorder->counter & (LATENCY_SAMPLE_EVERY - 1)) == 0 && recorder->count < LATENCY_SAMPLES_PER_THREAD;
+}
+
+static inline void* bench_malloc(Recorder* recorder, size_t size) {
+    if (!sample_now(recorder)) {
+        return allocator->malloc_fn(size);
+    }
+    uint64_t t0 = ticks();
+    void* ptr = allocator->malloc_fn(size);
+    recorder->samples[recorder->count++] = ticks() - t0;
+    return ptr;
+}
+
+static inline void bench_free(Recorder* recorder, void* ptr) {
+    if (!sample_now(recorder)) {
+        allocator->free_fn(ptr);
+        return;
+    }
+    uint64_t t0 = ticks();
+    allocator->free_fn(ptr);
+    recorder->samples[recorder->count++] = ticks() - t0;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void latency_percentiles(int count, Result* result) {
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        total += recorders[i].count;
+    }
+    if (total == 0) {
+        return;
+    }
+
+    uint64_t* all = mmap(NULL, total * sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    size_t filled = 0;
+    for (int i = 0; i < count; i++) {
+        memcpy(all + filled, recorders[i].samples, recorders[i].count * sizeof(uint64_t));
+        filled += recorders[i].count;
+    }
+    qsort(all, total, sizeof(uint64_t), compare_u64);
+
+    result->p50_ns = (double)all[total / 2] * ns_per_tick;
+    result->p99_ns = (double)all[total * 99 / 100] * ns_per_tick;
+    result->p999_ns = (double)all[total * 999 / 1000] * ns_per_tick;
+    munmap(all, total * sizeof(uint64_t));
+}
+
+/* Random numbers (xorshift64), one state per thread */
+
+static inline uint64_t next_random(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+// Size between min and max, log-uniform: as many requests of each order of magnitude
+static inline size_t random_size(uint64_t* state, size_t min, size_t max) {
+    int min_order = 63 - __builtin_clzll(min);
+    int max_order = 63 - __builtin_clzll(max);
+    uint64_t random = next_random(state);
+    int order = min_order + (int)(random % (uint64_t)(max_order - min_order + 1));
+    size_t size = ((size_t)1 << order) + (size_t)((random >> 16) % ((size_t)1 << order));
+    return size < min ? min : size > max ? max : size;
+}
+
+static inline void touch(void* ptr, size_t size) {
+    if (ptr) {
+        ((volatile char*)ptr)[0] = 1;
+        ((volatile char*)ptr)[size - 1] = 1;
+    }
+}
+
+/* Single thread benchmarks */
+
+// Fixed-size churn: a window of live blocks of one size, the oldest is replaced each step
+static size_t bench_churn(size_t size) {
+    enum { WINDOW = 256 };
+    void* window[WINDOW] = {0};
+    size_t iterations = size <= 4096 ? 2000000 : 200000;
+    Recorder* recorder = &recorders[0];
+
+    size_t ops = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        void** slot = &window[i % WINDOW];
+        if (*slot) {
+            bench_free(recorder, *slot);
+            ops++;
+        }
+        *slot = bench_malloc(recorder, size);
+        touch(*slot, size);
+        ops++;
+    }
+    for (int i = 0; i < WINDOW; i++) {
+        if (window[i]) {
+            bench_free(recorder, window[i]);
+            ops++;
+        }
+    }
+    return ops;
+}
+
+// Random mix: random sizes from 8 bytes to 16 KB replacing random live blocks
+static size_t bench_random_mix(size_t max_size) {
+    enum { SLOTS = 4096 };
+    static void* slots[SLOTS];
+    static size_t sizes[SLOTS];
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    Recorder* recorder = &recorders[0];
+
+    size_t ops = 0;
+    for (size_t i = 0; i < 2000000; i++) {
+        size_t slot = (size_t)(next_random(&state) % SLOTS);
+        if (slots[slot]) {
+            bench_free(recorder, slots[slot]);
+            ops++;
+        }
+        sizes[slot] = random_size(&state, 8, max_size);
+        slots[slot] = bench_malloc(recorder, sizes[slot]);
+        touch(slots[slot], sizes[slot]);
+        ops++;
+    }
+    for (int i = 0; i < SLOTS; i++) {
+        if (slots[i]) {
+            bench_free(recorder, slots[i]);
+            slots[i] = NULL;
+            ops++;
+        }
+    }
+    return ops;
+}
+
+// Large blocks: mappings from 128 KB to 4 MB, a few alive at a time
+static size_t bench_large(size_t unused) {
+    (void)unused;
+    enum { SLOTS = 8 };
+    void* slots[SLOTS] = {0};
+    size_t sizes[SLOTS];
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    Recorder* recorder = &recorders[0];
+
+    size_t ops = 0;
+    for (size_t i = 0; i < 40000; i++) {
+        size_t slot = (size_t)(next_random(&state) % SLOTS);
+        if (slots[slot]) {
+            bench_free(recorder, slots[slot]);
+            ops++;
+        }
+        sizes[slot] = random_size(&state, 128 * 1024, 4 * 1024 * 1024);
+        slots[slot] = bench_malloc(recorder, sizes[slot]);
+        touch(slots[slot], sizes[slot]);
+        ops++;
+    }
+    for (int i = 0; i < SLOTS; i++) {
+        if (slots[i]) {
+            bench_free(recorder, slots[i]);
+            ops++;
+        }
+    }
+    return ops;
+}
+
+/* Multithreaded benchmarks */
+
+typedef struct {
+    int index; // Thread index, also its recorder
+    size_t ops; // Operations done by the thread
+} Worker;
+
+static size_t run_workers(void* (*work)(void*), int count) {
+    pthread_t handles[MAX_THREADS];
+    Worker workers[MAX_THREADS];
+    for (int i = 0; i < count; i++) {
+        workers[i].index = i;
+        workers[i].ops = 0;
+        pthread_create(&handles[i], NULL, work, &workers[i]);
+    }
+    size_t ops = 0;
+    for (int i = 0; i < count; i++) {
+        pthread_join(handles[i], NULL);
+        ops += workers[i].ops;
+    }
+    return ops;
+}
+
+// Producer/consumer: pairs of threads, the producer allocates and the consumer frees
+// everything through a single-producer single-consumer ring
+#define RING_SIZE 4096
+#define PRODUCED_PER_PAIR 1000000
+
+typedef struct {
+    void* slots[RING_SIZE];
+    size_t head __attribute__((aligned(64))); // Next slot written by the producer
+    size_t tail __attribute__((aligned(64))); // Next slot read by the consumer
+} Ring;
+
+static Ring* rings;
+
+static void* producer_consumer_work(void* arg) {
+    Worker* worker = arg;
+    Ring* ring = &rings[worker->index / 2];
+    Recorder* recorder = &recorders[worker->index];
+
+    if (worker->index % 2 == 0) {
+        uint64_t state = 0x9E3779B97F4A7C15ULL + (uint64_t)worker->index;
+        for (size_t i = 0; i < PRODUCED_PER_PAIR; i++) {
+            size_t size = random_size(&state, 16, 1024);
+            void* ptr = bench_malloc(recorder, size);
+            touch(ptr, size);
+            while (i - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= RING_SIZE) {
+                sched_yield(); // Ring full, wait for the consumer
+            }
+            ring->slots[i % RING_SIZE] = ptr;
+            __atomic_store_n(&ring->head, i + 1, __ATOMIC_RELEASE);
+            worker->ops++;
+        }
+    } else {
+        for (size_t i = 0; i < PRODUCED_PER_PAIR; i++) {
+            while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) <= i) {
+                sched_yield(); // Ring empty, wait for the producer
+            }
+            void* ptr = ring->slots[i % RING_SIZE];
+            __atomic_store_n(&ring->tail, i + 1, __ATOMIC_RELEASE);
+            bench_free(recorder, ptr);
+            worker->ops++;
+        }
+    }
+    return NULL;
+}
+
+static size_t bench_producer_consumer(size_t unused) {
+    (void)unused;
+    int pairs = threads / 2 > 0 ? threads / 2 : 1;
+    rings = mmap(NULL, (size_t)pairs * sizeof(Ring), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return run_workers(producer_consumer_work, 2 * pairs);
+}
+
+// Larson-style: every thread replaces random blocks of an array; between rounds the
+// arrays change hands, so most frees hit blocks allocated by another thread
+#define LARSON_SLOTS 1000
+#define LARSON_ROUNDS 20
+#define LARSON_STEPS_PER_ROUND 50000
+
+static void* (*larson_arrays)[LARSON_SLOTS];
+static pthread_barrier_t larson_barrier;
+
+static void* larson_work(void* arg) {
+    Worker* worker = arg;
+    Recorder* recorder = &recorders[worker->index];
+    uint64_t state = 0xD1B54A32D192ED03ULL + (uint64_t)worker->index;
+
+    for (int round = 0; round < LARSON_ROUNDS; round++) {
+        void** slots = larson_arrays[(worker->index + round) % threads];
+        for (int step = 0; step < LARSON_STEPS_PER_ROUND; step++) {
+            size_t slot = (size_t)(next_random(&state) % LARSON_SLOTS);
+            if (slots[slot]) {
+                bench_free(recorder, slots[slot]);
+                worker->ops++;
+            }
+            size_t size = random_size(&state, 16, 512);
+            slots[slot] = bench_malloc(recorder, size);
+            touch(slots[slot], size);
+            worker->ops++;
+        }
+        pthread_barrier_wait(&larson_barrier);
+    }
+
+    // Each thread clears the array it worked on last
+    void** slots = larson_arrays[(worker->index + LARSON_ROUNDS - 1) % threads];
+    for (int slot = 0; slot < LARSON_SLOTS; slot++) {
+        if (slots[slot]) {
+            bench_free(recorder, slots[slot]);
+            worker->ops++;
+        }
+    }
+    return NULL;
+}
+
+static size_t bench_larson(size_t unused) {
+    (void)unused;
+    larson_arrays = mmap(NULL, (size_t)threads * sizeof(*larson_arrays), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    pthread_barrier_init(&larson_barrier, NULL, (unsigned int)threads);
+    size_t ops = run_workers(larson_work, threads);
+    pthread_barrier_destroy(&larson_barrier);
+    return ops;
+}
+
+// xmalloc-style: producers allocate batches and hand them over through a shared queue,
+// consumers free them. Frees always hit blocks of another thread
+#define XMALLOC_BATCH 64
+#define XMALLOC_BATCHES_PER_PRODUCER 20000
+
+typedef struct XBatch {
+    struct XBatch* next;
+    void* blocks[XMALLOC_BATCH];
+} XBatch;
+
+static XBatch* xmalloc_queue = NULL;
+static XBatch* xmalloc_spare = NULL; // Batch records go round between producers and consumers
+static size_t xmalloc_batches_left = 0;
+static pthread_mutex_t xmalloc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void* xmalloc_work(void* arg) {
+    Worker* worker = arg;
+    Recorder* recorder = &recorders[worker->index];
+
+    if (worker->index % 2 == 0) {
+        uint64_t state = 0x94D049BB133111EBULL + (uint64_t)worker->index;
+        for (int b = 0; b < XMALLOC_BATCHES_PER_PRODUCER; b++) {
+            pthread_mutex_lock(&xmalloc_lock);
+            XBatch* batch = xmalloc_spare;
+            if (batch) {
+                xmalloc_spare = batch->next;
+            }
+            pthread_mutex_unlock(&xmalloc_lock);
+            if (!batch) {
+                batch = mmap(NULL, sizeof(XBatch), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            }
+
+            for (int i = 0; i < XMALLOC_BATCH; i++) {
+                size_t size = random_size(&state, 16, 256);
+                batch->blocks[i] = bench_malloc(recorder, size);
+                touch(batch->blocks[i], size);
+                worker->ops++;
+            }
+
+            pthread_mutex_lock(&xmalloc_lock);
+            batch->next = xmalloc_queue;
+            xmalloc_queue = batch;
+            pthread_mutex_unlock(&xmalloc_lock);
+        }
+        return NULL;
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&xmalloc_lock);
+        if (xmalloc_batches_left == 0) {
+            pthread_mutex_unlock(&xmalloc_lock);
+            return NULL;
+        }
+        XBatch* batch = xmalloc_queue;
+        if (batch) {
+            xmalloc_queue = batch->next;
+            xmalloc_batches_left--;
+        }
+        pthread_mutex_unlock(&xmalloc_lock);
+        if (!batch) {
+            sched_yield(); // Nothing queued yet
+            continue;
+        }
+
+        for (int i = 0; i < XMALLOC_BATCH; i++) {
+            bench_free(recorder, batch->blocks[i]);
+            worker->ops++;
+        }
+
+        pthread_mutex_lock(&xmalloc_lock);
+        batch->next = xmalloc_spare;
+        xmalloc_spare = batch;
+        pthread_mutex_unlock(&xmalloc_lock);
+    }
+}
+
+static size_t bench_xmalloc(size_t unused) {
+    (void)unused;
+    int count = threads >= 2 ? threads : 2;
+    xmalloc_batches_left = (size_t)((count + 1) / 2) * XMALLOC_BATCHES_PER_PRODUCER;
+    return run_workers(xmalloc_work, count);
+}
+
+/* Driver */
+
+typedef struct {
+    const char* name;
+    size_t (*run)(size_t arg);
+    size_t arg;
+    int multithreaded; // Uses one recorder per thread
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+    {"churn-16", bench_churn, 16, 0},
+    {"churn-64", bench_churn, 64, 0},
+    {"churn-256", bench_churn, 256, 0},
+    {"churn-1k", bench_churn, 1024, 0},
+    {"churn-4k", bench_churn, 4096, 0},
+    {"churn-16k", bench_churn, 16384, 0},
+    {"churn-64k", bench_churn, 65536, 0},
+    {"random-mix-1k", bench_random_mix, 1024, 0},
+    {"random-mix-16k", bench_random_mix, 16384, 0},
+    {"large-mmap", bench_large, 0, 0},
+    {"producer-consumer", bench_producer_consumer, 0, 1},
+    {"larson", bench_larson, 0, 1},
+    {"xmalloc", bench_xmalloc, 0, 1},
+};
+
+// Run one benchmark with one allocator in a child process. 0 on success
+static int run_in_child(const Benchmark* benchmark, const Allocator* chosen, Result* result, long* max_rss_kb) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        return -1;
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        allocator = chosen;
+        int recorder_count = benchmark->multithreaded ? (threads >= 2 ? threads : 2) : 1;
+        recorders_init(recorder_count);
+
+        Result child_result = {0};
+        uint64_t start = now_ns();
+        child_result.ops = benchmark->run(benchmark->arg);
+        child_result.seconds = (double)(now_ns() - start) / 1e9;
+        latency_percentiles(recorder_count, &child_result);
+
+        ssize_t written = write(fds[1], &child_result, sizeof(child_result));
+        _exit(written == (ssize_t)sizeof(child_result) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    ssize_t got = read(fds[0], result, sizeof(*result));
+    close(fds[0]);
+
+    int status = 0;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+        got != (ssize_t)sizeof(*result)) {
+        return -1;
+    }
+    *max_rss_kb = usage.ru_maxrss;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    const char* filter = argc > 1 ? argv[1] : NULL;
+    if (argc > 2) {
+        threads = atoi(argv[2]);
+        if (threads < 1 || threads > MAX_THREADS) {
+            fprintf(stderr, "threads must be between 1 and %d\n", MAX_THREADS);
+            return 1;
+        }
+    }
+
+    calibrate_ticks();
+
+    printf("%-18s %-7s %14s %9s %9s %9s %12s\n", "benchmark", "malloc", "ops/s", "p50 ns", "p99 ns", "p999 ns", "peak RSS KB");
+    int failures = 0;
+    for (size_t b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); b++) {
+        if (filter && !strstr(benchmarks[b].name, filter)) {
+            continue;
+        }
+        for (size_t a = 0; a < sizeof(allocators) / sizeof(allocators[0]); a++) {
+            Result result;
+            long max_rss_kb = 0;
+            if (run_in_child(&benchmarks[b], &allocators[a], &result, &max_rss_kb) != 0) {
+                printf("%-18s %-7s failed\n", benchmarks[b].name, allocators[a].name);
+                failures++;
+                continue;
+            }
+            printf("%-18s %-7s %14.0f %9.0f %9.0f %9.0f %12ld\n", a == 0 ? benchmarks[b].name : "", allocators[a].name,
+                   (double)result.ops / result.seconds, result.p50_ns, result.p99_ns, result.p999_ns, max_rss_kb);
+            fflush(stdout);
+        }
+    }
+
+    return failures ? 1 : 0;
+}
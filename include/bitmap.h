@@ -6,14 +6,23 @@
 #include <stdint.h>
 #include <string.h>
 
+#define BITMAP_WORD_BITS 64 // Bits are stored in 64-bit words
+#define BITMAP_NOT_FOUND ((size_t)-1) // Returned by the search functions when no bit matches
+
 typedef struct {
     size_t size; // Size of the bitmap in bits
-    unsigned char* bits; // Pointer to the bitmap bits
+    uint64_t* bits; // Pointer to the bitmap words (bit i is bit i % 64 of word i / 64)
 } Bitmap;
 
 // Initialize a new bitmap with the given size
 Bitmap* bitmap_init(size_t size);
 
+// Initialize a bitmap over caller provided storage of bitmap_storage_size(size) bytes (nothing is allocated)
+Bitmap* bitmap_init_inplace(Bitmap* bitmap, size_t size, void* storage);
+
+// Number of bytes needed to store a bitmap with the given size in bits (a whole number of words)
+size_t bitmap_storage_size(size_t size);
+
 // Free the memory allocated for a bitmap
 void bitmap_free(Bitmap* bitmap);
 
@@ -26,4 +35,56 @@ void bitmap_clear(Bitmap* bitmap, size_t index);
 // Test if a bit is set (1) or cleared (0)
 int bitmap_test(const Bitmap* bitmap, size_t index);
 
-#endif // BITMAP_H
\ No newline at end of file
+// Flip a bit and return its new value (1 or 0)
+int bitmap_toggle(Bitmap* bitmap, size_t index);
+
+/* Bulk operations, all ranges are [start, end) and are clamped to the bitmap size */
+
+// Index of the first cleared bit in the range, BITMAP_NOT_FOUND if every bit is set
+size_t bitmap_find_first_zero(const Bitmap* bitmap, size_t start, size_t end);
+
+// Index of the first set bit in the range, BITMAP_NOT_FOUND if every bit is cleared
+size_t bitmap_find_first_set(const Bitmap* bitmap, size_t start, size_t end);
+
+// 1 if no bit of the range is set, 0 otherwise
+int bitmap_range_all_zero(const Bitmap* bitmap, size_t start, size_t end);
+
+// Set every bit of the range
+void bitmap_set_range(Bitmap* bitmap, size_t start, size_t end);
+
+// Clear every bit of the range
+void bitmap_clear_range(Bitmap* bitmap, size_t start, size_t end);
+
+// Number of set bits in the range
+size_t bitmap_popcount(const Bitmap* bitmap, size_t start, size_t end);
+
+/*
+ * Unchecked single bit operations for hot paths: no NULL check and no bounds check,
+ * the caller guarantees that the bitmap is valid and the index is in range.
+ * Words are read and written whole (relaxed atomics, plain moves on x86) so that a
+ * single writer holding a lock can run alongside lock-free readers of other bits
+ */
+
+static inline int bitmap_test_fast(const Bitmap* bitmap, size_t index) {
+    uint64_t word = __atomic_load_n(&bitmap->bits[index / BITMAP_WORD_BITS], __ATOMIC_RELAXED);
+    return (int)((word >> (index % BITMAP_WORD_BITS)) & 1);
+}
+
+static inline void bitmap_set_fast(Bitmap* bitmap, size_t index) {
+    uint64_t* word = &bitmap->bits[index / BITMAP_WORD_BITS];
+    __atomic_store_n(word, *word | ((uint64_t)1 << (index % BITMAP_WORD_BITS)), __ATOMIC_RELAXED);
+}
+
+static inline void bitmap_clear_fast(Bitmap* bitmap, size_t index) {
+    uint64_t* word = &bitmap->bits[index / BITMAP_WORD_BITS];
+    __atomic_store_n(word, *word & ~((uint64_t)1 << (index % BITMAP_WORD_BITS)), __ATOMIC_RELAXED);
+}
+
+static inline int bitmap_toggle_fast(Bitmap* bitmap, size_t index) {
+    uint64_t* word = &bitmap->bits[index / BITMAP_WORD_BITS];
+    uint64_t value = *word ^ ((uint64_t)1 << (index % BITMAP_WORD_BITS));
+    __atomic_store_n(word, value, __ATOMIC_RELAXED);
+    return (int)((value >> (index % BITMAP_WORD_BITS)) & 1);
+}
+
+#endif // BITMAP_H
@@ -5,21 +5,80 @@
 #include "my_malloc.h"
 
 #include <stdlib.h>
-#include <math.h>
 
-#define MIN_BLOCK_SIZE 64 // Smallest block size in bytes
+/*
+ * Pool geometry, from two orders (log2 of a size) so that every size derived from them is
+ * an integer constant expression and loops over the levels have constant bounds. Other
+ * variants are a rebuild away, e.g. 16 MB pools of 32-byte blocks:
+ *     make CFLAGS="-Wall -std=c99 -pthread -DBUDDY_POOL_ORDER=24 -DMIN_BLOCK_ORDER=5"
+ */
+#ifndef BUDDY_POOL_ORDER
+#define BUDDY_POOL_ORDER 20 // log2(BUDDY_POOL_SIZE): pools are aligned to their size
+#endif
+#ifndef MIN_BLOCK_ORDER
+#define MIN_BLOCK_ORDER 6 // log2(MIN_BLOCK_SIZE), at least 4 (a free block holds two pointers)
+#endif
+#define BUDDY_POOL_SIZE ((size_t)1 << BUDDY_POOL_ORDER) // 1MB by default for each pool of the buddy allocator
+
+#define MIN_BLOCK_SIZE (1 << MIN_BLOCK_ORDER) // Smallest block size in bytes (64 by default)
 #define MAX_BLOCK_SIZE BUDDY_POOL_SIZE // Largest block size is the size of the buddy memory pool so 1MB
-#define MAX_LEVELS (log2(MAX_BLOCK_SIZE) - log2(MIN_BLOCK_SIZE) + 1) // Maximum number of levels (14)
+#define MAX_LEVELS (BUDDY_POOL_ORDER - MIN_BLOCK_ORDER + 1) // Number of levels: log2(MAX_BLOCK_SIZE) - log2(MIN_BLOCK_SIZE) + 1 (15 by default)
+
+#if MAX_LEVELS < 16
+#define BUDDY_TAG_BITS 4 // Bits of a level tag: level + 1 fits in 4 bits, two tags per byte
+#else
+#define BUDDY_TAG_BITS 8 // Bits of a level tag: one byte per tag beyond 15 levels
+#endif
+
+#define BUDDY_INTERNAL_NODES (((size_t)1 << (MAX_LEVELS - 1)) - 1) // Nodes that can be split, one per buddy pair (16383)
+#define BUDDY_BITMAP_SIZE (((BUDDY_INTERNAL_NODES + 63) / 64) * 8) // Bytes of one tree bitmap, whole 64-bit words (2 KB)
+#define BUDDY_UNITS ((size_t)1 << (MAX_LEVELS - 1)) // MIN_BLOCK_SIZE units in the pool, one level tag each (16384)
+#define BUDDY_TAGS_SIZE (BUDDY_UNITS * BUDDY_TAG_BITS / 8) // Bytes of level tags, one per unit (8 KB)
+#define BUDDY_DIRTY_UNIT 4096 // Bytes of the pool per bit of the written pages map, whatever the page size of the system
+#define BUDDY_DIRTY_UNITS (MAX_BLOCK_SIZE / BUDDY_DIRTY_UNIT) // Bits of the written pages map (256)
+#define BUDDY_DIRTY_SIZE (((BUDDY_DIRTY_UNITS + 63) / 64) * 8) // Bytes of the written pages map, whole 64-bit words (32 bytes)
+#define BUDDY_METADATA_SIZE (2 * BUDDY_BITMAP_SIZE + BUDDY_TAGS_SIZE + BUDDY_DIRTY_SIZE) // Bitmaps, tags and written pages map placed right after the pool (12 KB)
+#define BUDDY_REGION_SIZE (MAX_BLOCK_SIZE + BUDDY_METADATA_SIZE) // Pool and metadata, mapped together
+#define BUDDY_PURGE_MIN_SIZE (64 * 1024) // Free blocks from this size on give their pages back when an arena purges its pools
+#define BUDDY_STRUCT_AREA 4096 // Room after the metadata for the struct of an allocator created by BuddyAllocator_init(NULL)
+
+// Free block header, stored inside the free block itself (intrusive list)
+typedef struct BuddyFreeBlock {
+    struct BuddyFreeBlock* next; // Next free block of the same level
+    struct BuddyFreeBlock* prev; // Previous free block of the same level
+} BuddyFreeBlock;
 
 // Buddy Allocator Structure
 typedef struct {
-    void* memory_pool; // Pointer to the entire memory pool
-    Bitmap* allocation_bitmap; // Tracks which blocks are allocated
+    void* memory_pool; // Pointer to the entire memory pool (aligned to MAX_BLOCK_SIZE), followed by the storage of the bitmaps
+    Bitmap allocation_bitmap; // One bit per buddy pair (indexed by the parent): set when exactly one of the two buddies is in use
+    Bitmap split_bitmap; // One bit per internal node: set when the block has been split into its two children
+    uint8_t* level_tags; // BUDDY_TAG_BITS per MIN_BLOCK_SIZE unit: level + 1 of the allocated block starting there, 0 if none
+    BuddyFreeBlock* free_lists[MAX_LEVELS]; // One list of free blocks per level (level 0 is the whole pool)
+    size_t written_end; // Pool offset past every byte ever written or handed out: beyond it the pool is still zero, never touched
+    Bitmap dirty_bitmap; // One bit per BUDDY_DIRTY_UNIT of the pool: set when written or handed out since the last purge gave it back
 } BuddyAllocator;
 
-// Initialize the Buddy Allocator
+// Occupancy of a pool, see BuddyAllocator_occupancy
+typedef struct {
+    size_t free_blocks[MAX_LEVELS]; // Free blocks of each level (level 0 is the whole pool)
+    size_t used_blocks[MAX_LEVELS]; // Allocated blocks of each level
+    size_t free_bytes; // Bytes of all the free blocks
+    size_t used_bytes; // Bytes of all the allocated blocks
+    size_t largest_free_block; // Size of the largest free block, 0 if the pool is full
+} BuddyOccupancy;
+
+// Initialize the Buddy Allocator. With NULL a new one is created inside the mapping of its own pool
+// (no libc malloc at all), released together with the pool by BuddyAllocator_destroy
 BuddyAllocator* BuddyAllocator_init(BuddyAllocator* allocator);
 
+// Release the memory pool and its metadata (the struct itself belongs to the caller, unless it
+// was created by BuddyAllocator_init(NULL): then it is gone as well)
+void BuddyAllocator_destroy(BuddyAllocator* allocator);
+
+// 1 if no block of the pool is allocated (the whole pool is one free block), 0 otherwise
+int BuddyAllocator_is_empty(const BuddyAllocator* allocator);
+
 // Allocate memory using the Buddy Allocator
 void* BuddyAllocator_malloc(BuddyAllocator* allocator, size_t size);
 
@@ -32,4 +91,47 @@ void* BuddyAllocator_malloc_metabuddy(BuddyAllocator* allocator, size_t size);
 // Free memory using the Buddy Allocator with metadata
 void BuddyAllocator_free_metabuddy(BuddyAllocator* allocator, void* ptr);
 
+// Allocate up to count blocks of size bytes into out, carving them out of a few larger free blocks
+// (one per set bit of count) instead of taking them one by one. Returns how many were allocated
+size_t BuddyAllocator_malloc_batch(BuddyAllocator* allocator, size_t size, size_t count, void** out);
+
+// Free count blocks (NULL entries are ignored). ptrs is sorted in place, then each run of allocated
+// buddies that makes up a larger block is given back as that block, merging once instead of per block
+void BuddyAllocator_free_batch(BuddyAllocator* allocator, void** ptrs, size_t count);
+
+// Sort addresses in increasing order in place, without allocating (heapsort)
+void BuddyAllocator_sort_addresses(void** ptrs, size_t count);
+
+// Give the pages of the free blocks of min_size bytes or more back to the OS (MADV_DONTNEED), all but
+// the first page of each block, which holds its free list links. Only pages written or handed out since
+// the last purge go (none of a block never touched); with pools on huge pages, only whole huge pages go.
+// Returns the bytes newly given back; they read as zero, and cost a page fault each, once handed out again
+size_t BuddyAllocator_purge(BuddyAllocator* allocator, size_t min_size);
+
+// Resize the allocated block at ptr in place to the block size that fits size bytes: growing merges
+// it with its free upper buddies, shrinking gives its upper halves back. 1 on success, 0 if the
+// block cannot grow in place (ptr is left untouched)
+int BuddyAllocator_resize(BuddyAllocator* allocator, void* ptr, size_t size);
+
+// Size of the allocated block starting at ptr (0 if ptr is not one). Does not modify the
+// allocator and may be called without holding the lock that protects malloc/free
+size_t BuddyAllocator_block_size(const BuddyAllocator* allocator, const void* ptr);
+
+/*
+ * Occupancy of a pool, to tell a full pool from a fragmented one. These functions only
+ * read the bitmaps and the level tags: no lock, no allocation, no stdio, so they may be
+ * called from a signal handler. While other threads allocate from the pool the result
+ * is a best effort snapshot
+ */
+
+// Free and allocated blocks of each level, free and used bytes and the largest free block
+void BuddyAllocator_occupancy(const BuddyAllocator* allocator, BuddyOccupancy* occupancy);
+
+// Set the bits of map (BUDDY_UNITS bits) of the MIN_BLOCK_SIZE units covered by allocated blocks, clear the others
+void BuddyAllocator_occupancy_bitmap(const BuddyAllocator* allocator, Bitmap* map);
+
+// ASCII map of the pool in cells characters plus '\0' ('.' free, '#' allocated, '+' partly allocated).
+// cells must be a power of two up to BUDDY_UNITS; returns cells, 0 if it is not valid
+size_t BuddyAllocator_occupancy_map(const BuddyAllocator* allocator, char* out, size_t cells);
+
 #endif
@@ -0,0 +1,55 @@
+#ifndef BUMP_ARENA_H
+#define BUMP_ARENA_H
+
+#include "my_malloc.h"
+
+#define BUMP_CHUNK_SIZE (64 * 1024) // Default chunk size: one mid buddy block
+#define BUMP_DEDICATED_FRACTION 4 // Objects above chunk_size / 4 that do not fit the current chunk get a chunk of their own
+
+/*
+ * Bump arena: a region for objects that all die together (one request, one frame, one
+ * parse). Objects are carved one after the other out of chunks taken with my_malloc (buddy
+ * blocks, or mappings for chunks of MID_THRESHOLD and more), so an allocation is a pointer
+ * increment and nothing is freed one by one: arena_reset and arena_destroy give back whole
+ * chunks. An arena is not thread-safe, each thread (or request) has its own
+ */
+typedef struct BumpChunk {
+    struct BumpChunk* next; // Chunk taken before this one
+    size_t size; // Usable bytes of the chunk, this header included
+} BumpChunk;
+
+typedef struct BumpArena {
+    char* cursor; // Next free byte of the current chunk
+    char* end; // End of the current chunk
+    BumpChunk* chunks; // Every chunk of the arena, newest first; the oldest one holds this struct
+    size_t chunk_size; // Bytes asked for each new chunk
+} BumpArena;
+
+// New arena whose chunks are chunk_size bytes (0: BUMP_CHUNK_SIZE). NULL if its first chunk cannot be allocated
+BumpArena* arena_create(size_t chunk_size);
+
+// Slow path of arena_alloc: a new chunk, or a chunk of its own for a large object
+void* arena_alloc_chunk(BumpArena* arena, size_t size);
+
+// size bytes from the arena, 16 bytes aligned; NULL for 0 bytes or out of memory
+static inline void* arena_alloc(BumpArena* arena, size_t size) {
+    // cursor and end are both 16 bytes aligned, so a size that fits still fits once rounded.
+    // size - 1 wraps for 0, which goes to the slow path
+    if (__builtin_expect(size - 1 < (size_t)(arena->end - arena->cursor), 1)) {
+        void* ptr = arena->cursor;
+        arena->cursor += (size + MALLOC_ALIGNMENT - 1) & ~(size_t)(MALLOC_ALIGNMENT - 1);
+        return ptr;
+    }
+    return arena_alloc_chunk(arena, size);
+}
+
+// Drop every object at once: all chunks but the first go back, the first one is reused
+void arena_reset(BumpArena* arena);
+
+// Give back every chunk, the arena included
+void arena_destroy(BumpArena* arena);
+
+// Bytes of the chunks currently held by the arena
+size_t arena_footprint(const BumpArena* arena);
+
+#endif // BUMP_ARENA_H
@@ -3,15 +3,42 @@
 
 #include <stdio.h>
 
-/* 
+/*
  * Conditional printing macros
  * When DEBUG_PRINT is defined, prints are enabled
  * When DEBUG_PRINT is not defined, prints are disabled (no-op)
+ *
+ * The allocator prints from inside malloc and free, where printf may not be called: stdio
+ * allocates its buffers with malloc (the interposed one in the shared library), which would
+ * print again before the buffer exists. Messages are formatted on the stack and written
+ * straight to the file descriptor instead, unbuffered, so nothing here allocates
  */
 
 #ifdef DEBUG_PRINT
-    #define DEBUG_PRINTF(fmt, ...) printf(fmt, ##__VA_ARGS__)
-    #define DEBUG_FPRINTF(stream, fmt, ...) fprintf(stream, fmt, ##__VA_ARGS__)
+    #include <stdarg.h>
+    #include <unistd.h>
+
+    #define DEBUG_PRINT_MAX 512 // Longer messages are cut
+
+    __attribute__((format(printf, 2, 3)))
+    static inline void debug_write(int fd, const char* fmt, ...) {
+        char message[DEBUG_PRINT_MAX];
+        va_list args;
+        va_start(args, fmt);
+        int length = vsnprintf(message, sizeof(message), fmt, args);
+        va_end(args);
+        if (length < 0) {
+            return;
+        }
+        if (length >= (int)sizeof(message)) {
+            length = sizeof(message) - 1;
+        }
+        ssize_t written = write(fd, message, (size_t)length);
+        (void)written;
+    }
+
+    #define DEBUG_PRINTF(fmt, ...) debug_write(STDOUT_FILENO, fmt, ##__VA_ARGS__)
+    #define DEBUG_FPRINTF(stream, fmt, ...) debug_write(fileno(stream), fmt, ##__VA_ARGS__)
 #else
     #define DEBUG_PRINTF(fmt, ...) do {} while(0)
     #define DEBUG_FPRINTF(stream, fmt, ...) do {} while(0)
@@ -0,0 +1,47 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stddef.h>
+
+/*
+ * Heaps: allocators independent of my_malloc and of each other, one per subsystem or
+ * tenant. A heap has an arena of its own (its own pools, slabs and lock, no thread cache),
+ * large blocks it maps itself, an optional limit on what it maps and statistics of its own.
+ * heap_destroy unmaps all of it at once, without freeing the blocks one by one.
+ *
+ * Blocks of a heap go back with heap_free on the same heap, never with my_free. A heap
+ * may be used from several threads; do not fork while one of them is inside a heap call:
+ * the child would find that heap locked (my_malloc and the other heaps are unaffected)
+ */
+typedef struct Heap Heap;
+
+typedef struct {
+    size_t limit; // Most bytes the heap may map (1 MB per pool, large blocks), 0 for no limit
+} HeapConfig;
+
+typedef struct {
+    size_t mallocs; // Blocks handed out
+    size_t frees; // Blocks given back
+    size_t failed_mallocs; // Requests that got NULL (limit reached or mmap failed)
+    size_t bytes_in_use; // Bytes of the blocks currently handed out
+    size_t peak_in_use; // Highest bytes_in_use so far
+    size_t bytes_mapped; // Bytes of the pools and large blocks currently mapped
+    size_t peak_mapped; // Highest bytes_mapped so far
+} HeapStats;
+
+// New empty heap (config NULL: no limit). NULL if the heap itself cannot be mapped
+Heap* heap_create(const HeapConfig* config);
+
+// Allocate size bytes from the heap, 16 bytes aligned. NULL for 0 bytes, past the limit or out of memory
+void* heap_malloc(Heap* heap, size_t size);
+
+// Give back a block of the heap (NULL is ignored)
+void heap_free(Heap* heap, void* ptr);
+
+// Statistics of the heap
+void heap_stats(Heap* heap, HeapStats* stats);
+
+// Unmap every pool and large block of the heap and the heap itself: every block is gone
+void heap_destroy(Heap* heap);
+
+#endif // HEAP_H
@@ -0,0 +1,57 @@
+#ifndef HUGE_PAGES_H
+#define HUGE_PAGES_H
+
+#include "my_malloc.h"
+
+#define HUGE_PAGE_SIZE ((size_t)2 * 1024 * 1024) // 2MB: size and alignment of a huge page (x86-64, and arm64 with 4 KB pages)
+
+/*
+ * Huge pages, off unless my_malloc_huge_pages is called before the first allocation (or,
+ * with the shared library, PSEUDO_MALLOC_HUGEPAGES is set, read by the first mapping).
+ * With them on, large mappings of HUGE_PAGE_SIZE and more are HUGE_PAGE_SIZE aligned
+ * and sized, and so are pools of HUGE_PAGE_SIZE and more (BUDDY_POOL_ORDER 21 and up;
+ * smaller pools stay on small pages), so the kernel can back each 2MB of them with a
+ * single TLB entry:
+ * - HUGE_PAGES_THP: madvise(MADV_HUGEPAGE), transparent huge pages when the kernel has some
+ * - HUGE_PAGES_HUGETLB: large mappings first try MAP_HUGETLB (reserved huge pages, see
+ *   /proc/sys/vm/nr_hugepages) and fall back to THP when none are left. Pools never use
+ *   MAP_HUGETLB, only THP when they are huge page backed: purging their free blocks needs
+ *   pages smaller than a pool
+ * The mode cannot change once memory was mapped with it: whether a mapping was made huge
+ * follows from the mode and its size alone
+ */
+
+extern HugePageMode huge_pages_mode; // Set by my_malloc_huge_pages
+extern int huge_pages_frozen; // Set by the first mapping: from then on the mode is fixed
+
+// Mode asked for by the environment (PSEUDO_MALLOC_HUGEPAGES), defined by the shared library only
+HugePageMode huge_pages_from_environment(void) __attribute__((weak));
+
+// Fix the mode, from the environment if my_malloc_huge_pages was not called
+void huge_pages_freeze(void);
+
+// Current mode, fixed for good by the first call
+static inline HugePageMode huge_page_mode(void) {
+    if (__builtin_expect(!__atomic_load_n(&huge_pages_frozen, __ATOMIC_ACQUIRE), 0)) {
+        huge_pages_freeze();
+    }
+    return __atomic_load_n(&huge_pages_mode, __ATOMIC_RELAXED);
+}
+
+// Whether a mapping of size bytes is huge page backed
+static inline int huge_pages_for(size_t size) {
+    return size >= HUGE_PAGE_SIZE && huge_page_mode() != HUGE_PAGES_OFF;
+}
+
+// size rounded up to whole huge pages
+static inline size_t round_to_huge_pages(size_t size) {
+    return (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+
+// Large mapping of size bytes (a multiple of HUGE_PAGE_SIZE), HUGE_PAGE_SIZE aligned and huge page backed. NULL on failure
+void* huge_pages_map(size_t size);
+
+// Ask for transparent huge pages on size bytes at region (HUGE_PAGE_SIZE aligned), counted as a huge mapping
+void huge_pages_advise(void* region, size_t size);
+
+#endif // HUGE_PAGES_H
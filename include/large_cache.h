@@ -0,0 +1,36 @@
+#ifndef LARGE_CACHE_H
+#define LARGE_CACHE_H
+
+#include "my_malloc.h"
+
+#define LARGE_CACHE_BUCKETS 64 // Hash buckets of cached mappings, by page count
+#define LARGE_CACHE_MAX_ENTRIES 64 // Mappings kept at most, the oldest is unmapped beyond that
+#define LARGE_CACHE_BUDGET (32 * 1024 * 1024) // Bytes of mappings kept at most (32MB), the oldest are unmapped beyond that
+#define LARGE_CACHE_MAX_SIZE (LARGE_CACHE_BUDGET / 4) // Bigger mappings are never cached
+#define LARGE_CACHE_MAX_AGE 256 // Frees a mapping stays resident in the cache, then its pages are dropped (MADV_DONTNEED, or unmapped for huge pages)
+
+/*
+ * Cache of freed large mappings, so that large allocations of a size seen recently
+ * do not cost an mmap and a munmap each. A freed mapping is kept as it is and handed
+ * out again to the next request of the same page count. Mappings not reused within
+ * LARGE_CACHE_MAX_AGE frees keep their address range but give their pages back to the
+ * OS (reusing them only costs page faults); huge page mappings that old are unmapped.
+ * The cache bookkeeping is stored in the first page of each cached mapping, which is
+ * never dropped
+ */
+
+// Mapping of size bytes (a multiple of PAGE_SIZE): a cached one of the same size or a new one, huge page
+// backed if huge_pages_for(size) (size is then a multiple of HUGE_PAGE_SIZE). NULL on failure.
+// If fresh is not NULL it is set to 1 for a new mapping (all zero), 0 for a reused one
+void* large_cache_map(size_t size, int* fresh);
+
+// Give back a mapping of size bytes obtained from large_cache_map: kept in the cache or unmapped. -1 if munmap failed
+int large_cache_unmap(void* ptr, size_t size);
+
+// Unmap every mapping kept in the cache, returns their bytes
+size_t large_cache_flush(void);
+
+// Bytes of mappings currently kept in the cache
+size_t large_cache_size(void);
+
+#endif // LARGE_CACHE_H
@@ -0,0 +1,237 @@
+#ifndef MALLOC_STATS_H
+#define MALLOC_STATS_H
+
+#include "buddy_allocator.h"
+
+#ifndef MALLOC_STATS
+#define MALLOC_STATS 1 // Count allocations, frees and system calls (-DMALLOC_STATS=0 compiles the counters out)
+#endif
+
+/*
+ * Allocation statistics
+ * Every thread counts into a block of counters of its own (plain stores, no shared cache
+ * line, no lock); my_malloc_stats adds up the blocks of the running threads and the
+ * counters left behind by the threads that exited. Byte counters are cumulative, so
+ * the live figures (bytes in use, bytes reserved) are differences of two of them
+ */
+typedef struct {
+    size_t buddy_mallocs[MAX_LEVELS]; // Buddy blocks handed out, by level (level 0 is a whole pool)
+    size_t buddy_frees[MAX_LEVELS]; // Buddy blocks given back, by level
+    size_t slab_mallocs; // Slab objects handed out
+    size_t slab_frees; // Slab objects given back
+    size_t large_mallocs; // Large (mmap) blocks handed out
+    size_t large_frees; // Large blocks given back
+    size_t failed_mallocs; // Requests that got NULL for lack of memory
+    size_t bytes_requested; // Bytes asked for by the successful requests
+    size_t bytes_allocated; // Bytes of the blocks handed out for them
+    size_t bytes_freed; // Bytes of the blocks given back
+    size_t mmap_calls; // Mappings created (pools, metadata, large blocks)
+    size_t munmap_calls; // Mappings (or parts of them) given back
+    size_t mremap_calls; // Large blocks resized by the kernel
+    size_t madvise_calls; // Page ranges dropped while keeping their mapping
+    size_t bytes_mapped; // Bytes mapped, mremap growth included
+    size_t bytes_unmapped; // Bytes unmapped, mremap shrinking included
+    size_t huge_mappings; // Mappings asked to be huge page backed (pool regions and large blocks, see my_malloc_huge_pages)
+    size_t hugetlb_fallbacks; // MAP_HUGETLB mappings that found no reserved huge page and fell back to THP
+    size_t huge_bytes_mapped; // Bytes of those mappings, mremap growth included
+    size_t huge_bytes_unmapped; // Bytes of those mappings unmapped, mremap shrinking included
+
+    // Derived by my_malloc_stats
+    size_t bytes_in_use; // bytes_allocated - bytes_freed: blocks currently handed out
+    size_t bytes_reserved; // bytes_mapped - bytes_unmapped: memory currently mapped
+    double internal_fragmentation; // 1 - bytes_requested / bytes_allocated: share of block bytes nobody asked for
+    size_t huge_bytes_reserved; // huge_bytes_mapped - huge_bytes_unmapped: memory currently mapped for huge pages
+    size_t huge_page_bytes; // Resident memory of the process on huge pages (AnonHugePages and Private_Hugetlb of /proc/self/smaps_rollup), read only once a huge mapping was made
+    double thp_hit_rate; // huge_page_bytes / resident anonymous memory of the process: share of it the TLB covers 2MB at a time
+} MallocStats;
+
+// Counters of one thread, linked in the list my_malloc_stats walks. Records live in pages of
+// their own, not in the thread's TLS block: a thread that first counts during its last TLS
+// destructor pass is never told it exits, and its record must stay valid once the thread is gone
+typedef struct ThreadStats {
+    MallocStats counters; // Only the raw counters are used
+    struct ThreadStats* next; // Next registered thread (next released record once released)
+    struct ThreadStats* prev; // Previous registered thread
+} ThreadStats;
+
+// initial-exec: counting must never allocate (no lazy TLS setup). NULL until the first count
+// of the thread, a shared record nobody reads once the thread exited
+extern __thread ThreadStats* thread_stats __attribute__((tls_model("initial-exec")));
+
+// Link the counters of the calling thread (first count of the thread)
+void malloc_stats_register(void);
+
+// Totals of all the threads so far
+void my_malloc_stats(MallocStats* stats);
+
+// Write the totals as text (json = 0) or as a JSON object (json = 1). -1 on write error
+int my_malloc_stats_print(FILE* stream, int json);
+
+/* Counting, called by the allocator itself */
+
+static inline void stats_add(size_t* counter, size_t value) {
+    // Only the owner thread writes its counters: no atomic read-modify-write needed
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+
+static inline MallocStats* stats_counters(void) {
+    if (__builtin_expect(thread_stats == NULL, 0)) {
+        malloc_stats_register();
+    }
+    return &thread_stats->counters;
+}
+
+// Buddy block for a request: the smallest power of two >= size, at least MIN_BLOCK_SIZE
+static inline size_t stats_buddy_block_size(size_t size) {
+    if (size <= MIN_BLOCK_SIZE) {
+        return MIN_BLOCK_SIZE;
+    }
+    return (size_t)1 << (64 - __builtin_clzll((unsigned long long)size - 1));
+}
+
+static inline int stats_buddy_level(size_t block_size) {
+    return __builtin_ctzll(MAX_BLOCK_SIZE) - __builtin_ctzll(block_size);
+}
+
+static inline void stats_buddy_malloc(size_t requested, size_t block_size) {
+#if MALLOC_STATS
+    MallocStats* stats = stats_counters();
+    stats_add(&stats->buddy_mallocs[stats_buddy_level(block_size)], 1);
+    stats_add(&stats->bytes_requested, requested);
+    stats_add(&stats->bytes_allocated, block_size);
+#endif
+}
+
+// count blocks of one batch, all for the same request size
+static inline void stats_buddy_malloc_batch(size_t requested, size_t block_size, size_t count) {
+#if MALLOC_STATS
+    MallocStats* stats = stats_counters();
+    stats_add(&stats->buddy_mallocs[stats_buddy_level(block_size)], count);
+    stats_add(&stats->bytes_requested, requested * count);
+    stats_add(&stats->bytes_allocated, block_size * count);
+#endif
+}
+
+static inline void stats_buddy_free(size_t block_size) {
+#if MALLOC_STATS
+    MallocStats* stats = stats_counters();
+    stats_add(&stats->buddy_frees[stats_buddy_level(block_size)], 1);
+    stats_add(&stats->bytes_freed, block_size);
+#endif
+}
+
+static inline void stats_slab_malloc(size_t requested, size_t object_size) {
+#if MALLOC_STATS
+    MallocStats* stats = stats_counters();
+    stats_add(&stats->slab_mallocs, 1);
+    stats_add(&stats->bytes_requested, requested);
+    stats_add(&stats->bytes_allocated, object_size);
+#endif
+}
+
+static inline void stats_slab_malloc_batch(size_t requested, size_t object_size, size_t count) {
+#if MALLOC_STATS
+    MallocStats* stats = stats_counters();
+    stats_add(&stats->slab_mallocs, count);
+    stats_add(&stats->bytes_requested, requested * count);
+    stats_add(&stats->bytes_allocated, object_size * count);
+#endif
+}
+
+static inline void stats_slab_free(size_t object_size) {
+#if MALLOC_STATS
+    MallocStats* stats = stats_counters();
+    stats_add(&stats->slab_frees, 1);
+    stats_add(&stats->bytes_freed, object_size);
+#endif
+}
+
+static inline void stats_large_malloc(size_t requested, size_t size) {
+#if MALLOC_STATS
+    MallocStats* stats = stats_counters();
+    stats_add(&stats->large_mallocs, 1);
+    stats_add(&stats->bytes_requested, requested);
+    stats_add(&stats->bytes_allocated, size);
+#endif
+}
+
+static inline void stats_large_free(size_t size) {
+#if MALLOC_STATS
+    MallocStats* stats = stats_counters();
+    stats_add(&stats->large_frees, 1);
+    stats_add(&stats->bytes_freed, size);
+#endif
+}
+
+static inline void stats_failed_malloc(void) {
+#if MALLOC_STATS
+    stats_add(&stats_counters()->failed_mallocs, 1);
+#endif
+}
+
+static inline void stats_mmap(size_t bytes) {
+#if MALLOC_STATS
+    MallocStats* stats = stats_counters();
+    stats_add(&stats->mmap_calls, 1);
+    stats_add(&stats->bytes_mapped, bytes);
+#endif
+}
+
+static inline void stats_munmap(size_t bytes) {
+#if MALLOC_STATS
+    MallocStats* stats = stats_counters();
+    stats_add(&stats->munmap_calls, 1);
+    stats_add(&stats->bytes_unmapped, bytes);
+#endif
+}
+
+static inline void stats_mremap(size_t old_bytes, size_t new_bytes) {
+#if MALLOC_STATS
+    MallocStats* stats = stats_counters();
+    stats_add(&stats->mremap_calls, 1);
+    if (new_bytes > old_bytes) {
+        stats_add(&stats->bytes_mapped, new_bytes - old_bytes);
+    } else {
+        stats_add(&stats->bytes_unmapped, old_bytes - new_bytes);
+    }
+#endif
+}
+
+static inline void stats_madvise(void) {
+#if MALLOC_STATS
+    stats_add(&stats_counters()->madvise_calls, 1);
+#endif
+}
+
+static inline void stats_huge_map(size_t bytes) {
+#if MALLOC_STATS
+    MallocStats* stats = stats_counters();
+    stats_add(&stats->huge_mappings, 1);
+    stats_add(&stats->huge_bytes_mapped, bytes);
+#endif
+}
+
+static inline void stats_huge_unmap(size_t bytes) {
+#if MALLOC_STATS
+    stats_add(&stats_counters()->huge_bytes_unmapped, bytes);
+#endif
+}
+
+static inline void stats_huge_remap(size_t old_bytes, size_t new_bytes) {
+#if MALLOC_STATS
+    MallocStats* stats = stats_counters();
+    if (new_bytes > old_bytes) {
+        stats_add(&stats->huge_bytes_mapped, new_bytes - old_bytes);
+    } else {
+        stats_add(&stats->huge_bytes_unmapped, old_bytes - new_bytes);
+    }
+#endif
+}
+
+static inline void stats_hugetlb_fallback(void) {
+#if MALLOC_STATS
+    stats_add(&stats_counters()->hugetlb_fallbacks, 1);
+#endif
+}
+
+#endif // MALLOC_STATS_H
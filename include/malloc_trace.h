@@ -0,0 +1,79 @@
+#ifndef MALLOC_TRACE_H
+#define MALLOC_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef MALLOC_TRACE
+#define MALLOC_TRACE 1 // Recording can be switched on at run time (-DMALLOC_TRACE=0 compiles the hooks out)
+#endif
+
+#define TRACE_MAGIC "PMTRACE1" // First 8 bytes of a trace file
+#define TRACE_VERSION 2
+#define TRACE_RING_RECORDS 4096 // Records buffered per thread (power of two), written out half a ring at a time
+
+/*
+ * Allocation trace
+ * While recording, every successful call of the my_malloc family appends one record to
+ * a ring of the calling thread: only that thread writes it, and whoever flushes it (the
+ * thread itself when half of it is filled, my_malloc_trace_stop at the end) takes a flag,
+ * so recording never takes a lock. Rings are written to the trace file with O_APPEND, one
+ * write per flush: the file holds chunks of records of each thread, in time order within
+ * a thread. tools/replay sorts them by timestamp and replays them.
+ *
+ * Blocks are identified by the address they had: an id is unique among the live blocks,
+ * and may come back once its block was freed. A free is recorded before the call and an
+ * allocation after it, so the record giving an address back always sorts before the one
+ * handing it out again. A realloc is both: TRACE_REALLOC_BEGIN names its old block before
+ * the call, TRACE_REALLOC the outcome after it
+ */
+typedef enum {
+    TRACE_MALLOC = 0, // my_malloc: size, id
+    TRACE_FREE = 1, // my_free: id
+    TRACE_REALLOC = 2, // my_realloc: size, id (0 when it freed the block), old_id (0 for NULL). Failed: size 0, id old_id (block kept)
+    TRACE_CALLOC = 3, // my_calloc: size (nmemb * size), id
+    TRACE_MEMALIGN = 4, // my_posix_memalign, my_aligned_alloc: size, id, alignment in old_id
+    TRACE_REALLOC_BEGIN = 5, // my_realloc of a block, before the call: old_id (followed by the TRACE_REALLOC of the thread)
+} TraceOp;
+
+typedef struct {
+    uint64_t timestamp; // Nanoseconds since the trace started
+    uint64_t size; // Bytes requested, 0 for free
+    uint64_t id; // Block handed out, or given back by free
+    uint64_t old_id; // realloc: block resized; memalign: alignment
+    uint32_t thread; // Thread number, in the order threads first recorded
+    uint32_t op; // TraceOp
+} TraceRecord;
+
+typedef struct {
+    char magic[8]; // TRACE_MAGIC
+    uint32_t version; // TRACE_VERSION
+    uint32_t record_size; // sizeof(TraceRecord)
+} TraceFileHeader;
+
+extern int trace_enabled; // 1 while recording
+
+// Start recording into the file at path (created or truncated). 0, or -1 with errno set
+int my_malloc_trace_start(const char* path);
+
+// Stop recording: flush the rings of every thread and close the file. 0, or -1 with errno set
+int my_malloc_trace_stop(void);
+
+// Append a record to the ring of the calling thread
+void trace_record(TraceOp op, size_t size, const void* id, uintptr_t old_id);
+
+// Called by the allocator after each successful operation
+static inline void trace_event(TraceOp op, size_t size, const void* id, uintptr_t old_id) {
+#if MALLOC_TRACE
+    if (__builtin_expect(__atomic_load_n(&trace_enabled, __ATOMIC_RELAXED), 0)) {
+        trace_record(op, size, id, old_id);
+    }
+#else
+    (void)op;
+    (void)size;
+    (void)id;
+    (void)old_id;
+#endif
+}
+
+#endif // MALLOC_TRACE_H
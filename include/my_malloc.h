@@ -11,12 +11,55 @@
 #include <string.h>
 #include <stdint.h>
 
-#define PAGE_SIZE 4096 // 4KB
-#define SMALL_THRESHOLD (PAGE_SIZE / 4) // 1024 bytes so 1KB
-#define BUDDY_POOL_SIZE (1024 * 1024)  // 1MB (1024 * 1024 = 1048576 bytes so 1MB) for buddy allocator
+// System page size (4 KB on most systems, 16 KB or 64 KB on some arm64 and ppc64 ones), read once
+static inline size_t page_size(void) {
+    static size_t size = 0;
+    size_t cached = __atomic_load_n(&size, __ATOMIC_RELAXED);
+    if (__builtin_expect(cached == 0, 0)) {
+        cached = (size_t)sysconf(_SC_PAGESIZE);
+        __atomic_store_n(&size, cached, __ATOMIC_RELAXED);
+    }
+    return cached;
+}
+#define PAGE_SIZE page_size() // Not a constant expression: sizes fixed at compile time do not depend on it
 
+#define SMALL_THRESHOLD 1024 // 1KB (a quarter of a 4 KB page): below it small pools, from it the mid pools
+#ifndef MID_THRESHOLD
+#define MID_THRESHOLD (128 * 1024) // 128KB: from SMALL_THRESHOLD up to here buddy blocks of the mid pools, beyond it mmap (override with -DMID_THRESHOLD)
+#endif
+#define MALLOC_ALIGNMENT 16 // Alignment of every block of 16 bytes or more
+#define LARGE_HEADER_SIZE 16 // Header right before each large (mmap) block: mapping size and offset
+
+// Slab layer for tiny objects, carved from buddy blocks without any per-object header
+#define SLAB_CLASSES 5 // Object sizes: 8, 16, 24, 32 and 48 bytes
+#define SLAB_MAX_SIZE 48 // Largest request served by a slab, bigger ones get a buddy block
+
+// Per-thread cache in front of the slabs and buddy pools of the arenas (each arena is protected by a lock)
+#define TCACHE_BUDDY_BINS 4 // Cached block sizes: 64, 128, 256 and 512 bytes
+#define TCACHE_BINS (SLAB_CLASSES + TCACHE_BUDDY_BINS) // Slab classes first, then buddy block sizes
+#define TCACHE_BIN_CAPACITY 32 // Blocks kept per bin, beyond that frees go back to the pool
+#define TCACHE_REFILL_COUNT 8 // Blocks taken from the pool with one lock when a bin is empty
+
+// Huge page backing of pool regions and large mappings (see huge_pages.h)
+typedef enum {
+    HUGE_PAGES_OFF = 0, // 4 KB pages only (default)
+    HUGE_PAGES_THP = 1, // Transparent huge pages (madvise MADV_HUGEPAGE)
+    HUGE_PAGES_HUGETLB = 2, // MAP_HUGETLB for large mappings, THP when no reserved huge page is left
+} HugePageMode;
+
+// All functions are thread-safe
 void* my_malloc(size_t size); // Allocate memory
 void my_free(void* ptr); // Free memory
+void* my_realloc(void* ptr, size_t size); // Resize memory, in place when the block can grow or shrink there
+void* my_calloc(size_t nmemb, size_t size); // Allocate zeroed memory for an array, NULL if nmemb * size overflows
+int my_posix_memalign(void** memptr, size_t alignment, size_t size); // Aligned allocation (alignment: power of two multiple of sizeof(void*)), 0 or an error code
+void* my_aligned_alloc(size_t alignment, size_t size); // Aligned allocation (alignment: power of two)
+size_t my_malloc_usable_size(void* ptr); // Bytes usable at ptr, at least the requested size
+int my_malloc_huge_pages(HugePageMode mode); // Choose the huge page mode before the first allocation: 0, or -1 with errno set (EBUSY once memory was mapped)
+size_t my_malloc_trim(void); // Give free memory back to the OS (empty pools, pages of free blocks, cached mappings), returns the bytes
+
+size_t my_malloc_batch(size_t size, size_t count, void** out); // Allocate count blocks of size bytes into out with one lock, returns how many were allocated
+void my_free_batch(void** ptrs, size_t count); // Free count blocks of my_malloc (NULL entries ignored); sorts ptrs in place
 
 void* my_malloc_metabuddy(size_t size); // Allocate memory with metabuddy
 void my_free_metabuddy(void* ptr); // Free memory with metabuddy
@@ -0,0 +1,104 @@
+#ifndef POOL_ARENA_H
+#define POOL_ARENA_H
+
+#include "buddy_allocator.h"
+#include "slab.h"
+
+#include <pthread.h>
+
+#define MAX_ARENAS 64 // Upper bound on the number of arenas
+#define ARENAS_PER_CPU 4 // Arenas created per online CPU (capped at MAX_ARENAS)
+#define POOL_PURGE_INTERVAL 4096 // Frees into the pools of an arena between two purges of its free blocks (BUDDY_PURGE_MIN_SIZE and up)
+
+#define POOL_MAP_ADDRESS_BITS 48 // User space addresses covered by the pool map (x86-64 and AArch64 without 5-level paging)
+#define POOL_MAP_LEAF_BITS 14 // Pools per leaf of the pool map (a leaf covers 16 GB of address space)
+#define POOL_MAP_ROOT_BITS (POOL_MAP_ADDRESS_BITS - BUDDY_POOL_ORDER - POOL_MAP_LEAF_BITS) // Leaves in the root of the map
+
+// What the blocks of a pool are used for: each kind has its own chain of pools in an arena
+typedef enum {
+    POOL_KIND_BUDDY, // Blocks handed out as they are by my_malloc
+    POOL_KIND_MID, // Blocks of SMALL_THRESHOLD bytes up to MID_THRESHOLD, kept apart from the small ones
+    POOL_KIND_SLAB, // Blocks carved into tiny objects by the slab layer
+    POOL_KINDS
+} PoolKind;
+
+/*
+ * Pool: one buddy pool of an arena. Pools are mmap'd aligned to their size, so the
+ * pool containing a pointer is found from the pointer's upper bits through the pool map
+ */
+typedef struct BuddyPool {
+    BuddyAllocator buddy; // Allocator of the pool
+    struct PoolArena* arena; // Arena that owns the pool
+    PoolKind kind; // Chain of the arena the pool belongs to
+    struct BuddyPool* next; // Next pool of the same arena
+    int dirty; // Blocks were freed since the pool was last purged
+} BuddyPool;
+
+/*
+ * Arena: one chain of buddy pools per pool kind, and the slabs carved from the slab
+ * pools, all under a single lock.
+ * Threads are spread over the arenas (round robin on first use) and keep their arena,
+ * so threads of different arenas never share a lock nor the cache lines of a bitmap.
+ * A chain grows by one pool whenever none of its pools can serve a request, and a pool
+ * that becomes empty goes back to the OS unless it is the only empty pool left in its
+ * chain. A block freed by a thread that does not own its arena is pushed on the
+ * arena remote_frees stack without locking; the stack is drained by the next thread that
+ * locks the arena. Every POOL_PURGE_INTERVAL frees into its pools, an arena gives the pages
+ * of the large free blocks of the pools freed into back to the OS
+ */
+typedef struct PoolArena {
+    pthread_mutex_t lock; // Protects the pool chains, every pool in them and the slabs
+    BuddyPool* pools[POOL_KINDS]; // Chain of pools of each kind, oldest first (the first one is created on first use)
+    BuddyPool* current[POOL_KINDS]; // Pool of each chain that served the last allocation, tried first
+    Slab* slabs[SLAB_CLASSES]; // Slabs of each class with free objects
+    void* remote_frees; // Lock-free stack of blocks waiting to go back to their pool (link stored in the block)
+    size_t mapped_bytes; // Bytes of the pools of the arena (a heap adds its large blocks)
+    size_t mapped_limit; // Most bytes the arena may map, 0 for no limit (only heaps set one)
+    unsigned int frees_since_purge; // Frees into the pools since they were last purged
+} __attribute__((aligned(64))) PoolArena; // One cache line apart, no false sharing between arenas
+
+// Arena of the calling thread (assigned on first call)
+PoolArena* pool_arena_for_thread(void);
+
+// Set up an arena with no pools and no limit (the shared arenas, or the private arena of a heap)
+void pool_arena_init(PoolArena* arena);
+
+// Unmap every pool of a locked arena at once, whatever is still allocated in them. For private
+// arenas only: nothing may point into the pools afterwards
+void pool_arena_release_all(PoolArena* arena);
+
+// Pool that contains ptr, NULL if ptr is not inside any pool. Lock-free
+BuddyPool* pool_arena_lookup(const void* ptr);
+
+// Lock an arena and give back the blocks freed remotely in the meantime
+void pool_arena_lock(PoolArena* arena);
+
+// Unlock an arena
+void pool_arena_unlock(PoolArena* arena);
+
+// Allocate from a chain of a locked arena, mapping a new pool if none has room (NULL if mmap fails
+// or a new pool would take the arena past its mapped_limit)
+void* pool_arena_malloc_locked(PoolArena* arena, PoolKind kind, size_t size, int metabuddy);
+
+// Free a block of a pool whose arena is locked, unmapping the pool if it became a spare empty pool
+void pool_arena_free_locked(BuddyPool* pool, void* ptr, int metabuddy);
+
+// Allocate up to count blocks of size bytes from a chain of a locked arena into out, mapping new pools
+// as needed. Returns how many were allocated (fewer than count only if a new pool cannot be mapped)
+size_t pool_arena_malloc_batch_locked(PoolArena* arena, PoolKind kind, size_t size, size_t count, void** out);
+
+// Free count blocks of one pool whose arena is locked (ptrs is sorted in place), then unmap the pool
+// if it became a spare empty pool
+void pool_arena_free_batch_locked(BuddyPool* pool, void** ptrs, size_t count);
+
+// Give the free memory of a locked arena back to the OS: its empty pools are unmapped, and the pages
+// of the free blocks of two pages or more in its other pools are dropped. Returns the bytes given back
+size_t pool_arena_trim_locked(PoolArena* arena);
+
+// pool_arena_trim_locked on every shared arena, each locked in turn
+size_t pool_arena_trim_all(void);
+
+// Hand a block (start of a buddy block or slab object) back to an arena without taking its lock
+void pool_arena_free_remote(PoolArena* arena, void* block);
+
+#endif // POOL_ARENA_H
@@ -0,0 +1,42 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "bitmap.h"
+#include "my_malloc.h"
+
+#define SLAB_SIZE 4096 // Each slab is one 4 KB buddy block, whatever the page size of the system
+#define SLAB_BITMAP_WORDS (SLAB_SIZE / 8 / BITMAP_WORD_BITS) // Enough words for the 8-byte class
+
+struct PoolArena;
+
+/*
+ * Slab: a buddy block carved into objects of a single size class. The header sits at
+ * the start of the block and the objects follow it, so the slab of an object is found
+ * by rounding its address down to SLAB_SIZE (buddy blocks are aligned to their size).
+ * Slabs with free objects are kept on a per-class list of their arena
+ */
+typedef struct Slab {
+    struct Slab* next; // Next slab of the same class with free objects
+    struct Slab* prev; // Previous slab of the same class with free objects
+    Bitmap free_map; // One bit per object: set when the object is free
+    uint32_t object_size; // Size of every object of the slab
+    uint32_t free_count; // Number of free objects
+    uint64_t free_words[SLAB_BITMAP_WORDS]; // Storage of free_map
+} Slab;
+
+// Class of a request size, SLAB_CLASSES if the size is too big for a slab
+int slab_class_for_size(size_t size);
+
+// Object size of a class
+size_t slab_class_size(int slab_class);
+
+// Allocate an object of a class from the slabs of a locked arena (a new slab is taken if all are full)
+void* slab_malloc_locked(struct PoolArena* arena, int slab_class);
+
+// Free an object, the arena that owns its slab must be locked. An empty slab goes back to its pool
+void slab_free_locked(struct PoolArena* arena, void* ptr);
+
+// Size of the allocated object at ptr (0 if ptr is not one). Lock-free, like BuddyAllocator_block_size
+size_t slab_object_size(const void* ptr);
+
+#endif // SLAB_H
@@ -1,9 +1,14 @@
 #include "../include/bitmap.h"
 #include "../include/debug_print.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BITMAP_HAVE_X86 1
+#endif
+
 Bitmap* bitmap_init(size_t size) {
     Bitmap* bitmap = (Bitmap*)malloc(sizeof(Bitmap));
-    
+
     if (!bitmap) {
         DEBUG_FPRINTF(stderr, "[bitmap_init]: Allocation of bitmap struct failed\n");
         return NULL;
@@ -11,19 +16,18 @@ Bitmap* bitmap_init(size_t size) {
 
     bitmap->size = size;
 
-    // We round up to the nearest byte by adding 7 before dividing by 8.
-    // This ensures that we have enough space for all bits.
-    size_t bytes_needed = (size + 7) / 8;
-    bitmap->bits = (unsigned char*)malloc(bytes_needed * sizeof(unsigned char));
-    
+    // We round up to the nearest word so that every bit has a place in the storage
+    size_t bytes_needed = bitmap_storage_size(size);
+    bitmap->bits = (uint64_t*)malloc(bytes_needed);
+
     if (!bitmap->bits) {
         DEBUG_FPRINTF(stderr, "[bitmap_init]: Error: Allocation of bitmap bits failed\n");
         free(bitmap);
         return NULL;
     }
-    
+
     // Initialize all bits to 0
-    if (memset(bitmap->bits, 0, bytes_needed * sizeof(unsigned char)) == NULL) {
+    if (memset(bitmap->bits, 0, bytes_needed) == NULL) {
         DEBUG_FPRINTF(stderr, "[bitmap_init]: Error: Setting bits to 0 failed\n");
         free(bitmap->bits);
         free(bitmap);
@@ -33,38 +37,53 @@ Bitmap* bitmap_init(size_t size) {
     return bitmap;
 }
 
+Bitmap* bitmap_init_inplace(Bitmap* bitmap, size_t size, void* storage) {
+
+    if (!bitmap || !storage) {
+        DEBUG_FPRINTF(stderr, "[bitmap_init_inplace]: Error: Invalid bitmap or storage pointer\n");
+        return NULL;
+    }
+
+    bitmap->size = size;
+    bitmap->bits = (uint64_t*)storage;
+
+    // Initialize all bits to 0
+    memset(bitmap->bits, 0, bitmap_storage_size(size));
+
+    return bitmap;
+}
+
+size_t bitmap_storage_size(size_t size) {
+    // Round up to the nearest word (adding 63 before dividing by 64)
+    return ((size + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS) * sizeof(uint64_t);
+}
+
 void bitmap_free(Bitmap* bitmap){
-    
+
     if (!bitmap) {
         DEBUG_FPRINTF(stderr, "[bitmap_free]: Error: Invalid bitmap pointer\n");
         return;
     }
-    
+
     free(bitmap->bits);
     free(bitmap);
-    
+
 }
 
 void bitmap_set(Bitmap* bitmap, size_t index) {
-    
+
     if (!bitmap) {
         DEBUG_FPRINTF(stderr, "[bitmap_set]: Error: Invalid bitmap pointer\n");
         return;
     }
 
     if (index >= bitmap->size) {
-        DEBUG_FPRINTF(stderr, "[bitmap_set]: Error: Index %zu out of bounds (max: %zu)\n", 
+        DEBUG_FPRINTF(stderr, "[bitmap_set]: Error: Index %zu out of bounds (max: %zu)\n",
                 index, bitmap->size - 1);
         return;
     }
 
-    // For setting a bit:
-    // 1. Get the byte containing the bit
-    // 2. Create a mask for the specific bit
-    // 3. Use bitwise OR to set it
-    int byte_index = index / 8; // Get the byte index
-    int mask = (1 << (index % 8)); // Create a mask for the specific bit
-    bitmap->bits[byte_index] |= mask; // Set the bit using OR operation
+    bitmap_set_fast(bitmap, index);
 
 }
 
@@ -76,18 +95,12 @@ void bitmap_clear(Bitmap* bitmap, size_t index) {
     }
 
     if (index >= bitmap->size) {
-        DEBUG_FPRINTF(stderr, "[bitmap_clear]: Error: Index %zu out of bounds (max: %zu)\n", 
+        DEBUG_FPRINTF(stderr, "[bitmap_clear]: Error: Index %zu out of bounds (max: %zu)\n",
                 index, bitmap->size - 1);
         return;
     }
 
-    // For clearing a bit:
-    // 1. Get the byte containing the bit
-    // 2. Create a mask for the specific bit
-    // 3. Use bitwise AND with the negation to clear it
-    int byte_index = index / 8; // Get the byte index
-    int mask = (1 << (index % 8)); // Create a mask for the specific bit
-    bitmap->bits[byte_index] &= ~mask; // Clear the bit using negated mask
+    bitmap_clear_fast(bitmap, index);
 }
 
 // Test if a bit is set or not
@@ -98,14 +111,267 @@ int bitmap_test(const Bitmap* bitmap, size_t index) {
     }
 
     if (index >= bitmap->size) {
-        DEBUG_FPRINTF(stderr, "[bitmap_test]: Error: Index %zu out of bounds (max: %zu)\n", 
+        DEBUG_FPRINTF(stderr, "[bitmap_test]: Error: Index %zu out of bounds (max: %zu)\n",
+                index, bitmap->size - 1);
+        return -1;
+    }
+
+    return bitmap_test_fast(bitmap, index); // Return 1 if set, 0 if not
+
+}
+
+// Flip a bit and return the value it has after the flip
+int bitmap_toggle(Bitmap* bitmap, size_t index) {
+    if (!bitmap) {
+        DEBUG_FPRINTF(stderr, "[bitmap_toggle]: Error: Invalid bitmap pointer\n");
+        return -1;
+    }
+
+    if (index >= bitmap->size) {
+        DEBUG_FPRINTF(stderr, "[bitmap_toggle]: Error: Index %zu out of bounds (max: %zu)\n",
                 index, bitmap->size - 1);
         return -1;
     }
 
-    int byte_index = bitmap->bits[index / 8]; // Get the byte containing the bit
-    int mask = (1 << (index % 8)); // Create a mask for the specific bit
-    int bit_value = byte_index & mask; // Mask application
-    return bit_value ? 1 : 0; // Return 1 if set, 0 if not
+    return bitmap_toggle_fast(bitmap, index);
+}
+
+/*
+ * Word scanning kernels
+ * They return the position of the first word different from `skip` (or count if there is none).
+ * The SSE2/AVX2 versions compare 2/4 words per instruction and are picked at runtime
+ */
+
+typedef size_t (*scan_words_fn)(const uint64_t* words, size_t count, uint64_t skip);
+typedef size_t (*popcount_words_fn)(const uint64_t* words, size_t count);
+
+static size_t scan_words_scalar(const uint64_t* words, size_t count, uint64_t skip) {
+    for (size_t i = 0; i < count; i++) {
+        if (words[i] != skip) {
+            return i;
+        }
+    }
+    return count;
+}
+
+static size_t popcount_words_scalar(const uint64_t* words, size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += (size_t)__builtin_popcountll(words[i]);
+    }
+    return total;
+}
+
+#ifdef BITMAP_HAVE_X86
+
+__attribute__((target("sse2")))
+static size_t scan_words_sse2(const uint64_t* words, size_t count, uint64_t skip) {
+    __m128i pattern = _mm_set1_epi64x((long long)skip);
+    size_t i = 0;
+
+    for (; i + 2 <= count; i += 2) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(words + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, pattern)) != 0xFFFF) {
+            break;
+        }
+    }
+
+    return i + scan_words_scalar(words + i, count - i, skip);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_words_avx2(const uint64_t* words, size_t count, uint64_t skip) {
+    __m256i pattern = _mm256_set1_epi64x((long long)skip);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(words + i));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, pattern)) != -1) {
+            break;
+        }
+    }
+
+    return i + scan_words_scalar(words + i, count - i, skip);
+}
+
+__attribute__((target("popcnt")))
+static size_t popcount_words_popcnt(const uint64_t* words, size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += (size_t)__builtin_popcountll(words[i]);
+    }
+    return total;
+}
+
+#endif
+
+static size_t scan_words_resolve(const uint64_t* words, size_t count, uint64_t skip);
+static size_t popcount_words_resolve(const uint64_t* words, size_t count);
+
+// Start on the resolvers, which replace themselves with the best kernel on first use
+static scan_words_fn scan_words_impl = scan_words_resolve;
+static popcount_words_fn popcount_words_impl = popcount_words_resolve;
+
+static size_t scan_words_resolve(const uint64_t* words, size_t count, uint64_t skip) {
+    scan_words_fn kernel = scan_words_scalar;
+#ifdef BITMAP_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernel = scan_words_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        kernel = scan_words_sse2;
+    }
+#endif
+    __atomic_store_n(&scan_words_impl, kernel, __ATOMIC_RELAXED);
+    return kernel(words, count, skip);
+}
+
+static size_t popcount_words_resolve(const uint64_t* words, size_t count) {
+    popcount_words_fn kernel = popcount_words_scalar;
+#ifdef BITMAP_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("popcnt")) {
+        kernel = popcount_words_popcnt;
+    }
+#endif
+    __atomic_store_n(&popcount_words_impl, kernel, __ATOMIC_RELAXED);
+    return kernel(words, count);
+}
+
+static inline size_t scan_words(const uint64_t* words, size_t count, uint64_t skip) {
+    return __atomic_load_n(&scan_words_impl, __ATOMIC_RELAXED)(words, count, skip);
+}
+
+static inline size_t popcount_words(const uint64_t* words, size_t count) {
+    return __atomic_load_n(&popcount_words_impl, __ATOMIC_RELAXED)(words, count);
+}
+
+// Mask of the bits at or above `start` inside its word
+static inline uint64_t mask_from(size_t start) {
+    return ~(uint64_t)0 << (start % BITMAP_WORD_BITS);
+}
+
+// Mask of the bits below `end` inside the word holding bit end - 1
+static inline uint64_t mask_until(size_t end) {
+    size_t used = end % BITMAP_WORD_BITS;
+    return used ? (((uint64_t)1 << used) - 1) : ~(uint64_t)0;
+}
+
+// Clamp a range to the bitmap, returns 0 if it is empty
+static int clamp_range(const Bitmap* bitmap, size_t start, size_t* end) {
+    if (*end > bitmap->size) {
+        *end = bitmap->size;
+    }
+    return start < *end;
+}
+
+// First bit of the range equal to `value`: words are XORed with `invert` so that
+// we always look for a set bit, and whole words equal to `invert` are skipped
+static size_t find_first_bit(const Bitmap* bitmap, size_t start, size_t end, int value) {
+    if (!bitmap || !clamp_range(bitmap, start, &end)) {
+        return BITMAP_NOT_FOUND;
+    }
+
+    uint64_t invert = value ? 0 : ~(uint64_t)0;
+    size_t first_word = start / BITMAP_WORD_BITS;
+    size_t last_word = (end - 1) / BITMAP_WORD_BITS;
+
+    // First (possibly partial) word
+    uint64_t word = (bitmap->bits[first_word] ^ invert) & mask_from(start);
+    if (first_word == last_word) {
+        word &= mask_until(end);
+    }
+    if (word) {
+        return first_word * BITMAP_WORD_BITS + (size_t)__builtin_ctzll(word);
+    }
+    if (first_word == last_word) {
+        return BITMAP_NOT_FOUND;
+    }
+
+    // Whole words in the middle
+    size_t middle = first_word + 1;
+    size_t middle_count = last_word - middle;
+    size_t found = scan_words(bitmap->bits + middle, middle_count, invert);
+    if (found < middle_count) {
+        word = bitmap->bits[middle + found] ^ invert;
+        return (middle + found) * BITMAP_WORD_BITS + (size_t)__builtin_ctzll(word);
+    }
+
+    // Last (possibly partial) word
+    word = (bitmap->bits[last_word] ^ invert) & mask_until(end);
+    if (word) {
+        return last_word * BITMAP_WORD_BITS + (size_t)__builtin_ctzll(word);
+    }
+
+    return BITMAP_NOT_FOUND;
+}
+
+size_t bitmap_find_first_zero(const Bitmap* bitmap, size_t start, size_t end) {
+    return find_first_bit(bitmap, start, end, 0);
+}
+
+size_t bitmap_find_first_set(const Bitmap* bitmap, size_t start, size_t end) {
+    return find_first_bit(bitmap, start, end, 1);
+}
+
+int bitmap_range_all_zero(const Bitmap* bitmap, size_t start, size_t end) {
+    return find_first_bit(bitmap, start, end, 1) == BITMAP_NOT_FOUND;
+}
+
+// Set (value = 1) or clear the bits of mask in one word, stored whole for the lock-free readers
+static inline void fill_word(uint64_t* word, uint64_t mask, int value) {
+    __atomic_store_n(word, value ? (*word | mask) : (*word & ~mask), __ATOMIC_RELAXED);
+}
+
+// Write `value` into every bit of the range, whole words at a time
+static void fill_range(Bitmap* bitmap, size_t start, size_t end, int value) {
+    if (!bitmap) {
+        DEBUG_FPRINTF(stderr, "[bitmap_fill_range]: Error: Invalid bitmap pointer\n");
+        return;
+    }
+    if (!clamp_range(bitmap, start, &end)) {
+        return;
+    }
+
+    size_t first_word = start / BITMAP_WORD_BITS;
+    size_t last_word = (end - 1) / BITMAP_WORD_BITS;
+
+    if (first_word == last_word) {
+        fill_word(&bitmap->bits[first_word], mask_from(start) & mask_until(end), value);
+        return;
+    }
+
+    // No memset for the middle words: it may write them a byte at a time
+    fill_word(&bitmap->bits[first_word], mask_from(start), value);
+    uint64_t whole = value ? ~(uint64_t)0 : 0;
+    for (size_t word = first_word + 1; word < last_word; word++) {
+        __atomic_store_n(&bitmap->bits[word], whole, __ATOMIC_RELAXED);
+    }
+    fill_word(&bitmap->bits[last_word], mask_until(end), value);
+}
+
+void bitmap_set_range(Bitmap* bitmap, size_t start, size_t end) {
+    fill_range(bitmap, start, end, 1);
+}
+
+void bitmap_clear_range(Bitmap* bitmap, size_t start, size_t end) {
+    fill_range(bitmap, start, end, 0);
+}
+
+size_t bitmap_popcount(const Bitmap* bitmap, size_t start, size_t end) {
+    if (!bitmap || !clamp_range(bitmap, start, &end)) {
+        return 0;
+    }
+
+    size_t first_word = start / BITMAP_WORD_BITS;
+    size_t last_word = (end - 1) / BITMAP_WORD_BITS;
+
+    if (first_word == last_word) {
+        return (size_t)__builtin_popcountll(bitmap->bits[first_word] & mask_from(start) & mask_until(end));
+    }
 
+    size_t total = (size_t)__builtin_popcountll(bitmap->bits[first_word] & mask_from(start));
+    total += popcount_words(bitmap->bits + first_word + 1, last_word - first_word - 1);
+    total += (size_t)__builtin_popcountll(bitmap->bits[last_word] & mask_until(end));
+    return total;
 }
@@ -1,112 +1,431 @@
+#define _GNU_SOURCE
 #include "../include/buddy_allocator.h"
+#include "../include/malloc_stats.h"
+#include "../include/huge_pages.h"
 #include "../include/debug_print.h"
 
-// Check if any parent node up the tree is marked as allocated
-static int any_ancestor_set(const Bitmap* bm, size_t node_index) {
-    if (!bm) 
+_Static_assert(((size_t)MIN_BLOCK_SIZE << (MAX_LEVELS - 1)) == MAX_BLOCK_SIZE,
+               "MAX_LEVELS does not match MAX_BLOCK_SIZE / MIN_BLOCK_SIZE");
+_Static_assert(MIN_BLOCK_ORDER >= 4 && MIN_BLOCK_ORDER < BUDDY_POOL_ORDER,
+               "MIN_BLOCK_ORDER must be at least 4 (free blocks hold two pointers) and below BUDDY_POOL_ORDER");
+_Static_assert(MAX_LEVELS < (1 << BUDDY_TAG_BITS), "level tags hold level + 1 in BUDDY_TAG_BITS bits");
+
+// Size of the blocks at a given level (level 0 is the whole pool)
+static inline size_t block_size_at_level(int level) {
+    return (size_t)MAX_BLOCK_SIZE >> level;
+}
+
+// Level of a node from its bitmap index (level L holds the indexes from 2^L - 1 to 2^(L+1) - 2)
+static inline int level_of_node(size_t node_index) {
+    return 63 - __builtin_clzll((unsigned long long)node_index + 1);
+}
+
+// Memory address of the block represented by a node
+static inline void* node_to_address(const BuddyAllocator* allocator, size_t node_index, int level) {
+    size_t index_in_level = node_index - (((size_t)1 << level) - 1);
+    return (char*)allocator->memory_pool + index_in_level * block_size_at_level(level);
+}
+
+// Bitmap index of the block of the given level that starts at ptr
+static inline size_t address_to_node(const BuddyAllocator* allocator, const void* ptr, int level) {
+    size_t offset = (const char*)ptr - (const char*)allocator->memory_pool;
+    return (((size_t)1 << level) - 1) + offset / block_size_at_level(level);
+}
+
+// First MIN_BLOCK_SIZE unit of the block represented by a node
+static inline size_t node_to_unit(size_t node_index, int level) {
+    size_t index_in_level = node_index - (((size_t)1 << level) - 1);
+    return index_in_level << (MAX_LEVELS - 1 - level);
+}
+
+// Level tag of a unit: level + 1 of the allocated block that starts there, 0 if none.
+// With 4-bit tags two tags share a byte; bytes are read and written whole (relaxed atomics)
+// so that lock-free readers never see a torn byte while the lock holder updates the other tag
+static inline int tag_get(const BuddyAllocator* allocator, size_t unit) {
+#if BUDDY_TAG_BITS == 8
+    return __atomic_load_n(&allocator->level_tags[unit], __ATOMIC_RELAXED);
+#else
+    uint8_t byte = __atomic_load_n(&allocator->level_tags[unit / 2], __ATOMIC_RELAXED);
+    return (byte >> ((unit & 1) * 4)) & 0xF;
+#endif
+}
+
+static inline void tag_set(BuddyAllocator* allocator, size_t unit, int tag) {
+#if BUDDY_TAG_BITS == 8
+    __atomic_store_n(&allocator->level_tags[unit], (uint8_t)tag, __ATOMIC_RELAXED);
+#else
+    uint8_t* byte = &allocator->level_tags[unit / 2];
+    int shift = (int)(unit & 1) * 4;
+    __atomic_store_n(byte, (uint8_t)((*byte & ~(0xF << shift)) | (tag << shift)), __ATOMIC_RELAXED);
+#endif
+}
+
+// Smallest level whose blocks are still large enough for the request (size <= MAX_BLOCK_SIZE):
+// MAX_LEVELS - 1 - (ceil(log2(size)) - MIN_BLOCK_ORDER), no loop over the levels
+static inline int level_for_size(size_t size) {
+    if (size <= MIN_BLOCK_SIZE) {
+        return MAX_LEVELS - 1;
+    }
+    int order = 64 - __builtin_clzll((unsigned long long)size - 1);
+    return BUDDY_POOL_ORDER - order;
+}
+
+/*
+ * Untouched blocks: a fresh pool is zero and none of its pages is mapped in until written.
+ * The pool is handed out from its low end, so everything past written_end has never been
+ * written, and a free block there already reads as a header of {NULL, NULL}: alone on its
+ * list it needs no write at all. Splitting a fresh pool down to a small block then touches
+ * none of the upper halves it frees, and a light user only pays for the pages it writes
+ */
+
+// Record that [start, end) of the pool has been written or handed out: the written end moves
+// past it, and its pages may be resident until a purge gives them back
+static inline void mark_written(BuddyAllocator* allocator, const void* start, const void* end) {
+    size_t offset = (size_t)((const char*)end - (const char*)allocator->memory_pool);
+    if (offset > allocator->written_end) {
+        allocator->written_end = offset;
+    }
+    size_t first = (size_t)((const char*)start - (const char*)allocator->memory_pool) / BUDDY_DIRTY_UNIT;
+    size_t last = (offset + BUDDY_DIRTY_UNIT - 1) / BUDDY_DIRTY_UNIT;
+    if (last - first == 1) {
+        bitmap_set_fast(&allocator->dirty_bitmap, first);
+    } else {
+        bitmap_set_range(&allocator->dirty_bitmap, first, last);
+    }
+}
+
+static inline int is_untouched(const BuddyAllocator* allocator, const void* block) {
+    return (size_t)((const char*)block - (const char*)allocator->memory_pool) >= allocator->written_end;
+}
+
+// Put a block at the head of the free list of its level
+static void free_list_push(BuddyAllocator* allocator, size_t node_index, int level) {
+    BuddyFreeBlock* block = (BuddyFreeBlock*)node_to_address(allocator, node_index, level);
+    BuddyFreeBlock* head = allocator->free_lists[level];
+
+    // Untouched and alone on its list: its header is already right
+    if (head || !is_untouched(allocator, block)) {
+        block->prev = NULL;
+        block->next = head;
+        mark_written(allocator, block, block + 1);
+        if (head) {
+            head->prev = block;
+            mark_written(allocator, head, head + 1);
+        }
+    }
+    allocator->free_lists[level] = block;
+}
+
+// Unlink a block from the free list of its level (O(1) thanks to the prev pointer)
+static void free_list_remove(BuddyAllocator* allocator, size_t node_index, int level) {
+    BuddyFreeBlock* block = (BuddyFreeBlock*)node_to_address(allocator, node_index, level);
+
+    // An untouched block is alone on its list (linking it to another one writes it): no need to read it
+    if (is_untouched(allocator, block)) {
+        allocator->free_lists[level] = NULL;
+        return;
+    }
+
+    if (block->prev) {
+        block->prev->next = block->next;
+    } else {
+        allocator->free_lists[level] = block->next;
+    }
+    if (block->next) {
+        block->next->prev = block->prev;
+    }
+}
+
+// A node goes from free to in use (allocated or split) or back: flip the bit of its buddy pair.
+// Returns the new value of the pair bit (0 means both buddies are now in the same state)
+static inline int flip_pair_bit(BuddyAllocator* allocator, size_t node_index) {
+    // The pair bit is indexed by the parent, the root has no buddy
+    return bitmap_toggle_fast(&allocator->allocation_bitmap, (node_index - 1) / 2);
+}
+
+// Take a free block of the given level, splitting a larger free block when needed.
+// Returns 1 and the bitmap index of the block on success, 0 if nothing large enough is free
+static int take_block(BuddyAllocator* allocator, int level, size_t* node_index) {
+
+    // Every level from the requested one up to the root can serve the request.
+    // Among the heads of those lists pick the lowest address, so that the low end
+    // of the pool is filled first (same placement the old first-fit scan produced)
+    int source_level = -1;
+    for (int l = level; l >= 0; l--) {
+        BuddyFreeBlock* head = allocator->free_lists[l];
+        if (head && (source_level < 0 || head < allocator->free_lists[source_level])) {
+            source_level = l;
+        }
+    }
+
+    if (source_level < 0) {
         return 0;
+    }
 
-    // Walk up the tree checking each parent
-    while (node_index > 0) {
+    size_t node = address_to_node(allocator, allocator->free_lists[source_level], source_level);
+    free_list_remove(allocator, node, source_level);
+    if (source_level > 0) {
+        flip_pair_bit(allocator, node);
+    }
 
-        // Get the parent index
-        size_t parent = (node_index - 1) / 2;
-        // Ex. 0 -> 0, 1 -> 0, 2 -> 1, 3 -> 1, 4 -> 2, 5 -> 2, 6 -> 3, 7 -> 3
+    // Split down to the requested level: keep the lower half, free the upper half (its buddy)
+    for (int l = source_level; l < level; l++) {
+        size_t lower_child = 2 * node + 1;
+
+        bitmap_set_fast(&allocator->split_bitmap, node);
+        flip_pair_bit(allocator, lower_child); // Lower child in use, upper child free
+        free_list_push(allocator, lower_child + 1, l + 1);
+
+        node = lower_child;
+    }
 
-        // Check if this parent is allocated
-        if(bitmap_test(bm, parent)){
-            return 1;
+    tag_set(allocator, node_to_unit(node, level), level + 1);
+    char* address = node_to_address(allocator, node, level);
+    mark_written(allocator, address, address + block_size_at_level(level));
+
+    *node_index = node;
+    return 1;
+}
+
+// Give a block back and merge it with its buddy for as long as the buddy is free
+static void release_block(BuddyAllocator* allocator, size_t node_index, int level) {
+
+    tag_set(allocator, node_to_unit(node_index, level), 0);
+
+    while (level > 0) {
+        // The pair bit was 1 (we in use, buddy free) or 0 (both in use):
+        // after the flip a 0 means both buddies are free
+        if (flip_pair_bit(allocator, node_index) != 0) {
+            break;
         }
 
-        // Move up to the next level
+        // Left children have odd indexes, right children even ones
+        size_t buddy = (node_index & 1) ? node_index + 1 : node_index - 1;
+        size_t parent = (node_index - 1) / 2;
+
+        // Buddy is free as a whole: take it off its list and move up to the parent
+        free_list_remove(allocator, buddy, level);
+        bitmap_clear_fast(&allocator->split_bitmap, parent);
         node_index = parent;
+        level--;
     }
 
-    // Arrived at the root without finding any allocated ancestors
-    return 0;
+    free_list_push(allocator, node_index, level);
 }
 
-// Check if any child nodes below this one are allocated
-static int any_descendant_set(const Bitmap* bm, size_t node_index, int node_level) {
-    if (!bm) 
+// Set (or clear) the split bits of the nodes of a subtree from its root at root_level down to the
+// level above leaf_level: one bitmap range per level, the nodes of a subtree being contiguous in each
+static void set_subtree_split(BuddyAllocator* allocator, size_t root, int root_level, int leaf_level, int split) {
+    size_t first = root;
+    for (int l = root_level; l < leaf_level; l++) {
+        size_t width = (size_t)1 << (l - root_level);
+        if (split) {
+            bitmap_set_range(&allocator->split_bitmap, first, first + width);
+        } else {
+            bitmap_clear_range(&allocator->split_bitmap, first, first + width);
+        }
+        first = 2 * first + 1;
+    }
+}
+
+// Turn a block just taken at span_level into all its blocks of the given level, each one
+// allocated, and store their addresses in out. The subtree was free as a whole, so its
+// pair bits are all 0, and they stay 0 with every block of the subtree in use
+static void carve_block(BuddyAllocator* allocator, size_t node_index, int span_level, int level, void** out) {
+    set_subtree_split(allocator, node_index, span_level, level, 1);
+    char* address = node_to_address(allocator, node_index, span_level);
+    mark_written(allocator, address, address + block_size_at_level(span_level));
+
+    size_t unit = node_to_unit(node_index, span_level);
+    size_t unit_step = (size_t)1 << (MAX_LEVELS - 1 - level);
+    size_t leaves = (size_t)1 << (level - span_level);
+    for (size_t i = 0; i < leaves; i++) {
+        tag_set(allocator, unit + i * unit_step, level + 1);
+        out[i] = address + i * block_size_at_level(level);
+    }
+}
+
+// Check that an index names a block handed out by the allocator: the tag of its first
+// unit holds its level. Free blocks and split blocks have no tag, so double frees are caught
+static int is_allocated_node(const BuddyAllocator* allocator, size_t node_index, int level) {
+    return tag_get(allocator, node_to_unit(node_index, level)) == level + 1;
+}
+
+// Find the block in use that starts at ptr (ptr must be inside the pool) in O(1): the
+// tag of the unit at ptr is the level of the block. The tag of a block in use does not
+// change until the block is freed, so this is safe without the lock
+static int find_block(const BuddyAllocator* allocator, const void* ptr, int* level, size_t* node_index) {
+    size_t offset = (size_t)((const char*)ptr - (const char*)allocator->memory_pool);
+    if (offset % MIN_BLOCK_SIZE) {
+        return 0;
+    }
+
+    int tag = tag_get(allocator, offset / MIN_BLOCK_SIZE);
+    if (tag == 0) {
         return 0;
-    
-    int max_depth = MAX_LEVELS;
+    }
 
-    // Calculate how many levels are below the current node
-    int levels_below = (max_depth - 1) - node_level;
-    // Ex. node level = 2, levels below = (14 - 1) - 2 = 11
+    *level = tag - 1;
+    *node_index = address_to_node(allocator, ptr, tag - 1);
+    return 1;
+}
 
-    // Check each level below the current node
-    for (int level = 1; level <= levels_below; level++) {
+// Next address tried for a region: right below the last one, so that the kernel (which
+// hands out addresses top-down) usually gives an aligned region on the first mmap
+static char* next_region_hint = NULL;
 
-        // Calculate the number of children at this level
-        size_t num_children = ((size_t)1 << level); // 2^level
+_Static_assert(sizeof(BuddyAllocator) <= BUDDY_STRUCT_AREA, "BuddyAllocator must fit in BUDDY_STRUCT_AREA");
 
-        // Convert to 1-based (to have and easy formula to find the first child)
-        size_t node_index_1based = (node_index + 1);
+// Bytes mapped for a pool: pool, metadata and, for a self-hosted allocator, its struct,
+// in whole pages (the page size is only known at run time)
+static inline size_t region_map_size(int self_hosted) {
+    size_t size = BUDDY_REGION_SIZE + (self_hosted ? BUDDY_STRUCT_AREA : 0);
+    return (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+}
 
-        // Calculate the 1-based index of the first child at this level
-        size_t first_child_1based = node_index_1based * num_children;
+// Whether pools are huge page backed: only when huge pages are on and a pool fills whole
+// huge pages. A smaller pool would take a whole huge page on its first write, most of it
+// never used (and the pool alignment already makes a bigger one huge page aligned)
+static inline int pools_on_huge_pages(void) {
+    return MAX_BLOCK_SIZE >= HUGE_PAGE_SIZE && huge_page_mode() != HUGE_PAGES_OFF;
+}
 
-        // Convert to 0-based
-        size_t first_child = first_child_1based - 1;
-        
-        // Check each child at this level
-        for (size_t i = 0; i < num_children; i++) {
-            if (bitmap_test(bm, first_child + i)) {
-                return 1;
+// Map size bytes (whole pages) aligned to MAX_BLOCK_SIZE, the pool itself huge page
+// backed when pools are. NULL on failure
+static char* map_aligned_region(size_t size) {
+    int huge = pools_on_huge_pages();
+    size_t alignment = MAX_BLOCK_SIZE;
+    size_t span = (size + alignment - 1) & ~(alignment - 1);
+
+    char* hint = __atomic_load_n(&next_region_hint, __ATOMIC_RELAXED);
+    if (hint) {
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_FIXED_NOREPLACE
+        flags |= MAP_FIXED_NOREPLACE; // Fail instead of mapping elsewhere (older kernels treat it as a plain hint)
+#endif
+        char* region = mmap(hint, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (region != MAP_FAILED) {
+            stats_mmap(size);
+        }
+        if (region == hint && ((uintptr_t)region & (alignment - 1)) == 0) {
+            __atomic_store_n(&next_region_hint, (uintptr_t)region > span ? region - span : NULL, __ATOMIC_RELAXED);
+            if (huge) {
+                huge_pages_advise(region, MAX_BLOCK_SIZE);
             }
+            return region;
+        }
+        if (region != MAP_FAILED) {
+            munmap(region, size);
+            stats_munmap(size);
         }
     }
-    
-    // Checked all descendants, none are allocated
-    return 0;
+
+    // Map one extra alignment and trim the misaligned head and the unused tail
+    char* raw = mmap(NULL, size + alignment, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+    stats_mmap(size + alignment);
+
+    char* region = (char*)(((uintptr_t)raw + alignment - 1) & ~((uintptr_t)alignment - 1));
+    size_t head = (size_t)(region - raw);
+    if (head) {
+        munmap(raw, head);
+        stats_munmap(head);
+    }
+    munmap(region + size, alignment - head);
+    stats_munmap(alignment - head);
+
+    __atomic_store_n(&next_region_hint, (uintptr_t)region > span ? region - span : NULL, __ATOMIC_RELAXED);
+    if (huge) {
+        huge_pages_advise(region, MAX_BLOCK_SIZE);
+    }
+    return region;
 }
 
+#ifdef DEBUG_PRINT
+// Tell a full pool from a fragmented one when a request finds no free block
+static void debug_print_occupancy(const BuddyAllocator* allocator, const char* caller) {
+    BuddyOccupancy occupancy;
+    BuddyAllocator_occupancy(allocator, &occupancy);
+    if (occupancy.free_bytes == 0) {
+        DEBUG_FPRINTF(stderr, "[%s]: Pool is full\n", caller);
+    } else {
+        DEBUG_FPRINTF(stderr, "[%s]: Pool is fragmented: %zu bytes free, largest free block %zu bytes\n",
+                      caller, occupancy.free_bytes, occupancy.largest_free_block);
+    }
+}
+#endif
+
 BuddyAllocator* BuddyAllocator_init(BuddyAllocator* allocator) {
-    
-    DEBUG_PRINTF("[BuddyAllocator_init]: Initializing Buddy Allocator\n");
 
-    // If allocator is NULL, create a new one
-    if (!allocator) {
-        allocator = malloc(sizeof(BuddyAllocator));
-        if (!allocator) {
-            DEBUG_FPRINTF(stderr, "[BuddyAllocator_init]: Error: Memory allocation failed\n");
-            return NULL;
-        }
+    DEBUG_PRINTF("[BuddyAllocator_init]: Initializing Buddy Allocator\n");
 
-        // Initialize pointers to NULL for new allocator
-        allocator->memory_pool = NULL;
-        allocator->allocation_bitmap = NULL;
+    // Already initialized, nothing to do
+    if (allocator && allocator->memory_pool) {
+        return allocator;
     }
 
-    // Check if memory pool needs allocation
-    if (!allocator->memory_pool) {
-        allocator->memory_pool = malloc(MAX_BLOCK_SIZE);
-        if (!allocator->memory_pool) {
-            DEBUG_FPRINTF(stderr, "[BuddyAllocator_init]: Error: Memory pool allocation failed\n");
-            if (allocator->allocation_bitmap) {
-                free(allocator);
-            }
-            return NULL;
-        }
+    // Pool and tree metadata come from a single mapping: the bitmaps and the level tags
+    // are sized from MAX_LEVELS (12 KB in total for a 1 MB pool) and live right after the pool.
+    // The written pages map follows them The pool is
+    // aligned to its own size so the pool containing a pointer follows from the pointer's upper bits.
+    // If allocator is NULL, the new one takes BUDDY_STRUCT_AREA more bytes after the metadata
+    int self_hosted = allocator == NULL;
+    char* region = map_aligned_region(region_map_size(self_hosted));
+    if (!region) {
+        DEBUG_FPRINTF(stderr, "[BuddyAllocator_init]: Error: Memory pool allocation failed\n");
+        return NULL;
+    }
+    if (self_hosted) {
+        allocator = (BuddyAllocator*)(region + BUDDY_REGION_SIZE);
     }
 
-    // Check if bitmap needs initialization
-    if (!allocator->allocation_bitmap) {
-        allocator->allocation_bitmap = bitmap_init(MAX_BLOCK_SIZE);
-        if (!allocator->allocation_bitmap) {
-            DEBUG_FPRINTF(stderr, "[BuddyAllocator_init]: Error: Bitmap initialization failed\n");
-            free(allocator->memory_pool);
-            free(allocator);
-            return NULL;
-        }
+    char* metadata = region + MAX_BLOCK_SIZE;
+    bitmap_init_inplace(&allocator->allocation_bitmap, BUDDY_INTERNAL_NODES, metadata);
+    bitmap_init_inplace(&allocator->split_bitmap, BUDDY_INTERNAL_NODES, metadata + BUDDY_BITMAP_SIZE);
+    allocator->level_tags = (uint8_t*)(metadata + 2 * BUDDY_BITMAP_SIZE); // Fresh mapping, already all 0
+    bitmap_init_inplace(&allocator->dirty_bitmap, BUDDY_DIRTY_UNITS, metadata + 2 * BUDDY_BITMAP_SIZE + BUDDY_TAGS_SIZE);
+
+    // At the beginning the whole pool is a single free block at level 0, untouched
+    for (int level = 0; level < MAX_LEVELS; level++) {
+        allocator->free_lists[level] = NULL;
     }
+    allocator->written_end = 0;
+    allocator->free_lists[0] = (BuddyFreeBlock*)region; // Untouched, alone on its list: no header to write
 
+    // Published last: my_free reads the pool bounds without holding the lock
+    __atomic_store_n(&allocator->memory_pool, (void*)region, __ATOMIC_RELEASE);
     return allocator;
 }
 
+void BuddyAllocator_destroy(BuddyAllocator* allocator) {
+
+    if (!allocator || !allocator->memory_pool) {
+        DEBUG_PRINTF("[BuddyAllocator_destroy]: Warning: Buddy Allocator not initialized, nothing to release\n");
+        return;
+    }
+
+    // Bitmap and tag storage is part of the pool mapping, and so is the struct of a
+    // self-hosted allocator (nothing may touch it after the munmap)
+    char* region = allocator->memory_pool;
+    int self_hosted = (char*)allocator == region + BUDDY_REGION_SIZE;
+    size_t size = region_map_size(self_hosted);
+    if (pools_on_huge_pages()) {
+        stats_huge_unmap(MAX_BLOCK_SIZE);
+    }
+    munmap(region, size);
+    stats_munmap(size);
+    if (!self_hosted) {
+        allocator->memory_pool = NULL;
+    }
+}
+
+int BuddyAllocator_is_empty(const BuddyAllocator* allocator) {
+    // A pool with all its blocks free has a single level-0 block (untouched, or fully coalesced)
+    return allocator->memory_pool && allocator->free_lists[0] != NULL;
+}
+
 void* BuddyAllocator_malloc(BuddyAllocator* allocator, size_t size) {
 
     DEBUG_PRINTF("[BuddyAllocator_malloc]: Requested size: %zu bytes\n", size);
@@ -124,7 +443,7 @@ void* BuddyAllocator_malloc(BuddyAllocator* allocator, size_t size) {
     }
 
     // Check if buddy allocator struct is initialized
-    if (!allocator || !allocator->memory_pool || !allocator->allocation_bitmap) {
+    if (!allocator || !allocator->memory_pool) {
         DEBUG_PRINTF("[BuddyAllocator_malloc]: Buddy Allocator not initialized\n");
         allocator = BuddyAllocator_init(allocator);
         if (!allocator) {
@@ -140,65 +459,24 @@ void* BuddyAllocator_malloc(BuddyAllocator* allocator, size_t size) {
     }
 
     // Find the level with blocks large enough for the request
-    size_t block_size = MAX_BLOCK_SIZE;
-    int current_level = 0;
-    while (block_size / 2 >= aligned_size && block_size / 2 >= MIN_BLOCK_SIZE) {
-        block_size /= 2;
-        current_level++;
-    }
-
-    // Variables to store the found block information
-    int level_found = -1;
-    int index_found = -1;
-    int found = 0;
-    
-    // Try to find a free block at this level
-    Bitmap* bitmap = allocator->allocation_bitmap;
-    size_t blocks_at_level = MAX_BLOCK_SIZE / block_size; // Number of blocks at this level
-    size_t start_index = (1 << current_level) - 1; // The index of the first block at this level in the bitmap using 2^level - 1
-
-    for (size_t i = 0; i < blocks_at_level; i++) {
-        size_t bitmap_index = start_index + i;
-
-        // Skip if this block is already allocated
-        if (bitmap_test(bitmap, bitmap_index) == 1) {
-            continue;
-        }
-
-        // Skip if any parent block is allocated (would overlap)
-        if (any_ancestor_set(bitmap, bitmap_index)) {
-            continue;
-        }
-
-        // Skip if any child blocks are allocated (would fragment)
-        if (any_descendant_set(bitmap, bitmap_index, current_level)) {
-            continue;
-        }
-
-        // Found a usable block
-        level_found = current_level;
-        index_found = i;
-        found = 1;
-        break;
-    }
-
-    if (!found) {
-        DEBUG_FPRINTF(stderr, "[BuddyAllocator_malloc]: Error: No free block found at level %d\n", current_level);
+    int level = level_for_size(aligned_size);
+
+    // Pop a block from the free lists (splitting a larger one if needed)
+    size_t node_index;
+    if (!take_block(allocator, level, &node_index)) {
+        DEBUG_FPRINTF(stderr, "[BuddyAllocator_malloc]: Error: No free block found at level %d\n", level);
+#ifdef DEBUG_PRINT
+        debug_print_occupancy(allocator, "BuddyAllocator_malloc");
+#endif
         return NULL;
     }
 
-    // Mark the block as allocated in the bitmap
-    size_t allocated_index = start_index + index_found;
-    bitmap_set(allocator->allocation_bitmap, allocated_index);
+    void* allocated_block = node_to_address(allocator, node_index, level);
 
-    // Calculate the memory address of the allocated block
-    size_t offset = index_found * block_size;
-    void* allocated_block = (void*)((unsigned long)allocator->memory_pool + offset);
-
-    DEBUG_PRINTF("[BuddyAllocator_malloc]: Allocated block at level %d, index %d, address %p, size %zu\n", level_found, index_found, allocated_block, block_size);
+    DEBUG_PRINTF("[BuddyAllocator_malloc]: Allocated block at level %d, bitmap index %zu, address %p, size %zu\n", level, node_index, allocated_block, block_size_at_level(level));
 
     return allocated_block;
-    
+
 }
 
 void* BuddyAllocator_malloc_metabuddy(BuddyAllocator* allocator, size_t size) {
@@ -218,7 +496,7 @@ void* BuddyAllocator_malloc_metabuddy(BuddyAllocator* allocator, size_t size) {
     }
 
     // Check if buddy allocator struct is initialized
-    if (!allocator || !allocator->memory_pool || !allocator->allocation_bitmap) {
+    if (!allocator || !allocator->memory_pool) {
         DEBUG_PRINTF("[BuddyAllocator_malloc_metabuddy]: Buddy Allocator not initialized\n");
         allocator = BuddyAllocator_init(allocator);
         if (!allocator) {
@@ -236,74 +514,39 @@ void* BuddyAllocator_malloc_metabuddy(BuddyAllocator* allocator, size_t size) {
         aligned_size = MIN_BLOCK_SIZE;
     }
 
-    // Find the level with blocks large enough for the request
-    size_t block_size = MAX_BLOCK_SIZE;
-    int current_level = 0;
-    while (block_size / 2 >= aligned_size && block_size / 2 >= MIN_BLOCK_SIZE) {
-        block_size /= 2;
-        current_level++;
-    }
-
-    // Variables to store the found block information
-    int level_found = -1;
-    int index_found = -1;
-    int found = 0;
-    
-    // Try to find a free block at this level
-    Bitmap* bitmap = allocator->allocation_bitmap;
-    size_t blocks_at_level = MAX_BLOCK_SIZE / block_size; // Number of blocks at this level
-    size_t start_index = (1 << current_level) - 1; // The index of the first block at this level in the bitmap using 2^level - 1
-
-    for (size_t i = 0; i < blocks_at_level; i++) {
-        size_t bitmap_index = start_index + i;
-
-        // Skip if this block is already allocated
-        if (bitmap_test(bitmap, bitmap_index) == 1) {
-            continue;
-        }
-
-        // Skip if any parent block is allocated (would overlap)
-        if (any_ancestor_set(bitmap, bitmap_index)) {
-            continue;
-        }
-
-        // Skip if any child blocks are allocated (would fragment)
-        if (any_descendant_set(bitmap, bitmap_index, current_level)) {
-            continue;
-        }
-
-        // Found a usable block
-        level_found = current_level;
-        index_found = i;
-        found = 1;
-        break;
+    // The metadata may push the request past the pool size
+    if (aligned_size > MAX_BLOCK_SIZE) {
+        DEBUG_FPRINTF(stderr, "[BuddyAllocator_malloc_metabuddy]: Error: Requested size plus metadata exceeds maximum block size\n");
+        return NULL;
     }
 
-    if (!found) {
-        DEBUG_FPRINTF(stderr, "[BuddyAllocator_malloc_metabuddy]: Error: No free block found at level %d\n", current_level);
+    // Find the level with blocks large enough for the request
+    int level = level_for_size(aligned_size);
+
+    // Pop a block from the free lists (splitting a larger one if needed)
+    size_t node_index;
+    if (!take_block(allocator, level, &node_index)) {
+        DEBUG_FPRINTF(stderr, "[BuddyAllocator_malloc_metabuddy]: Error: No free block found at level %d\n", level);
+#ifdef DEBUG_PRINT
+        debug_print_occupancy(allocator, "BuddyAllocator_malloc_metabuddy");
+#endif
         return NULL;
     }
 
-    // Mark the block as allocated in the bitmap
-    size_t allocated_index = start_index + index_found;
-    bitmap_set(allocator->allocation_bitmap, allocated_index);
-
-    // Calculate the memory address of the allocated block
-    size_t offset = index_found * block_size;
-    void* allocated_block = (void*)((unsigned long)allocator->memory_pool + offset);
+    void* allocated_block = node_to_address(allocator, node_index, level);
 
     // Store bitmap index for easy freeing
     size_t* metadata = (size_t*)allocated_block;
-    *metadata = allocated_index;
+    *metadata = node_index;
 
     // Move pointer to the location just after the metadata
     void * allocated_block_ptr = (void*)((char*)allocated_block + sizeof(size_t));
 
-    DEBUG_PRINTF("[BuddyAllocator_malloc_metabuddy]: Allocated block at level %d, index %d, address %p, size %zu (including %zu bytes of metadata)\n", 
-           level_found, index_found, allocated_block, block_size, sizeof(size_t));
+    DEBUG_PRINTF("[BuddyAllocator_malloc_metabuddy]: Allocated block at level %d, bitmap index %zu, address %p, size %zu (including %zu bytes of metadata)\n",
+           level, node_index, allocated_block, block_size_at_level(level), sizeof(size_t));
 
     return allocated_block_ptr;
-    
+
 }
 
 void BuddyAllocator_free(BuddyAllocator* allocator, void* ptr) {
@@ -316,7 +559,7 @@ void BuddyAllocator_free(BuddyAllocator* allocator, void* ptr) {
     DEBUG_PRINTF("[BuddyAllocator_free]: Freeing pointer %p\n", ptr);
 
     // Check if buddy is initialized
-    if (!allocator || !allocator->memory_pool || !allocator->allocation_bitmap) {
+    if (!allocator || !allocator->memory_pool) {
         DEBUG_PRINTF("[BuddyAllocator_free]: Error: Buddy Allocator not properly initialized\n");
         return;
     }
@@ -331,50 +574,18 @@ void BuddyAllocator_free(BuddyAllocator* allocator, void* ptr) {
         return;
     }
 
-    // Calculate offset from the start of memory pool
-    size_t offset = (char*)ptr - pool_start;
-    
-    // Find which level this block belongs to by checking all possible levels
-    int found_level = -1;
-    size_t found_index = 0;
-    size_t found_block_size = 0;
-    size_t found_bitmap_index = 0;
-    
-    // Start from the smallest blocks
-    for (int level = 0; level < MAX_LEVELS; level++) {
-        size_t block_size = MAX_BLOCK_SIZE / (1 << level); // is like doing MAX_BLOCK_SIZE / (2^level)
-
-        // Check if this block size is valid (not smaller than minimum)
-        if (block_size < MIN_BLOCK_SIZE) {
-            break;
-        }
-        
-        // Check if the offset is aligned to this block size
-        if (offset % block_size == 0) {
-            size_t block_index = offset / block_size;
-            size_t start_index = ((size_t)1 << level) - 1; // First block index at this level
-            size_t bitmap_index = start_index + block_index;
-            
-            // Check if this block is actually allocated in the bitmap
-            if (bitmap_test(allocator->allocation_bitmap, bitmap_index) == 1) {
-                found_level = level;
-                found_index = block_index;
-                found_block_size = block_size;
-                found_bitmap_index = bitmap_index;
-                break;
-            }
-        }
-    }
-    
-    if (found_level == -1) {
+    // The level tag of the block gives its level directly, no header needed
+    int found_level;
+    size_t found_bitmap_index;
+    if (!find_block(allocator, ptr, &found_level, &found_bitmap_index)) {
         DEBUG_FPRINTF(stderr, "[BuddyAllocator_free]: Error: Could not find allocated block for pointer %p\n", ptr);
         return;
     }
-    
-    // Clear the stored bitmap index
-    bitmap_clear(allocator->allocation_bitmap, found_bitmap_index);
 
-    DEBUG_PRINTF("[BuddyAllocator_free]: Freed block at level %d, index %zu, size %zu bytes\n", found_level, found_index, found_block_size);
+    // Give the block back, merging it with its free buddies
+    release_block(allocator, found_bitmap_index, found_level);
+
+    DEBUG_PRINTF("[BuddyAllocator_free]: Freed block at level %d, bitmap index %zu, size %zu bytes\n", found_level, found_bitmap_index, block_size_at_level(found_level));
 
 }
 
@@ -389,7 +600,7 @@ void BuddyAllocator_free_metabuddy(BuddyAllocator* allocator, void* ptr) {
     DEBUG_PRINTF("[BuddyAllocator_free_metabuddy]: Freeing pointer %p\n", ptr);
 
     // Check if buddy is initialized
-    if (!allocator || !allocator->memory_pool || !allocator->allocation_bitmap) {
+    if (!allocator || !allocator->memory_pool) {
         DEBUG_PRINTF("[BuddyAllocator_free_metabuddy]: Error: Buddy Allocator not properly initialized\n");
         return;
     }
@@ -408,9 +619,409 @@ void BuddyAllocator_free_metabuddy(BuddyAllocator* allocator, void* ptr) {
     size_t* metadata = (size_t*)((char*)ptr - sizeof(size_t));
     size_t found_bitmap_index = *metadata;
 
-    // Clear the stored bitmap index
-    bitmap_clear(allocator->allocation_bitmap, found_bitmap_index);
+    // Reject corrupted metadata or blocks that are not allocated (e.g. double free)
+    if (found_bitmap_index >= ((size_t)1 << MAX_LEVELS) - 1 ||
+        !is_allocated_node(allocator, found_bitmap_index, level_of_node(found_bitmap_index))) {
+        DEBUG_FPRINTF(stderr, "[BuddyAllocator_free_metabuddy]: Error: Bitmap index %zu is not an allocated block\n", found_bitmap_index);
+        return;
+    }
+
+    // Give the block back, merging it with its free buddies
+    release_block(allocator, found_bitmap_index, level_of_node(found_bitmap_index));
 
     DEBUG_PRINTF("[BuddyAllocator_free_metabuddy]: Freed block of bitmap index %zu\n", found_bitmap_index);
 
-}
\ No newline at end of file
+}
+
+size_t BuddyAllocator_malloc_batch(BuddyAllocator* allocator, size_t size, size_t count, void** out) {
+
+    if (!allocator || !allocator->memory_pool || size == 0 || size > MAX_BLOCK_SIZE) {
+        DEBUG_FPRINTF(stderr, "[BuddyAllocator_malloc_batch]: Error: Invalid allocator or size %zu\n", size);
+        return 0;
+    }
+
+    int level = level_for_size(size < MIN_BLOCK_SIZE ? MIN_BLOCK_SIZE : size);
+
+    // Take the largest block whose blocks of the requested level are not more than what is
+    // still missing (2^depth of them) and carve it whole; a count that is not a power of two
+    // takes one span per set bit. A span size that found nothing is not tried again
+    size_t done = 0;
+    int max_depth = level;
+    while (done < count) {
+        int depth = 63 - __builtin_clzll((unsigned long long)(count - done));
+        if (depth > max_depth) {
+            depth = max_depth;
+        }
+
+        size_t node_index;
+        while (!take_block(allocator, level - depth, &node_index)) {
+            if (depth == 0) {
+                DEBUG_FPRINTF(stderr, "[BuddyAllocator_malloc_batch]: Error: No free block found at level %d, %zu of %zu allocated\n", level, done, count);
+                return done;
+            }
+            depth--;
+        }
+        max_depth = depth;
+
+        carve_block(allocator, node_index, level - depth, level, out + done);
+        done += (size_t)1 << depth;
+    }
+
+    DEBUG_PRINTF("[BuddyAllocator_malloc_batch]: Allocated %zu blocks of %zu bytes\n", done, block_size_at_level(level));
+    return done;
+}
+
+// Sift ptrs[node] down the max-heap made of the first end addresses
+static void sift_down(void** ptrs, size_t node, size_t end) {
+    for (;;) {
+        size_t child = 2 * node + 1;
+        if (child >= end) {
+            return;
+        }
+        if (child + 1 < end && (uintptr_t)ptrs[child + 1] > (uintptr_t)ptrs[child]) {
+            child++;
+        }
+        if ((uintptr_t)ptrs[child] <= (uintptr_t)ptrs[node]) {
+            return;
+        }
+        void* swap = ptrs[node];
+        ptrs[node] = ptrs[child];
+        ptrs[child] = swap;
+        node = child;
+    }
+}
+
+void BuddyAllocator_sort_addresses(void** ptrs, size_t count) {
+
+    // Batches are often in order already
+    size_t sorted = 1;
+    while (sorted < count && (uintptr_t)ptrs[sorted - 1] <= (uintptr_t)ptrs[sorted]) {
+        sorted++;
+    }
+    if (sorted >= count) {
+        return;
+    }
+
+    // Heapsort: in place and without recursion, nothing is allocated while an arena is locked
+    for (size_t root = count / 2; root-- > 0;) {
+        sift_down(ptrs, root, count);
+    }
+    for (size_t end = count - 1; end > 0; end--) {
+        void* largest = ptrs[0];
+        ptrs[0] = ptrs[end];
+        ptrs[end] = largest;
+        sift_down(ptrs, 0, end);
+    }
+}
+
+void BuddyAllocator_free_batch(BuddyAllocator* allocator, void** ptrs, size_t count) {
+
+    if (!allocator || !allocator->memory_pool) {
+        DEBUG_PRINTF("[BuddyAllocator_free_batch]: Error: Buddy Allocator not properly initialized\n");
+        return;
+    }
+
+    BuddyAllocator_sort_addresses(ptrs, count);
+
+    char* pool_start = (char*)allocator->memory_pool;
+    char* pool_end = pool_start + MAX_BLOCK_SIZE;
+
+    size_t i = 0;
+    while (i < count) {
+        char* ptr = ptrs[i];
+        int level;
+        size_t node_index;
+        if (ptr < pool_start || ptr >= pool_end || !find_block(allocator, ptr, &level, &node_index)) {
+            if (ptr) {
+                DEBUG_FPRINTF(stderr, "[BuddyAllocator_free_batch]: Error: Could not find allocated block for pointer %p\n", ptr);
+            }
+            i++;
+            continue;
+        }
+
+        // Double the run while the next pointers are the allocated blocks of the same level
+        // that complete an aligned block twice as large: the run is then a whole subtree
+        size_t block_size = block_size_at_level(level);
+        size_t unit = (size_t)(ptr - pool_start) / MIN_BLOCK_SIZE;
+        size_t unit_step = block_size / MIN_BLOCK_SIZE;
+        size_t run = 1;
+        int depth = 0;
+        while (depth < level && (size_t)(ptr - pool_start) % (block_size * run * 2) == 0 && i + 2 * run <= count) {
+            size_t j = run;
+            while (j < 2 * run && (char*)ptrs[i + j] == ptr + j * block_size &&
+                   tag_get(allocator, unit + j * unit_step) == level + 1) {
+                j++;
+            }
+            if (j < 2 * run) {
+                break;
+            }
+            run *= 2;
+            depth++;
+        }
+
+        // Give the subtree back as one block: untag its blocks, unsplit its nodes and let
+        // its root merge with the free buddies above
+        size_t root = node_index;
+        for (int d = 0; d < depth; d++) {
+            root = (root - 1) / 2;
+        }
+        for (size_t j = 1; j < run; j++) {
+            tag_set(allocator, unit + j * unit_step, 0);
+        }
+        set_subtree_split(allocator, root, level - depth, level, 0);
+        release_block(allocator, root, level - depth);
+
+        i += run;
+    }
+}
+
+int BuddyAllocator_resize(BuddyAllocator* allocator, void* ptr, size_t size) {
+
+    if (!allocator || !allocator->memory_pool || size == 0 || size > MAX_BLOCK_SIZE) {
+        DEBUG_FPRINTF(stderr, "[BuddyAllocator_resize]: Error: Invalid allocator or size %zu\n", size);
+        return 0;
+    }
+
+    char* pool_start = (char*)allocator->memory_pool;
+    if ((char*)ptr < pool_start || (char*)ptr >= pool_start + MAX_BLOCK_SIZE) {
+        DEBUG_FPRINTF(stderr, "[BuddyAllocator_resize]: Error: Pointer %p is outside memory pool bounds\n", ptr);
+        return 0;
+    }
+
+    int level;
+    size_t node_index;
+    if (!find_block(allocator, ptr, &level, &node_index)) {
+        DEBUG_FPRINTF(stderr, "[BuddyAllocator_resize]: Error: Could not find allocated block for pointer %p\n", ptr);
+        return 0;
+    }
+
+    int target_level = level_for_size(size < MIN_BLOCK_SIZE ? MIN_BLOCK_SIZE : size);
+    if (target_level == level) {
+        return 1;
+    }
+
+    size_t node = node_index;
+
+    if (target_level < level) {
+        // Growing: the block must be the lower child at every level up to the target (a
+        // parent starts where its lower child does) and each upper buddy must be free,
+        // which is what a pair bit of 1 says while our side is in use
+        for (int l = level; l > target_level; l--) {
+            if (!(node & 1) || !bitmap_test_fast(&allocator->allocation_bitmap, (node - 1) / 2)) {
+                DEBUG_PRINTF("[BuddyAllocator_resize]: Block at %p cannot grow in place\n", ptr);
+                return 0;
+            }
+            node = (node - 1) / 2;
+        }
+
+        // Absorb the buddies: both halves are now part of the parent, which stays in use
+        node = node_index;
+        for (int l = level; l > target_level; l--) {
+            free_list_remove(allocator, node + 1, l);
+            flip_pair_bit(allocator, node);
+            node = (node - 1) / 2;
+            bitmap_clear_fast(&allocator->split_bitmap, node);
+        }
+    } else {
+        // Shrinking: split down like take_block, keeping the lower half each time
+        for (int l = level; l < target_level; l++) {
+            size_t lower_child = 2 * node + 1;
+
+            bitmap_set_fast(&allocator->split_bitmap, node);
+            flip_pair_bit(allocator, lower_child);
+            free_list_push(allocator, lower_child + 1, l + 1);
+
+            node = lower_child;
+        }
+    }
+
+    // Same first unit, new level
+    tag_set(allocator, node_to_unit(node, target_level), target_level + 1);
+    mark_written(allocator, ptr, (char*)ptr + block_size_at_level(target_level));
+
+    DEBUG_PRINTF("[BuddyAllocator_resize]: Block at %p resized from level %d to level %d\n", ptr, level, target_level);
+    return 1;
+}
+
+// Give back the granules of [start, end) (granule aligned) that hold a page written or handed
+// out since the last purge, and forget those writes. Returns the bytes given back
+static size_t purge_written(BuddyAllocator* allocator, char* start, char* end, size_t granule) {
+    char* pool = allocator->memory_pool;
+    size_t last = (size_t)(end - pool) / BUDDY_DIRTY_UNIT;
+    size_t unit = (size_t)(start - pool) / BUDDY_DIRTY_UNIT;
+
+    size_t purged = 0;
+    while ((unit = bitmap_find_first_set(&allocator->dirty_bitmap, unit, last)) != BITMAP_NOT_FOUND) {
+        size_t run_end = bitmap_find_first_zero(&allocator->dirty_bitmap, unit, last);
+        if (run_end == BITMAP_NOT_FOUND) {
+            run_end = last;
+        }
+
+        // The run widened to whole granules, still inside [start, end) as both ends are granule aligned
+        size_t from = (unit * BUDDY_DIRTY_UNIT) & ~(granule - 1);
+        size_t to = (run_end * BUDDY_DIRTY_UNIT + granule - 1) & ~(granule - 1);
+        if (madvise(pool + from, to - from, MADV_DONTNEED) == 0) {
+            stats_madvise();
+            bitmap_clear_range(&allocator->dirty_bitmap, from / BUDDY_DIRTY_UNIT, to / BUDDY_DIRTY_UNIT);
+            purged += to - from;
+        }
+        unit = to / BUDDY_DIRTY_UNIT;
+    }
+    return purged;
+}
+
+size_t BuddyAllocator_purge(BuddyAllocator* allocator, size_t min_size) {
+
+    if (!allocator || !allocator->memory_pool) {
+        return 0;
+    }
+
+    // A block must have a page to give back besides the one holding its links
+    if (min_size < 2 * PAGE_SIZE) {
+        min_size = 2 * PAGE_SIZE;
+    }
+
+    // Pools on transparent huge pages: only whole huge pages go, a smaller range would split one
+    size_t granule = pools_on_huge_pages() ? HUGE_PAGE_SIZE : PAGE_SIZE;
+
+    size_t purged = 0;
+    for (int level = 0; level < MAX_LEVELS && block_size_at_level(level) >= min_size; level++) {
+        size_t size = block_size_at_level(level);
+        for (BuddyFreeBlock* block = allocator->free_lists[level]; block; block = block->next) {
+            // Untouched blocks have no page to give back (and reading their links is not needed:
+            // such a block is alone on its list)
+            if (is_untouched(allocator, block)) {
+                break;
+            }
+            // Only the pages written since the last purge: split and merged again, a purged
+            // block only has the pages of the headers and blocks written in the meantime
+            char* start = (char*)(((uintptr_t)block + PAGE_SIZE + granule - 1) & ~(uintptr_t)(granule - 1));
+            char* end = (char*)(((uintptr_t)block + size) & ~(uintptr_t)(granule - 1));
+            if (start < end) {
+                purged += purge_written(allocator, start, end, granule);
+            }
+        }
+    }
+
+    DEBUG_PRINTF("[BuddyAllocator_purge]: Gave back %zu bytes\n", purged);
+    return purged;
+}
+
+size_t BuddyAllocator_block_size(const BuddyAllocator* allocator, const void* ptr) {
+
+    if (!allocator || !ptr) {
+        return 0;
+    }
+
+    char* pool_start = (char*)__atomic_load_n(&allocator->memory_pool, __ATOMIC_ACQUIRE);
+    if (!pool_start || (char*)ptr < pool_start || (char*)ptr >= pool_start + MAX_BLOCK_SIZE) {
+        return 0;
+    }
+
+    int level;
+    size_t node_index;
+    if (!find_block(allocator, ptr, &level, &node_index)) {
+        DEBUG_FPRINTF(stderr, "[BuddyAllocator_block_size]: Error: Pointer %p is not an allocated block\n", ptr);
+        return 0;
+    }
+
+    return block_size_at_level(level);
+}
+
+void BuddyAllocator_occupancy(const BuddyAllocator* allocator, BuddyOccupancy* occupancy) {
+
+    memset(occupancy, 0, sizeof(BuddyOccupancy));
+    if (!allocator || !__atomic_load_n(&allocator->memory_pool, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    // Allocated blocks: one tag at the first unit of each
+    for (size_t unit = 0; unit < BUDDY_UNITS; unit++) {
+        int tag = tag_get(allocator, unit);
+        if (tag) {
+            occupancy->used_blocks[tag - 1]++;
+        }
+    }
+
+    // Free blocks: the children of the split nodes of a level are either split, allocated
+    // or free, and the only node without a parent is the whole pool
+    size_t split_above = 0;
+    for (int level = 0; level < MAX_LEVELS; level++) {
+        size_t split = 0;
+        if (level < MAX_LEVELS - 1) {
+            size_t first = ((size_t)1 << level) - 1;
+            split = bitmap_popcount(&allocator->split_bitmap, first, 2 * first + 1);
+        }
+
+        size_t nodes = level == 0 ? 1 : 2 * split_above;
+        size_t taken = split + occupancy->used_blocks[level];
+        // Bits and tags are read one by one: a concurrent malloc/free may make them disagree for a moment
+        occupancy->free_blocks[level] = nodes > taken ? nodes - taken : 0;
+
+        occupancy->free_bytes += occupancy->free_blocks[level] * block_size_at_level(level);
+        occupancy->used_bytes += occupancy->used_blocks[level] * block_size_at_level(level);
+        if (occupancy->free_blocks[level] && !occupancy->largest_free_block) {
+            occupancy->largest_free_block = block_size_at_level(level);
+        }
+        split_above = split;
+    }
+}
+
+void BuddyAllocator_occupancy_bitmap(const BuddyAllocator* allocator, Bitmap* map) {
+
+    bitmap_clear_range(map, 0, BUDDY_UNITS);
+    if (!allocator || !__atomic_load_n(&allocator->memory_pool, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    // Each tag covers the units of its whole block, free units are skipped one by one
+    size_t unit = 0;
+    while (unit < BUDDY_UNITS) {
+        int tag = tag_get(allocator, unit);
+        if (!tag) {
+            unit++;
+            continue;
+        }
+        size_t span = (size_t)1 << (MAX_LEVELS - tag);
+        bitmap_set_range(map, unit, unit + span);
+        unit += span;
+    }
+}
+
+size_t BuddyAllocator_occupancy_map(const BuddyAllocator* allocator, char* out, size_t cells) {
+
+    if (cells == 0 || cells > BUDDY_UNITS || (cells & (cells - 1)) != 0) {
+        DEBUG_FPRINTF(stderr, "[BuddyAllocator_occupancy_map]: Error: %zu cells is not a power of two up to %zu\n", cells, (size_t)BUDDY_UNITS);
+        return 0;
+    }
+
+    // One walk over the tags, in address order, counting the allocated units of each cell as it
+    // goes: no buffer of BUDDY_UNITS bits (64 KB of stack for some geometries), so nothing is
+    // allocated and this may run in a signal handler
+    int mapped = allocator && __atomic_load_n(&allocator->memory_pool, __ATOMIC_ACQUIRE);
+    size_t units_per_cell = BUDDY_UNITS / cells;
+    size_t unit = 0;
+    size_t block_end = 0; // End of the last allocated block found, in units
+    for (size_t cell = 0; cell < cells; cell++) {
+        size_t cell_end = (cell + 1) * units_per_cell;
+        size_t used = 0;
+        while (mapped && unit < cell_end) {
+            if (unit < block_end) {
+                // Inside an allocated block, which may go on into the next cells
+                size_t stop = block_end < cell_end ? block_end : cell_end;
+                used += stop - unit;
+                unit = stop;
+                continue;
+            }
+            int tag = tag_get(allocator, unit);
+            if (tag) {
+                block_end = unit + ((size_t)1 << (MAX_LEVELS - tag));
+            } else {
+                unit++;
+            }
+        }
+        out[cell] = used == 0 ? '.' : used == units_per_cell ? '#' : '+';
+    }
+    out[cells] = '\0';
+    return cells;
+}
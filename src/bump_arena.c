@@ -0,0 +1,113 @@
+#define _GNU_SOURCE
+#include "../include/bump_arena.h"
+#include "../include/debug_print.h"
+
+#define ALIGN_UP(size) (((size) + MALLOC_ALIGNMENT - 1) & ~(size_t)(MALLOC_ALIGNMENT - 1))
+
+#define CHUNK_HEADER_SIZE ALIGN_UP(sizeof(BumpChunk)) // Bytes before the objects of a chunk
+#define ARENA_HEADER_SIZE (CHUNK_HEADER_SIZE + ALIGN_UP(sizeof(BumpArena))) // First chunk: its header, then the arena
+
+// The first chunk of an arena, right before the arena itself: it is kept until arena_destroy
+static inline BumpChunk* home_chunk(BumpArena* arena) {
+    return (BumpChunk*)((char*)arena - CHUNK_HEADER_SIZE);
+}
+
+// Chunk of at least size bytes; the whole block my_malloc handed out is used
+static BumpChunk* chunk_alloc(size_t size) {
+    BumpChunk* chunk = my_malloc(size);
+    if (!chunk) {
+        DEBUG_FPRINTF(stderr, "[arena_alloc]: Error: no chunk of %zu bytes\n", size);
+        return NULL;
+    }
+    chunk->size = my_malloc_usable_size(chunk) & ~(size_t)(MALLOC_ALIGNMENT - 1);
+    return chunk;
+}
+
+BumpArena* arena_create(size_t chunk_size) {
+    if (chunk_size == 0) {
+        chunk_size = BUMP_CHUNK_SIZE;
+    }
+    if (chunk_size < 4 * ARENA_HEADER_SIZE) {
+        chunk_size = 4 * ARENA_HEADER_SIZE;
+    }
+
+    BumpChunk* chunk = chunk_alloc(chunk_size);
+    if (!chunk) {
+        return NULL;
+    }
+    chunk->next = NULL;
+
+    BumpArena* arena = (BumpArena*)((char*)chunk + CHUNK_HEADER_SIZE);
+    arena->chunks = chunk;
+    arena->chunk_size = chunk_size;
+    arena->cursor = (char*)chunk + ARENA_HEADER_SIZE;
+    arena->end = (char*)chunk + chunk->size;
+    return arena;
+}
+
+void* arena_alloc_chunk(BumpArena* arena, size_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+    if (size > SIZE_MAX - CHUNK_HEADER_SIZE - MALLOC_ALIGNMENT) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    size_t rounded = ALIGN_UP(size);
+
+    // Large object: a chunk of its own, and the room left in the current chunk stays in use
+    if (rounded > arena->chunk_size / BUMP_DEDICATED_FRACTION) {
+        BumpChunk* chunk = chunk_alloc(CHUNK_HEADER_SIZE + rounded);
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        return (char*)chunk + CHUNK_HEADER_SIZE;
+    }
+
+    // Current chunk full: the rest of it is left unused until the next reset
+    BumpChunk* chunk = chunk_alloc(arena->chunk_size);
+    if (!chunk) {
+        return NULL;
+    }
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+
+    void* ptr = (char*)chunk + CHUNK_HEADER_SIZE;
+    arena->cursor = (char*)ptr + rounded;
+    arena->end = (char*)chunk + chunk->size;
+    return ptr;
+}
+
+void arena_reset(BumpArena* arena) {
+    BumpChunk* home = home_chunk(arena);
+
+    // The first chunk is the oldest one, the end of the list
+    BumpChunk* chunk = arena->chunks;
+    while (chunk != home) {
+        BumpChunk* next = chunk->next;
+        my_free(chunk);
+        chunk = next;
+    }
+
+    arena->chunks = home;
+    arena->cursor = (char*)home + ARENA_HEADER_SIZE;
+    arena->end = (char*)home + home->size;
+}
+
+void arena_destroy(BumpArena* arena) {
+    if (!arena) {
+        return;
+    }
+    arena_reset(arena);
+    my_free(home_chunk(arena));
+}
+
+size_t arena_footprint(const BumpArena* arena) {
+    size_t bytes = 0;
+    for (const BumpChunk* chunk = arena->chunks; chunk; chunk = chunk->next) {
+        bytes += chunk->size;
+    }
+    return bytes;
+}
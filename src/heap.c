@@ -0,0 +1,201 @@
+#define _GNU_SOURCE
+#include "../include/heap.h"
+#include "../include/pool_arena.h"
+#include "../include/slab.h"
+#include "../include/malloc_stats.h"
+#include "../include/debug_print.h"
+
+// Header right before each large block of a heap: the heap keeps them on a list to unmap them all at once
+typedef struct HeapLargeBlock {
+    struct HeapLargeBlock* next; // Next large block of the heap
+    struct HeapLargeBlock* prev; // Previous large block of the heap
+    struct Heap* heap; // Heap that mapped the block
+    size_t map_size; // Size of the mapping, header included
+} HeapLargeBlock;
+
+_Static_assert(sizeof(HeapLargeBlock) % MALLOC_ALIGNMENT == 0, "large blocks of a heap must stay 16 bytes aligned");
+
+struct Heap {
+    PoolArena arena; // Pools and slabs of the heap; its lock protects the whole heap
+    HeapLargeBlock* large_blocks; // Large blocks of the heap
+    HeapStats stats; // Statistics, updated under the lock
+    size_t struct_size; // Bytes mapped for this struct
+};
+
+static inline size_t round_to_pages(size_t size) {
+    return (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+}
+
+static void count_malloc(Heap* heap, size_t block_size) {
+    heap->stats.mallocs++;
+    heap->stats.bytes_in_use += block_size;
+    if (heap->stats.bytes_in_use > heap->stats.peak_in_use) {
+        heap->stats.peak_in_use = heap->stats.bytes_in_use;
+    }
+}
+
+Heap* heap_create(const HeapConfig* config) {
+    size_t struct_size = round_to_pages(sizeof(Heap));
+    Heap* heap = mmap(NULL, struct_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (heap == MAP_FAILED) {
+        DEBUG_FPRINTF(stderr, "[heap_create]: Error: mmap failed\n");
+        return NULL;
+    }
+    stats_mmap(struct_size);
+
+    // Pools of a heap take the global pool locks too: the fork handlers that guard them are
+    // registered with the arena of the calling thread
+    pool_arena_for_thread();
+
+    // Fresh mapping: lists and statistics are already 0
+    pool_arena_init(&heap->arena);
+    heap->arena.mapped_limit = config ? config->limit : 0;
+    heap->struct_size = struct_size;
+    return heap;
+}
+
+// Large block mapped for the heap, NULL past the limit or if mmap fails. Heap locked
+static void* heap_large_malloc_locked(Heap* heap, size_t size) {
+    if (size > SIZE_MAX - sizeof(HeapLargeBlock) - PAGE_SIZE) {
+        return NULL;
+    }
+    size_t map_size = round_to_pages(size + sizeof(HeapLargeBlock));
+    PoolArena* arena = &heap->arena;
+    if (arena->mapped_limit && arena->mapped_bytes + map_size > arena->mapped_limit) {
+        DEBUG_FPRINTF(stderr, "[heap_malloc]: Error: heap limit of %zu bytes reached\n", arena->mapped_limit);
+        return NULL;
+    }
+
+    HeapLargeBlock* block = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (block == MAP_FAILED) {
+        DEBUG_FPRINTF(stderr, "[heap_malloc]: Error: mmap failed\n");
+        return NULL;
+    }
+    stats_mmap(map_size);
+    arena->mapped_bytes += map_size;
+
+    block->heap = heap;
+    block->map_size = map_size;
+    block->prev = NULL;
+    block->next = heap->large_blocks;
+    if (block->next) {
+        block->next->prev = block;
+    }
+    heap->large_blocks = block;
+
+    count_malloc(heap, map_size - sizeof(HeapLargeBlock));
+    return block + 1;
+}
+
+static void heap_large_free_locked(Heap* heap, HeapLargeBlock* block) {
+    if (block->prev) {
+        block->prev->next = block->next;
+    } else {
+        heap->large_blocks = block->next;
+    }
+    if (block->next) {
+        block->next->prev = block->prev;
+    }
+
+    size_t map_size = block->map_size;
+    heap->arena.mapped_bytes -= map_size;
+    heap->stats.frees++;
+    heap->stats.bytes_in_use -= map_size - sizeof(HeapLargeBlock);
+    stats_munmap(map_size);
+    munmap(block, map_size);
+}
+
+void* heap_malloc(Heap* heap, size_t size) {
+    if (!heap || size == 0) {
+        return NULL;
+    }
+
+    pool_arena_lock(&heap->arena);
+    void* ptr;
+    if (size <= SLAB_MAX_SIZE) {
+        int slab_class = slab_class_for_size(size);
+        ptr = slab_malloc_locked(&heap->arena, slab_class);
+        if (ptr) {
+            count_malloc(heap, slab_class_size(slab_class));
+        }
+    } else if (size < MID_THRESHOLD) {
+        PoolKind kind = size < SMALL_THRESHOLD ? POOL_KIND_BUDDY : POOL_KIND_MID;
+        ptr = pool_arena_malloc_locked(&heap->arena, kind, size, 0);
+        if (ptr) {
+            count_malloc(heap, BuddyAllocator_block_size(&pool_arena_lookup(ptr)->buddy, ptr));
+        }
+    } else {
+        ptr = heap_large_malloc_locked(heap, size);
+    }
+
+    if (!ptr) {
+        heap->stats.failed_mallocs++;
+    } else if (heap->arena.mapped_bytes > heap->stats.peak_mapped) {
+        heap->stats.peak_mapped = heap->arena.mapped_bytes;
+    }
+    pool_arena_unlock(&heap->arena);
+    return ptr;
+}
+
+void heap_free(Heap* heap, void* ptr) {
+    if (!heap || !ptr) {
+        return;
+    }
+
+    BuddyPool* pool = pool_arena_lookup(ptr);
+    if (pool && pool->arena != &heap->arena) {
+        DEBUG_FPRINTF(stderr, "[heap_free]: Error: %p does not belong to this heap\n", ptr);
+        return;
+    }
+
+    pool_arena_lock(&heap->arena);
+    if (!pool) {
+        HeapLargeBlock* block = (HeapLargeBlock*)ptr - 1;
+        if (block->heap != heap) {
+            DEBUG_FPRINTF(stderr, "[heap_free]: Error: %p does not belong to this heap\n", ptr);
+        } else {
+            heap_large_free_locked(heap, block);
+        }
+        pool_arena_unlock(&heap->arena);
+        return;
+    }
+
+    size_t block_size = pool->kind == POOL_KIND_SLAB ? slab_object_size(ptr)
+                                                     : BuddyAllocator_block_size(&pool->buddy, ptr);
+    if (block_size == 0) {
+        DEBUG_FPRINTF(stderr, "[heap_free]: Error: %p is not an allocated block of the heap\n", ptr);
+    } else {
+        heap->stats.frees++;
+        heap->stats.bytes_in_use -= block_size;
+        if (pool->kind == POOL_KIND_SLAB) {
+            slab_free_locked(&heap->arena, ptr);
+        } else {
+            pool_arena_free_locked(pool, ptr, 0);
+        }
+    }
+    pool_arena_unlock(&heap->arena);
+}
+
+void heap_stats(Heap* heap, HeapStats* stats) {
+    pool_arena_lock(&heap->arena);
+    *stats = heap->stats;
+    stats->bytes_mapped = heap->arena.mapped_bytes;
+    pool_arena_unlock(&heap->arena);
+}
+
+void heap_destroy(Heap* heap) {
+    if (!heap) {
+        return;
+    }
+
+    pool_arena_lock(&heap->arena);
+    pool_arena_release_all(&heap->arena);
+    while (heap->large_blocks) {
+        heap_large_free_locked(heap, heap->large_blocks);
+    }
+    pool_arena_unlock(&heap->arena);
+
+    pthread_mutex_destroy(&heap->arena.lock);
+    stats_munmap(heap->struct_size);
+    munmap(heap, heap->struct_size);
+}
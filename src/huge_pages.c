@@ -0,0 +1,92 @@
+#define _GNU_SOURCE
+#include "../include/huge_pages.h"
+#include "../include/malloc_stats.h"
+#include "../include/debug_print.h"
+
+#include <pthread.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT) // log2(HUGE_PAGE_SIZE) in the page size bits of the mmap flags
+#endif
+
+HugePageMode huge_pages_mode = HUGE_PAGES_OFF;
+int huge_pages_frozen = 0;
+
+static pthread_once_t huge_pages_once = PTHREAD_ONCE_INIT;
+
+static void huge_pages_init(void) {
+    if (huge_pages_mode == HUGE_PAGES_OFF && huge_pages_from_environment) {
+        huge_pages_mode = huge_pages_from_environment();
+    }
+    __atomic_store_n(&huge_pages_frozen, 1, __ATOMIC_RELEASE);
+}
+
+void huge_pages_freeze(void) {
+    // Threads racing to the first mapping all wait for the same mode
+    pthread_once(&huge_pages_once, huge_pages_init);
+}
+
+int my_malloc_huge_pages(HugePageMode mode) {
+    if (mode != HUGE_PAGES_OFF && mode != HUGE_PAGES_THP && mode != HUGE_PAGES_HUGETLB) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (__atomic_load_n(&huge_pages_frozen, __ATOMIC_RELAXED)) {
+        DEBUG_FPRINTF(stderr, "[my_malloc_huge_pages]: Error: memory already mapped, the mode can no longer change\n");
+        errno = EBUSY;
+        return -1;
+    }
+    __atomic_store_n(&huge_pages_mode, mode, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void huge_pages_advise(void* region, size_t size) {
+#ifdef MADV_HUGEPAGE
+    // Fails with EINVAL on kernels without THP: the mapping simply stays on small pages
+    if (madvise(region, size, MADV_HUGEPAGE) != 0) {
+        DEBUG_FPRINTF(stderr, "[huge_pages_advise]: Error: madvise(MADV_HUGEPAGE) failed\n");
+    }
+#endif
+    stats_huge_map(size);
+}
+
+void* huge_pages_map(size_t size) {
+#ifdef MAP_HUGETLB
+    // Reserved huge pages: aligned by the kernel, and backed by huge pages or not mapped at all
+    if (huge_page_mode() == HUGE_PAGES_HUGETLB) {
+        void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+        if (ptr != MAP_FAILED) {
+            stats_mmap(size);
+            stats_huge_map(size);
+            return ptr;
+        }
+        DEBUG_PRINTF("[huge_pages_map]: No reserved huge page for %zu bytes, falling back to THP\n", size);
+        stats_hugetlb_fallback();
+    }
+#endif
+
+    // Map one extra huge page and trim the misaligned head and the unused tail
+    char* raw = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        DEBUG_FPRINTF(stderr, "[huge_pages_map]: Error: mmap failed\n");
+        return NULL;
+    }
+    stats_mmap(size + HUGE_PAGE_SIZE);
+
+    char* region = (char*)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) & ~((uintptr_t)HUGE_PAGE_SIZE - 1));
+    size_t head = (size_t)(region - raw);
+    if (head) {
+        munmap(raw, head);
+        stats_munmap(head);
+    }
+    if (HUGE_PAGE_SIZE - head) {
+        munmap(region + size, HUGE_PAGE_SIZE - head);
+        stats_munmap(HUGE_PAGE_SIZE - head);
+    }
+
+    huge_pages_advise(region, size);
+    return region;
+}
@@ -0,0 +1,213 @@
+#define _GNU_SOURCE
+#include "../include/large_cache.h"
+#include "../include/malloc_stats.h"
+#include "../include/huge_pages.h"
+#include "../include/debug_print.h"
+
+#include <pthread.h>
+
+// Bookkeeping of a cached mapping, stored at its start
+typedef struct LargeCacheEntry {
+    struct LargeCacheEntry* newer; // Next entry towards the most recently freed one
+    struct LargeCacheEntry* older; // Next entry towards the least recently freed one
+    struct LargeCacheEntry* bucket_next; // Next entry of the same bucket
+    struct LargeCacheEntry* bucket_prev; // Previous entry of the same bucket
+    size_t size; // Size of the mapping in bytes
+    unsigned long freed_at; // Value of free_clock when the mapping was freed
+    int purged; // Pages after the first one have been dropped
+} LargeCacheEntry;
+
+static LargeCacheEntry* buckets[LARGE_CACHE_BUCKETS];
+static LargeCacheEntry* newest = NULL; // Most recently freed mapping
+static LargeCacheEntry* oldest = NULL; // Least recently freed mapping, first one to go
+static size_t cached_bytes = 0;
+static int cached_entries = 0;
+static unsigned long free_clock = 0; // Frees seen by the cache, measures the age of the entries
+
+static pthread_mutex_t large_cache_lock = PTHREAD_MUTEX_INITIALIZER; // Protects everything above
+static pthread_once_t large_cache_once = PTHREAD_ONCE_INIT;
+
+static void fork_prepare(void) {
+    pthread_mutex_lock(&large_cache_lock);
+}
+
+static void fork_release(void) {
+    pthread_mutex_unlock(&large_cache_lock);
+}
+
+static void large_cache_init(void) {
+    // Same as the arenas: the lock must not be held by a thread that does not exist in the child
+    pthread_atfork(fork_prepare, fork_release, fork_release);
+}
+
+static inline size_t bucket_of(size_t size) {
+    return (size / PAGE_SIZE) % LARGE_CACHE_BUCKETS;
+}
+
+static void entry_insert(LargeCacheEntry* entry) {
+    size_t bucket = bucket_of(entry->size);
+    entry->bucket_prev = NULL;
+    entry->bucket_next = buckets[bucket];
+    if (entry->bucket_next) {
+        entry->bucket_next->bucket_prev = entry;
+    }
+    buckets[bucket] = entry;
+
+    entry->newer = NULL;
+    entry->older = newest;
+    if (newest) {
+        newest->newer = entry;
+    } else {
+        oldest = entry;
+    }
+    newest = entry;
+
+    cached_bytes += entry->size;
+    cached_entries++;
+}
+
+static void entry_remove(LargeCacheEntry* entry) {
+    if (entry->bucket_prev) {
+        entry->bucket_prev->bucket_next = entry->bucket_next;
+    } else {
+        buckets[bucket_of(entry->size)] = entry->bucket_next;
+    }
+    if (entry->bucket_next) {
+        entry->bucket_next->bucket_prev = entry->bucket_prev;
+    }
+
+    if (entry->newer) {
+        entry->newer->older = entry->older;
+    } else {
+        newest = entry->older;
+    }
+    if (entry->older) {
+        entry->older->newer = entry->newer;
+    } else {
+        oldest = entry->newer;
+    }
+
+    cached_bytes -= entry->size;
+    cached_entries--;
+}
+
+// Give a mapping back to the OS, -1 if munmap failed
+static int unmap_mapping(void* ptr, size_t size) {
+    if (huge_pages_for(size)) {
+        stats_huge_unmap(size);
+    }
+    stats_munmap(size);
+    return munmap(ptr, size);
+}
+
+// Enforce the limits of the cache (lock held)
+static void large_cache_trim(void) {
+    // Over budget: the oldest mappings go back to the OS
+    while (oldest && (cached_bytes > LARGE_CACHE_BUDGET || cached_entries > LARGE_CACHE_MAX_ENTRIES)) {
+        LargeCacheEntry* entry = oldest;
+        entry_remove(entry);
+        DEBUG_PRINTF("[large_cache_trim]: Unmapping %zu bytes at %p\n", entry->size, (void*)entry);
+        unmap_mapping(entry, entry->size);
+    }
+
+    // Too old: keep the address range but drop the pages. Entries are ordered by age,
+    // so the walk stops at the first entry that is young enough. Huge page mappings are
+    // unmapped instead: dropping all but their first small page would split a transparent
+    // huge page, and fails on MAP_HUGETLB ones (not huge page aligned)
+    LargeCacheEntry* entry = oldest;
+    while (entry && free_clock - entry->freed_at > LARGE_CACHE_MAX_AGE) {
+        LargeCacheEntry* newer = entry->newer;
+        if (huge_pages_for(entry->size)) {
+            entry_remove(entry);
+            unmap_mapping(entry, entry->size);
+        } else if (!entry->purged) {
+            if (madvise((char*)entry + PAGE_SIZE, entry->size - PAGE_SIZE, MADV_DONTNEED) == 0) {
+                stats_madvise();
+                entry->purged = 1;
+            } else {
+                DEBUG_FPRINTF(stderr, "[large_cache_trim]: Error: madvise failed, unmapping %zu bytes at %p\n",
+                              entry->size, (void*)entry);
+                entry_remove(entry);
+                unmap_mapping(entry, entry->size);
+            }
+        }
+        entry = newer;
+    }
+}
+
+void* large_cache_map(size_t size, int* fresh) {
+    if (size <= LARGE_CACHE_MAX_SIZE) {
+        pthread_mutex_lock(&large_cache_lock);
+        // Most recently freed first: its pages are the likeliest to still be resident
+        for (LargeCacheEntry* entry = buckets[bucket_of(size)]; entry; entry = entry->bucket_next) {
+            if (entry->size == size) {
+                entry_remove(entry);
+                pthread_mutex_unlock(&large_cache_lock);
+                DEBUG_PRINTF("[large_cache_map]: Reusing %zu bytes at %p\n", size, (void*)entry);
+                if (fresh) {
+                    *fresh = 0;
+                }
+                return entry;
+            }
+        }
+        pthread_mutex_unlock(&large_cache_lock);
+    }
+
+    if (huge_pages_for(size)) {
+        void* ptr = huge_pages_map(size);
+        if (ptr && fresh) {
+            *fresh = 1;
+        }
+        return ptr;
+    }
+
+    void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        DEBUG_FPRINTF(stderr, "[large_cache_map]: Error: mmap failed\n");
+        return NULL;
+    }
+    stats_mmap(size);
+    if (fresh) {
+        *fresh = 1;
+    }
+    return ptr;
+}
+
+int large_cache_unmap(void* ptr, size_t size) {
+    if (size > LARGE_CACHE_MAX_SIZE) {
+        return unmap_mapping(ptr, size);
+    }
+
+    pthread_once(&large_cache_once, large_cache_init);
+
+    LargeCacheEntry* entry = (LargeCacheEntry*)ptr;
+    entry->size = size;
+    entry->purged = 0;
+
+    pthread_mutex_lock(&large_cache_lock);
+    entry->freed_at = ++free_clock;
+    entry_insert(entry);
+    large_cache_trim();
+    pthread_mutex_unlock(&large_cache_lock);
+
+    return 0;
+}
+
+size_t large_cache_flush(void) {
+    pthread_mutex_lock(&large_cache_lock);
+    size_t flushed = cached_bytes;
+    while (oldest) {
+        LargeCacheEntry* entry = oldest;
+        entry_remove(entry);
+        unmap_mapping(entry, entry->size);
+    }
+    pthread_mutex_unlock(&large_cache_lock);
+    return flushed;
+}
+
+size_t large_cache_size(void) {
+    pthread_mutex_lock(&large_cache_lock);
+    size_t size = cached_bytes;
+    pthread_mutex_unlock(&large_cache_lock);
+    return size;
+}
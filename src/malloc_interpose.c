@@ -0,0 +1,158 @@
+#define _GNU_SOURCE
+#include "../include/my_malloc.h"
+#include "../include/malloc_stats.h"
+#include "../include/malloc_trace.h"
+#include "../include/huge_pages.h"
+
+#include <stdlib.h>
+#include <malloc.h>
+
+/*
+ * libc malloc family on top of my_malloc, only built into libpseudo_malloc.so:
+ *
+ *     LD_PRELOAD=build/libpseudo_malloc.so ./program
+ *
+ * replaces the allocator of a program (and of libc itself) without relinking it.
+ * Nothing below my_malloc calls back into libc malloc: pools, bitmaps and pool records
+ * are mapped directly, and the per-thread state is initial-exec TLS.
+ *
+ * my_malloc returns NULL for 0 bytes, while programs written against glibc expect a
+ * unique pointer they can free: 0 byte requests get the smallest block instead.
+ *
+ *     PSEUDO_MALLOC_TRACE=trace.bin LD_PRELOAD=build/libpseudo_malloc.so ./program
+ *
+ * also records every allocation of the program into trace.bin (see tools/replay), and
+ *
+ *     PSEUDO_MALLOC_HUGEPAGES=thp LD_PRELOAD=build/libpseudo_malloc.so ./program
+ *
+ * backs pools and large blocks with huge pages (thp or hugetlb, see my_malloc_huge_pages).
+ * The mode is read by the first mapping, not by a constructor, so it also covers what libc
+ * allocates before the constructors run
+ */
+
+// Message on stderr without stdio, which may allocate
+static void report(const char* message) {
+    ssize_t written = write(STDERR_FILENO, message, strlen(message));
+    (void)written;
+}
+
+__attribute__((constructor)) static void trace_from_environment(void) {
+    const char* path = getenv("PSEUDO_MALLOC_TRACE");
+    if (path && *path && my_malloc_trace_start(path) == 0 && __atomic_load_n(&huge_pages_frozen, __ATOMIC_RELAXED)) {
+        // libc (or an earlier constructor) allocated before this one ran
+        report("pseudo-malloc: PSEUDO_MALLOC_TRACE: blocks allocated before the program started are not in the trace\n");
+    }
+}
+
+// Called by the first mapping, from inside malloc: getenv does not allocate
+HugePageMode huge_pages_from_environment(void) {
+    const char* mode = getenv("PSEUDO_MALLOC_HUGEPAGES");
+    if (!mode || !*mode) {
+        return HUGE_PAGES_OFF;
+    }
+    if (strcmp(mode, "thp") == 0) {
+        return HUGE_PAGES_THP;
+    }
+    if (strcmp(mode, "hugetlb") == 0) {
+        return HUGE_PAGES_HUGETLB;
+    }
+    report("pseudo-malloc: PSEUDO_MALLOC_HUGEPAGES must be thp or hugetlb, huge pages stay off\n");
+    return HUGE_PAGES_OFF;
+}
+
+// Runs at exit: the records still in the rings of the threads reach the file
+__attribute__((destructor)) static void trace_at_exit(void) {
+    if (trace_enabled) {
+        my_malloc_trace_stop();
+    }
+}
+
+void* malloc(size_t size) {
+    void* ptr = my_malloc(size ? size : 1);
+    if (!ptr) {
+        errno = ENOMEM;
+    }
+    return ptr;
+}
+
+void free(void* ptr) {
+    my_free(ptr);
+}
+
+void* calloc(size_t nmemb, size_t size) {
+    if (nmemb == 0 || size == 0) {
+        nmemb = size = 1;
+    }
+    void* ptr = my_calloc(nmemb, size);
+    if (!ptr) {
+        errno = ENOMEM;
+    }
+    return ptr;
+}
+
+void* realloc(void* ptr, size_t size) {
+    if (!ptr) {
+        return malloc(size);
+    }
+
+    // Zero size frees the block and returns NULL, as glibc does
+    if (size == 0) {
+        my_free(ptr);
+        return NULL;
+    }
+
+    void* new_ptr = my_realloc(ptr, size);
+    if (!new_ptr) {
+        errno = ENOMEM;
+    }
+    return new_ptr;
+}
+
+int posix_memalign(void** memptr, size_t alignment, size_t size) {
+    return my_posix_memalign(memptr, alignment, size ? size : 1);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    return my_aligned_alloc(alignment, size ? size : 1);
+}
+
+void* memalign(size_t alignment, size_t size) {
+    // glibc rounds any alignment up to a power of two instead of failing
+    if (alignment > (SIZE_MAX >> 1) + 1) {
+        errno = EINVAL;
+        return NULL;
+    }
+    size_t power = sizeof(void*);
+    while (power < alignment) {
+        power <<= 1;
+    }
+    return my_aligned_alloc(power, size ? size : 1);
+}
+
+void* valloc(size_t size) {
+    return my_aligned_alloc(PAGE_SIZE, size ? size : 1);
+}
+
+void* pvalloc(size_t size) {
+    if (size > SIZE_MAX - PAGE_SIZE) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    size_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    return my_aligned_alloc(PAGE_SIZE, pages ? pages * PAGE_SIZE : PAGE_SIZE);
+}
+
+size_t malloc_usable_size(void* ptr) {
+    return my_malloc_usable_size(ptr);
+}
+
+// glibc prints its statistics on stderr
+void malloc_stats(void) {
+    my_malloc_stats_print(stderr, 0);
+}
+
+// glibc keeps pad bytes at the top of its heap; the pools have no top, so pad is ignored
+int malloc_trim(size_t pad) {
+    (void)pad;
+    return my_malloc_trim() > 0;
+}
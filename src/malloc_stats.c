@@ -0,0 +1,220 @@
+#define _GNU_SOURCE
+#include "../include/malloc_stats.h"
+#include "../include/debug_print.h"
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <stdlib.h>
+
+__thread ThreadStats* thread_stats __attribute__((tls_model("initial-exec")));
+
+static ThreadStats* registered_threads = NULL; // Counters of the running threads
+static ThreadStats* free_thread_records = NULL; // Records released by exited threads (linked through next)
+static MallocStats exited_threads; // Counters folded in by the threads that exited
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER; // Protects the three above
+
+// Counts a thread still makes after its exit: written, never read
+static ThreadStats discarded_stats;
+
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t stats_key;
+
+// Raw counters, in the order they appear in MallocStats
+#define STATS_COUNTERS (2 * MAX_LEVELS + 18)
+
+_Static_assert(offsetof(MallocStats, bytes_in_use) == STATS_COUNTERS * sizeof(size_t),
+               "raw counters of MallocStats must come first and be size_t only");
+
+static void stats_accumulate(MallocStats* total, const MallocStats* counters) {
+    size_t* to = (size_t*)total;
+    const size_t* from = (const size_t*)counters;
+    for (int i = 0; i < STATS_COUNTERS; i++) {
+        to[i] += __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+    }
+}
+
+static void fork_prepare(void) {
+    pthread_mutex_lock(&stats_lock);
+}
+
+static void fork_release(void) {
+    pthread_mutex_unlock(&stats_lock);
+}
+
+// Thread exit: fold the counters into the exited threads total and release the record
+static void stats_thread_exit(void* stats) {
+    ThreadStats* thread = stats;
+
+    // Whatever the thread still does from now on is not counted
+    thread_stats = &discarded_stats;
+
+    pthread_mutex_lock(&stats_lock);
+    stats_accumulate(&exited_threads, &thread->counters);
+    if (thread->prev) {
+        thread->prev->next = thread->next;
+    } else {
+        registered_threads = thread->next;
+    }
+    if (thread->next) {
+        thread->next->prev = thread->prev;
+    }
+    thread->next = free_thread_records;
+    free_thread_records = thread;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+static void stats_global_init(void) {
+    pthread_key_create(&stats_key, stats_thread_exit);
+    pthread_atfork(fork_prepare, fork_release, fork_release);
+}
+
+// Zeroed record, NULL if mmap fails (stats lock held). The pages are not counted: counting
+// is what asked for them
+static ThreadStats* thread_record_alloc(void) {
+    if (!free_thread_records) {
+        // Carve a fresh page into records
+        char* page = mmap(NULL, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (page == MAP_FAILED) {
+            return NULL;
+        }
+        for (size_t i = 0; i < PAGE_SIZE / sizeof(ThreadStats); i++) {
+            ThreadStats* record = (ThreadStats*)page + i;
+            record->next = free_thread_records;
+            free_thread_records = record;
+        }
+    }
+    ThreadStats* record = free_thread_records;
+    free_thread_records = record->next;
+    memset(&record->counters, 0, sizeof(record->counters));
+    return record;
+}
+
+void malloc_stats_register(void) {
+    pthread_mutex_lock(&stats_lock);
+    ThreadStats* thread = thread_record_alloc();
+    if (!thread) {
+        pthread_mutex_unlock(&stats_lock);
+        DEBUG_FPRINTF(stderr, "[malloc_stats_register]: Error: mmap failed, the thread is not counted\n");
+        thread_stats = &discarded_stats;
+        return;
+    }
+    thread->prev = NULL;
+    thread->next = registered_threads;
+    if (registered_threads) {
+        registered_threads->prev = thread;
+    }
+    registered_threads = thread;
+    pthread_mutex_unlock(&stats_lock);
+
+    // Set before the glibc calls below: they may allocate, and that malloc must not come back here
+    thread_stats = thread;
+
+    // A thread registering during its last TLS destructor pass never gets its destructor: its
+    // record stays linked with what it counted, and no other thread ever gets it
+    pthread_once(&stats_once, stats_global_init);
+    pthread_setspecific(stats_key, thread);
+}
+
+// Value in bytes of a "name: N kB" line of /proc/self/smaps_rollup, 0 if missing
+static size_t smaps_field(const char* text, const char* name) {
+    const char* line = strstr(text, name);
+    return line ? (size_t)strtoul(line + strlen(name), NULL, 10) * 1024 : 0;
+}
+
+// Huge page backed and anonymous resident bytes of the process (no stdio: nothing here may allocate)
+static void read_huge_page_bytes(size_t* huge, size_t* anonymous) {
+    char text[4096];
+    ssize_t length = 0;
+    int fd = open("/proc/self/smaps_rollup", O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        length = read(fd, text, sizeof(text) - 1);
+        close(fd);
+    }
+    text[length > 0 ? length : 0] = '\0';
+
+    // Reserved huge pages are not part of Anonymous
+    size_t hugetlb = smaps_field(text, "\nPrivate_Hugetlb:");
+    *huge = smaps_field(text, "\nAnonHugePages:") + hugetlb;
+    *anonymous = smaps_field(text, "\nAnonymous:") + hugetlb;
+}
+
+void my_malloc_stats(MallocStats* stats) {
+    memset(stats, 0, sizeof(MallocStats));
+
+    pthread_mutex_lock(&stats_lock);
+    stats_accumulate(stats, &exited_threads);
+    for (ThreadStats* thread = registered_threads; thread; thread = thread->next) {
+        stats_accumulate(stats, &thread->counters);
+    }
+    pthread_mutex_unlock(&stats_lock);
+
+    // Counters are read one by one while threads keep counting: never report negative figures
+    stats->bytes_in_use = stats->bytes_allocated > stats->bytes_freed ? stats->bytes_allocated - stats->bytes_freed : 0;
+    stats->bytes_reserved = stats->bytes_mapped > stats->bytes_unmapped ? stats->bytes_mapped - stats->bytes_unmapped : 0;
+    stats->internal_fragmentation = stats->bytes_allocated
+        ? 1.0 - (double)stats->bytes_requested / (double)stats->bytes_allocated : 0.0;
+
+    stats->huge_bytes_reserved = stats->huge_bytes_mapped > stats->huge_bytes_unmapped
+        ? stats->huge_bytes_mapped - stats->huge_bytes_unmapped : 0;
+    if (stats->huge_mappings) {
+        size_t anonymous;
+        read_huge_page_bytes(&stats->huge_page_bytes, &anonymous);
+        stats->thp_hit_rate = anonymous ? (double)stats->huge_page_bytes / (double)anonymous : 0.0;
+        if (stats->thp_hit_rate > 1.0) {
+            stats->thp_hit_rate = 1.0;
+        }
+    }
+}
+
+int my_malloc_stats_print(FILE* stream, int json) {
+    MallocStats stats;
+    my_malloc_stats(&stats);
+
+    int result = 0;
+    if (json) {
+        result |= fprintf(stream, "{\"buddy_levels\": [");
+        for (int level = 0; level < MAX_LEVELS; level++) {
+            result |= fprintf(stream, "%s{\"block_size\": %zu, \"mallocs\": %zu, \"frees\": %zu}",
+                              level ? ", " : "", (size_t)MAX_BLOCK_SIZE >> level,
+                              stats.buddy_mallocs[level], stats.buddy_frees[level]);
+        }
+        result |= fprintf(stream, "], \"slab_mallocs\": %zu, \"slab_frees\": %zu, \"large_mallocs\": %zu, \"large_frees\": %zu, "
+                          "\"failed_mallocs\": %zu, \"mmap_calls\": %zu, \"munmap_calls\": %zu, \"mremap_calls\": %zu, "
+                          "\"madvise_calls\": %zu, \"bytes_requested\": %zu, \"bytes_allocated\": %zu, \"bytes_freed\": %zu, "
+                          "\"bytes_mapped\": %zu, \"bytes_unmapped\": %zu, \"bytes_in_use\": %zu, \"bytes_reserved\": %zu, "
+                          "\"internal_fragmentation\": %.4f, \"huge_mappings\": %zu, \"hugetlb_fallbacks\": %zu, "
+                          "\"huge_bytes_mapped\": %zu, \"huge_bytes_unmapped\": %zu, \"huge_bytes_reserved\": %zu, "
+                          "\"huge_page_bytes\": %zu, \"thp_hit_rate\": %.4f}\n",
+                          stats.slab_mallocs, stats.slab_frees, stats.large_mallocs, stats.large_frees,
+                          stats.failed_mallocs, stats.mmap_calls, stats.munmap_calls, stats.mremap_calls,
+                          stats.madvise_calls, stats.bytes_requested, stats.bytes_allocated, stats.bytes_freed,
+                          stats.bytes_mapped, stats.bytes_unmapped, stats.bytes_in_use, stats.bytes_reserved,
+                          stats.internal_fragmentation, stats.huge_mappings, stats.hugetlb_fallbacks,
+                          stats.huge_bytes_mapped, stats.huge_bytes_unmapped, stats.huge_bytes_reserved,
+                          stats.huge_page_bytes, stats.thp_hit_rate);
+        return result < 0 ? -1 : 0;
+    }
+
+    result |= fprintf(stream, "pseudo-malloc statistics\n");
+    result |= fprintf(stream, "%12s %12s %12s\n", "block size", "mallocs", "frees");
+    for (int level = 0; level < MAX_LEVELS; level++) {
+        result |= fprintf(stream, "%12zu %12zu %12zu\n", (size_t)MAX_BLOCK_SIZE >> level,
+                          stats.buddy_mallocs[level], stats.buddy_frees[level]);
+    }
+    result |= fprintf(stream, "%12s %12zu %12zu\n", "slab", stats.slab_mallocs, stats.slab_frees);
+    result |= fprintf(stream, "%12s %12zu %12zu\n", "large", stats.large_mallocs, stats.large_frees);
+    result |= fprintf(stream, "failed mallocs:         %zu\n", stats.failed_mallocs);
+    result |= fprintf(stream, "system calls:           %zu mmap, %zu munmap, %zu mremap, %zu madvise\n",
+                      stats.mmap_calls, stats.munmap_calls, stats.mremap_calls, stats.madvise_calls);
+    result |= fprintf(stream, "bytes in use:           %zu\n", stats.bytes_in_use);
+    result |= fprintf(stream, "bytes reserved:         %zu\n", stats.bytes_reserved);
+    result |= fprintf(stream, "internal fragmentation: %.2f%% (%zu bytes requested, %zu allocated)\n",
+                      100.0 * stats.internal_fragmentation, stats.bytes_requested, stats.bytes_allocated);
+    if (stats.huge_mappings) {
+        result |= fprintf(stream, "huge page mappings:     %zu (%zu bytes reserved, %zu MAP_HUGETLB fallbacks)\n",
+                          stats.huge_mappings, stats.huge_bytes_reserved, stats.hugetlb_fallbacks);
+        result |= fprintf(stream, "THP hit rate:           %.2f%% (%zu bytes on huge pages)\n",
+                          100.0 * stats.thp_hit_rate, stats.huge_page_bytes);
+    }
+    return result < 0 ? -1 : 0;
+}
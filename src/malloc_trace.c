@@ -0,0 +1,235 @@
+#define _GNU_SOURCE
+#include "../include/malloc_trace.h"
+#include "../include/debug_print.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+// Records of one thread, waiting to be written out
+typedef struct TraceRing {
+    TraceRecord records[TRACE_RING_RECORDS];
+    size_t head; // Records written, only by the owner thread
+    size_t tail; // Records flushed, only by the thread holding flushing
+    int flushing; // 1 while a thread writes the ring out
+    int owned; // 1 while a thread records into the ring, free rings are reused by new threads
+    uint32_t thread; // Thread number of the owner
+    struct TraceRing* next; // Next ring, rings are never unmapped
+} TraceRing;
+
+int trace_enabled = 0;
+
+static int trace_fd = -1; // Trace file, -1 when not recording
+static uint64_t trace_start_ns; // CLOCK_MONOTONIC time of my_malloc_trace_start
+static uint32_t trace_threads = 0; // Thread numbers handed out
+static TraceRing* trace_rings = NULL; // Every ring ever mapped
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER; // Protects everything above
+
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t trace_key;
+
+// initial-exec: recording must never allocate (no lazy TLS setup)
+static __thread TraceRing* thread_ring __attribute__((tls_model("initial-exec")));
+static __thread int thread_exited __attribute__((tls_model("initial-exec"))); // Ring given back, no more recording
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Write out the records of a ring. Without wait, give up if another thread is at it
+static void trace_ring_flush(TraceRing* ring, int wait) {
+    while (__atomic_exchange_n(&ring->flushing, 1, __ATOMIC_ACQUIRE)) {
+        if (!wait) {
+            return;
+        }
+        sched_yield();
+    }
+
+    size_t tail = ring->tail;
+    size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    int fd = __atomic_load_n(&trace_fd, __ATOMIC_RELAXED);
+    if (fd >= 0 && head != tail) {
+        // One write for the whole chunk (two pieces when it wraps): O_APPEND keeps it in one piece
+        size_t first = tail & (TRACE_RING_RECORDS - 1);
+        size_t count = head - tail;
+        size_t until_end = TRACE_RING_RECORDS - first;
+        struct iovec parts[2] = {
+            {&ring->records[first], (count < until_end ? count : until_end) * sizeof(TraceRecord)},
+            {&ring->records[0], (count > until_end ? count - until_end : 0) * sizeof(TraceRecord)},
+        };
+        if (writev(fd, parts, parts[1].iov_len ? 2 : 1) != (ssize_t)(count * sizeof(TraceRecord))) {
+            DEBUG_FPRINTF(stderr, "[trace_ring_flush]: Error: records of thread %u lost\n", ring->thread);
+        }
+    }
+
+    __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->flushing, 0, __ATOMIC_RELEASE);
+}
+
+// Thread exit: write out what is left and give the ring to the next thread
+static void trace_thread_exit(void* ring) {
+    trace_ring_flush(ring, 1);
+    thread_exited = 1;
+    thread_ring = NULL;
+    __atomic_store_n(&((TraceRing*)ring)->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void fork_prepare(void) {
+    pthread_mutex_lock(&trace_lock);
+}
+
+static void fork_parent(void) {
+    pthread_mutex_unlock(&trace_lock);
+}
+
+// The child does not record into the parent's file, and the rings of the other threads are free again
+static void fork_child(void) {
+    if (trace_fd >= 0) {
+        close(trace_fd);
+        trace_fd = -1;
+    }
+    trace_enabled = 0;
+    for (TraceRing* ring = trace_rings; ring; ring = ring->next) {
+        ring->flushing = 0;
+        if (ring != thread_ring) {
+            ring->owned = 0;
+        }
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+static void trace_global_init(void) {
+    pthread_key_create(&trace_key, trace_thread_exit);
+    pthread_atfork(fork_prepare, fork_parent, fork_child);
+}
+
+// First record of the thread: take a free ring, or map a new one
+static TraceRing* trace_register(void) {
+    pthread_mutex_lock(&trace_lock);
+    TraceRing* ring = trace_rings;
+    while (ring && __atomic_load_n(&ring->owned, __ATOMIC_ACQUIRE)) {
+        ring = ring->next;
+    }
+    if (!ring) {
+        ring = mmap(NULL, sizeof(TraceRing), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ring == MAP_FAILED) {
+            pthread_mutex_unlock(&trace_lock);
+            DEBUG_FPRINTF(stderr, "[trace_register]: Error: mmap failed\n");
+            return NULL;
+        }
+        ring->next = trace_rings;
+        trace_rings = ring;
+    }
+    ring->owned = 1;
+    ring->thread = trace_threads++;
+    pthread_mutex_unlock(&trace_lock);
+
+    // Set first: the glibc calls below may allocate, and that record goes into this ring
+    thread_ring = ring;
+    pthread_once(&trace_once, trace_global_init);
+    pthread_setspecific(trace_key, ring);
+    return ring;
+}
+
+void trace_record(TraceOp op, size_t size, const void* id, uintptr_t old_id) {
+    TraceRing* ring = thread_ring;
+    if (!ring) {
+        if (thread_exited) {
+            return;
+        }
+        ring = trace_register();
+        if (!ring) {
+            return;
+        }
+    }
+
+    // Full ring: make room, even if that means waiting for another flush to end
+    while (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == TRACE_RING_RECORDS) {
+        trace_ring_flush(ring, 1);
+    }
+
+    TraceRecord* record = &ring->records[ring->head & (TRACE_RING_RECORDS - 1)];
+    record->timestamp = now_ns() - trace_start_ns;
+    record->size = size;
+    record->id = (uintptr_t)id;
+    record->old_id = old_id;
+    record->thread = ring->thread;
+    record->op = op;
+    size_t head = ring->head + 1;
+    __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= TRACE_RING_RECORDS / 2) {
+        trace_ring_flush(ring, 0);
+    }
+}
+
+int my_malloc_trace_start(const char* path) {
+    pthread_once(&trace_once, trace_global_init);
+
+    pthread_mutex_lock(&trace_lock);
+    if (trace_fd >= 0) {
+        pthread_mutex_unlock(&trace_lock);
+        DEBUG_FPRINTF(stderr, "[my_malloc_trace_start]: Error: already recording\n");
+        errno = EBUSY;
+        return -1;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        pthread_mutex_unlock(&trace_lock);
+        DEBUG_FPRINTF(stderr, "[my_malloc_trace_start]: Error: cannot open %s\n", path);
+        return -1;
+    }
+
+    TraceFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    if (write(fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+        int error = errno;
+        close(fd);
+        pthread_mutex_unlock(&trace_lock);
+        DEBUG_FPRINTF(stderr, "[my_malloc_trace_start]: Error: cannot write %s\n", path);
+        errno = error;
+        return -1;
+    }
+
+    // Records left over from a previous trace (made while it was stopping) are dropped
+    for (TraceRing* ring = trace_rings; ring; ring = ring->next) {
+        trace_ring_flush(ring, 1);
+    }
+
+    trace_start_ns = now_ns();
+    __atomic_store_n(&trace_fd, fd, __ATOMIC_RELEASE);
+    __atomic_store_n(&trace_enabled, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&trace_lock);
+    return 0;
+}
+
+int my_malloc_trace_stop(void) {
+    pthread_mutex_lock(&trace_lock);
+    if (trace_fd < 0) {
+        pthread_mutex_unlock(&trace_lock);
+        errno = EINVAL;
+        return -1;
+    }
+
+    __atomic_store_n(&trace_enabled, 0, __ATOMIC_RELEASE);
+    for (TraceRing* ring = trace_rings; ring; ring = ring->next) {
+        trace_ring_flush(ring, 1);
+    }
+
+    int fd = trace_fd;
+    __atomic_store_n(&trace_fd, -1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&trace_lock);
+    return close(fd);
+}
@@ -1,8 +1,240 @@
 #define _GNU_SOURCE
 #include "../include/my_malloc.h"
+#include "../include/pool_arena.h"
+#include "../include/slab.h"
+#include "../include/large_cache.h"
+#include "../include/huge_pages.h"
+#include "../include/malloc_stats.h"
+#include "../include/malloc_trace.h"
 #include "../include/debug_print.h"
 
-BuddyAllocator buddy_allocator = {0};
+#include <pthread.h>
+
+/*
+ * Per-thread cache (tcache)
+ * Each thread keeps small stacks of ready-made slab objects (8 to 48 bytes) and
+ * 64/128/256/512 byte buddy blocks. Blocks in a bin
+ * are still allocated for their arena, so malloc/free of cached sizes usually never touch
+ * a lock: the arena lock is only taken to refill an empty bin or to drain a full one.
+ * A bin may hold blocks of any arena (frees from other threads), each one goes back
+ * to its own arena when the bin is drained
+ */
+
+typedef struct TCacheBlock {
+    struct TCacheBlock* next; // Next cached block of the same bin (stored inside the block)
+} TCacheBlock;
+
+typedef struct {
+    TCacheBlock* bins[TCACHE_BINS]; // One stack of cached blocks per size
+    unsigned int counts[TCACHE_BINS]; // Number of blocks in each bin
+    int registered; // Thread exit destructor registered for this thread
+} ThreadCache;
+
+// initial-exec: accessing the cache must never allocate (no lazy TLS setup)
+static __thread ThreadCache thread_cache __attribute__((tls_model("initial-exec")));
+
+static pthread_once_t thread_cache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t thread_cache_key;
+
+// Bin for a request size, TCACHE_BINS if the size is not cached
+static inline int tcache_bin_for_size(size_t size) {
+    if (size <= SLAB_MAX_SIZE) {
+        return slab_class_for_size(size);
+    }
+    if (size <= MIN_BLOCK_SIZE) {
+        return SLAB_CLASSES;
+    }
+    // ceil(log2(size)) - log2(MIN_BLOCK_SIZE), after the slab bins
+    int bin = SLAB_CLASSES + (64 - __builtin_clzll((unsigned long long)size - 1)) - __builtin_ctz(MIN_BLOCK_SIZE);
+    return bin < TCACHE_BINS ? bin : TCACHE_BINS;
+}
+
+static inline size_t tcache_bin_size(int bin) {
+    if (bin < SLAB_CLASSES) {
+        return slab_class_size(bin);
+    }
+    return (size_t)MIN_BLOCK_SIZE << (bin - SLAB_CLASSES);
+}
+
+static inline void tcache_push(ThreadCache* cache, int bin, void* ptr) {
+    TCacheBlock* block = (TCacheBlock*)ptr;
+    block->next = cache->bins[bin];
+    cache->bins[bin] = block;
+    cache->counts[bin]++;
+}
+
+static inline void* tcache_pop(ThreadCache* cache, int bin) {
+    TCacheBlock* block = cache->bins[bin];
+    cache->bins[bin] = block->next;
+    cache->counts[bin]--;
+    return block;
+}
+
+// Give a block back to its arena. `arena` is the locked arena of the calling thread:
+// blocks of other arenas go to their remote stack instead of taking a second lock
+static void release_to_arena_locked(PoolArena* arena, void* ptr) {
+    BuddyPool* pool = pool_arena_lookup(ptr);
+    if (!pool) {
+        return;
+    }
+    if (pool->arena != arena) {
+        pool_arena_free_remote(pool->arena, ptr);
+    } else if (pool->kind == POOL_KIND_SLAB) {
+        slab_free_locked(arena, ptr);
+    } else {
+        pool_arena_free_locked(pool, ptr, 0);
+    }
+}
+
+// Give the cached blocks of a bin back until `keep` are left (arena locked)
+static void tcache_drain_bin_locked(ThreadCache* cache, PoolArena* arena, int bin, unsigned int keep) {
+    while (cache->counts[bin] > keep) {
+        release_to_arena_locked(arena, tcache_pop(cache, bin));
+    }
+}
+
+// Give every cached block back (arena locked)
+static void tcache_flush_locked(ThreadCache* cache, PoolArena* arena) {
+    for (int bin = 0; bin < TCACHE_BINS; bin++) {
+        tcache_drain_bin_locked(cache, arena, bin, 0);
+    }
+}
+
+// Thread exit: the cached blocks would be lost otherwise
+static void tcache_thread_exit(void* unused) {
+    (void)unused;
+    PoolArena* arena = pool_arena_for_thread();
+    pool_arena_lock(arena);
+    tcache_flush_locked(&thread_cache, arena);
+    pool_arena_unlock(arena);
+
+    // Frees from later destructors cache blocks again: register once more to flush them too
+    thread_cache.registered = 0;
+}
+
+static void thread_cache_global_init(void) {
+    pthread_key_create(&thread_cache_key, tcache_thread_exit);
+}
+
+// Make sure the thread exit destructor runs for this thread once it caches something
+static inline void tcache_register(ThreadCache* cache) {
+    if (!cache->registered) {
+        // Set first: pthread_setspecific may allocate, and that malloc must not come back here
+        cache->registered = 1;
+        pthread_once(&thread_cache_once, thread_cache_global_init);
+        pthread_setspecific(thread_cache_key, cache);
+    }
+}
+
+_Static_assert(MID_THRESHOLD >= SMALL_THRESHOLD && MID_THRESHOLD <= BUDDY_POOL_SIZE / 2,
+               "MID_THRESHOLD must be between SMALL_THRESHOLD and half a pool (a block and its metadata must fit)");
+
+// Slab object or buddy block from the locked arena of the thread
+static inline void* arena_block_malloc_locked(PoolArena* arena, size_t size, int metabuddy) {
+    if (size <= SLAB_MAX_SIZE && !metabuddy) {
+        return slab_malloc_locked(arena, slab_class_for_size(size));
+    }
+    PoolKind kind = size < SMALL_THRESHOLD ? POOL_KIND_BUDDY : POOL_KIND_MID;
+    return pool_arena_malloc_locked(arena, kind, size, metabuddy);
+}
+
+// Allocation from the locked arena of the thread. The arena maps a new pool when its
+// pools are full; if even that fails the blocks cached by this thread are given back
+// (they may coalesce into what we need) and we try again
+static void* arena_malloc_locked(PoolArena* arena, size_t size, int metabuddy) {
+    void* ptr = arena_block_malloc_locked(arena, size, metabuddy);
+    if (!ptr) {
+        tcache_flush_locked(&thread_cache, arena);
+        ptr = arena_block_malloc_locked(arena, size, metabuddy);
+    }
+    return ptr;
+}
+
+// Small allocation: thread cache first, then the slabs or pools of the thread arena
+static void* small_malloc(size_t size) {
+    ThreadCache* cache = &thread_cache;
+    int bin = tcache_bin_for_size(size);
+
+    // Fast path, no lock
+    if (bin < TCACHE_BINS && cache->bins[bin]) {
+        return tcache_pop(cache, bin);
+    }
+
+    PoolArena* arena = pool_arena_for_thread();
+
+    // Not a cached size: straight to the pool
+    if (bin == TCACHE_BINS) {
+        pool_arena_lock(arena);
+        void* ptr = arena_malloc_locked(arena, size, 0);
+        pool_arena_unlock(arena);
+        return ptr;
+    }
+
+    // Empty bin: take a few blocks from the pool with a single lock
+    size_t block_size = tcache_bin_size(bin);
+
+    pool_arena_lock(arena);
+    void* ptr = arena_malloc_locked(arena, block_size, 0);
+    if (ptr) {
+        for (int i = 1; i < TCACHE_REFILL_COUNT; i++) {
+            void* extra = arena_block_malloc_locked(arena, block_size, 0);
+            if (!extra) {
+                break;
+            }
+            tcache_push(cache, bin, extra);
+        }
+    }
+    pool_arena_unlock(arena);
+
+    if (cache->counts[bin]) {
+        tcache_register(cache);
+    }
+
+    return ptr;
+}
+
+// Small free: keep the block in the thread cache if there is room, else back to its arena
+static void small_free(BuddyPool* pool, void* ptr) {
+    ThreadCache* cache = &thread_cache;
+
+    size_t block_size = pool->kind == POOL_KIND_SLAB ? slab_object_size(ptr)
+                                                     : BuddyAllocator_block_size(&pool->buddy, ptr);
+    if (block_size == 0) {
+        DEBUG_FPRINTF(stderr, "[my_free]: Error: %p is not an allocated block of the pool\n", ptr);
+        return;
+    }
+
+    if (pool->kind == POOL_KIND_SLAB) {
+        stats_slab_free(block_size);
+    } else {
+        stats_buddy_free(block_size);
+    }
+
+    int bin = tcache_bin_for_size(block_size);
+
+    // Fast path, no lock
+    if (bin < TCACHE_BINS && cache->counts[bin] < TCACHE_BIN_CAPACITY) {
+        tcache_register(cache);
+        tcache_push(cache, bin, ptr);
+        return;
+    }
+
+    PoolArena* arena = pool_arena_for_thread();
+
+    // Block of another thread's arena and nothing to drain: no lock at all
+    if (pool->arena != arena && bin == TCACHE_BINS) {
+        pool_arena_free_remote(pool->arena, ptr);
+        return;
+    }
+
+    pool_arena_lock(arena);
+    release_to_arena_locked(arena, ptr);
+    if (bin < TCACHE_BINS) {
+        // Full bin: give half of it back now so the next frees stay lock-free
+        tcache_drain_bin_locked(cache, arena, bin, TCACHE_BIN_CAPACITY / 2);
+    }
+    pool_arena_unlock(arena);
+}
 
 // Round up to page
 static inline size_t round_to_pages(size_t size) {
@@ -10,7 +242,80 @@ static inline size_t round_to_pages(size_t size) {
     return num_pages * PAGE_SIZE;
 }
 
-void* my_malloc(size_t size) {
+// Size of the mapping of a large block of size bytes, header included: whole pages, or whole
+// huge pages when huge pages are on and the block fills at least one
+static inline size_t large_map_size(size_t size) {
+    size_t map_size = round_to_pages(size);
+    return huge_pages_for(map_size) ? round_to_huge_pages(map_size) : map_size;
+}
+
+/*
+ * Large allocations
+ * A mapping of its own (from the large mapping cache) with a header right before the
+ * pointer handed out. Aligned allocations place the pointer further into the mapping,
+ * the header records how far so the whole mapping can be given back
+ */
+
+typedef struct {
+    size_t map_size; // Size of the whole mapping
+    size_t offset; // Distance from the start of the mapping to the pointer handed out
+} LargeHeader;
+
+_Static_assert(sizeof(LargeHeader) == LARGE_HEADER_SIZE, "large header must keep pointers 16 bytes aligned");
+
+static inline LargeHeader* large_header(void* ptr) {
+    return (LargeHeader*)((char*)ptr - LARGE_HEADER_SIZE);
+}
+
+// Mapping for size bytes aligned to alignment (a power of two); if fresh is not NULL it is set
+// to 1 when the memory comes straight from mmap (all zero)
+static void* large_malloc(size_t size, size_t alignment, int* fresh) {
+    // Room for the header, plus the worst case padding to reach the alignment
+    size_t extra = alignment <= LARGE_HEADER_SIZE ? LARGE_HEADER_SIZE : alignment + LARGE_HEADER_SIZE;
+    if (size > SIZE_MAX - extra - HUGE_PAGE_SIZE) {
+        stats_failed_malloc();
+        errno = ENOMEM;
+        DEBUG_FPRINTF(stderr, "[large_malloc]: Error: size %zu too large\n", size);
+        return NULL;
+    }
+    size_t map_size = large_map_size(size + extra);
+
+    // A recently freed mapping of the same size if there is one, else a new one
+    char* map = large_cache_map(map_size, fresh);
+    if (map == NULL) {
+        stats_failed_malloc();
+        errno = ENOMEM; // Out of memory
+        DEBUG_FPRINTF(stderr, "[large_malloc]: Error: mmap failed\n");
+        return NULL;
+    }
+
+    uintptr_t mask = (uintptr_t)(alignment > LARGE_HEADER_SIZE ? alignment : LARGE_HEADER_SIZE) - 1;
+    char* ptr = (char*)(((uintptr_t)map + LARGE_HEADER_SIZE + mask) & ~mask);
+    LargeHeader* header = large_header(ptr);
+    header->map_size = map_size;
+    header->offset = (size_t)(ptr - map);
+    stats_large_malloc(size, map_size - header->offset);
+
+    DEBUG_PRINTF("[large_malloc]: Successful allocation: ptr=%p, requested=%zu, allocated=%zu\n", (void*)ptr, size, map_size);
+    return ptr;
+}
+
+// Give back the mapping of a large allocation, -1 if munmap failed
+static int large_free(void* ptr) {
+    LargeHeader* header = large_header(ptr);
+    stats_large_free(header->map_size - header->offset);
+    // Kept in the large mapping cache for the next request of that size, or unmapped
+    return large_cache_unmap((char*)ptr - header->offset, header->map_size);
+}
+
+/*
+ * Entry points
+ * Each public function is a thin wrapper recording the call in the allocation trace;
+ * the work is done by the *_block functions below, which also serve each other (realloc
+ * moving a block, calloc, aligned allocations) without adding records of their own
+ */
+
+static void* malloc_block(size_t size) {
 
     // Since size_t is unsigned long is always >= 0 is unnecessary check if < 0
 
@@ -20,41 +325,25 @@ void* my_malloc(size_t size) {
         return NULL;
     }
 
-    // Small size --> buddy allocator
-    if (size < SMALL_THRESHOLD) {
+    // Small and medium size --> buddy allocator (medium blocks come from pools of their own)
+    if (size < MID_THRESHOLD) {
         DEBUG_PRINTF("[my_malloc]: Small size (%zu), using BuddyAllocator\n", size);
-        void* ptr = BuddyAllocator_malloc(&buddy_allocator, size);
+        void* ptr = small_malloc(size);
         if (!ptr) {
+            stats_failed_malloc();
+            errno = ENOMEM; // Out of memory
             DEBUG_FPRINTF(stderr, "[my_malloc]: Error: BuddyAllocator failed\n");
+        } else if (size <= SLAB_MAX_SIZE) {
+            stats_slab_malloc(size, slab_class_size(slab_class_for_size(size)));
+        } else {
+            stats_buddy_malloc(size, stats_buddy_block_size(size));
         }
         return ptr;
     }
 
     // Large size --> use mmap
     DEBUG_PRINTF("[my_malloc]: Large size (%zu), using mmap\n", size);
-
-    // Calculate total size needed (including metadata)
-    size_t total_size = size + sizeof(size_t);
-    size_t alloc_size = round_to_pages(total_size);
-
-    void* ptr = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-
-    // check for correct allocation
-    if (ptr == MAP_FAILED) {
-        errno = ENOMEM; // Out of memory
-        DEBUG_FPRINTF(stderr, "[my_malloc]: Error: mmap failed\n");
-        return NULL;
-    }
-
-    // Store metadata
-    size_t* metadata = (size_t*)ptr;
-    *metadata = size;  // Store original requested size
-
-    // Return pointer after metadata
-    void* return_ptr = (char*)ptr + sizeof(size_t);
-    DEBUG_PRINTF("[my_malloc]: Successful allocation: ptr=%p, requested=%zu, allocated=%zu\n", return_ptr, size, alloc_size);
-
-    return return_ptr;
+    return large_malloc(size, MALLOC_ALIGNMENT, NULL);
 }
 
 void* my_malloc_metabuddy(size_t size) {
@@ -67,44 +356,41 @@ void* my_malloc_metabuddy(size_t size) {
         return NULL;
     }
 
-    // Small size --> buddy allocator
-    if (size < SMALL_THRESHOLD) {
+    // Tiny size --> slab object, its slab knows the size so no metadata is needed
+    if (size <= SLAB_MAX_SIZE) {
+        DEBUG_PRINTF("[my_malloc_metabuddy]: Tiny size (%zu), using a slab\n", size);
+        void* ptr = small_malloc(size);
+        if (!ptr) {
+            stats_failed_malloc();
+            DEBUG_FPRINTF(stderr, "[my_malloc_metabuddy]: Error: slab allocation failed\n");
+        } else {
+            stats_slab_malloc(size, slab_class_size(slab_class_for_size(size)));
+        }
+        return ptr;
+    }
+
+    // Small and medium size --> buddy allocator (medium blocks come from pools of their own)
+    if (size < MID_THRESHOLD) {
         DEBUG_PRINTF("[my_malloc_metabuddy]: Small size (%zu), using BuddyAllocator\n", size);
-        void* ptr = BuddyAllocator_malloc_metabuddy(&buddy_allocator, size);
+        PoolArena* arena = pool_arena_for_thread();
+        pool_arena_lock(arena);
+        void* ptr = arena_malloc_locked(arena, size, 1);
+        pool_arena_unlock(arena);
         if (!ptr) {
+            stats_failed_malloc();
             DEBUG_FPRINTF(stderr, "[my_malloc_metabuddy]: Error: BuddyAllocator failed\n");
+        } else {
+            stats_buddy_malloc(size, stats_buddy_block_size(size + sizeof(size_t)));
         }
         return ptr;
     }
 
     // Large size --> use mmap
     DEBUG_PRINTF("[my_malloc_metabuddy]: Large size (%zu), using mmap\n", size);
-
-    // Calculate total size needed (including metadata)
-    size_t total_size = size + sizeof(size_t);
-    size_t alloc_size = round_to_pages(total_size);
-
-    void* ptr = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-
-    // check for correct allocation
-    if (ptr == MAP_FAILED) {
-        errno = ENOMEM; // Out of memory
-        DEBUG_FPRINTF(stderr, "[my_malloc_metabuddy]: Error: mmap failed\n");
-        return NULL;
-    }
-
-    // Store metadata
-    size_t* metadata = (size_t*)ptr;
-    *metadata = size;  // Store original requested size
-
-    // Return pointer after metadata
-    void* return_ptr = (char*)ptr + sizeof(size_t);
-    DEBUG_PRINTF("[my_malloc_metabuddy]: Successful allocation: ptr=%p, requested=%zu, allocated=%zu\n", return_ptr, size, alloc_size);
-
-    return return_ptr;
+    return large_malloc(size, MALLOC_ALIGNMENT, NULL);
 }
 
-void my_free(void* ptr) {
+static void free_block(void* ptr) {
 
     // Check if ptr is NULL
     if (ptr == NULL) {
@@ -112,29 +398,22 @@ void my_free(void* ptr) {
         return;
     }
 
-    // Check if ptr is within BuddyAllocator range --> ptr deallocation with BuddyAllocator
-    if (buddy_allocator.memory_pool && ptr >= buddy_allocator.memory_pool && ptr < (buddy_allocator.memory_pool + BUDDY_POOL_SIZE)) {
+    // Check if ptr is within a pool of an arena --> ptr deallocation with BuddyAllocator
+    BuddyPool* pool = pool_arena_lookup(ptr);
+    if (pool) {
         DEBUG_PRINTF("[my_free]: Pointer deallocation using BuddyAllocator free..\n");
-        BuddyAllocator_free(&buddy_allocator, ptr);
+        small_free(pool, ptr);
         return;
     }
 
     // Ptr deallocation with munmap
     DEBUG_PRINTF("[my_free]: Pointer deallocation with munmap..\n");
-    void* metadata_ptr = (char*)ptr - sizeof(size_t);
-
-    // Get the original requested size stored in metadata
-    size_t requested_size = *(size_t*)metadata_ptr;
-
-    // Calculate the total allocated size (rounded to page size)
-    size_t alloc_size = round_to_pages(sizeof(size_t) + requested_size);
-    
-    if (munmap(metadata_ptr, alloc_size) == -1) {
+    if (large_free(ptr) == -1) {
         DEBUG_FPRINTF(stderr, "[my_free]: Error: munmap failed\n");
         return;
     }
-    
-    DEBUG_PRINTF("[my_free]: Successfully freed %zu bytes (requested: %zu)\n", alloc_size, requested_size);
+
+    DEBUG_PRINTF("[my_free]: Successfully freed %p\n", ptr);
 }
 
 void my_free_metabuddy(void* ptr) {
@@ -145,27 +424,413 @@ void my_free_metabuddy(void* ptr) {
         return;
     }
 
-    // Check if ptr is within BuddyAllocator range --> ptr deallocation with BuddyAllocator
-    if (buddy_allocator.memory_pool && ptr >= buddy_allocator.memory_pool && ptr < (buddy_allocator.memory_pool + BUDDY_POOL_SIZE)) {
+    // Check if ptr is within a pool of an arena --> ptr deallocation with BuddyAllocator
+    BuddyPool* pool = pool_arena_lookup(ptr);
+    if (pool) {
+        if (pool->kind == POOL_KIND_SLAB) {
+            DEBUG_PRINTF("[my_free_metabuddy]: Pointer deallocation of a slab object..\n");
+            small_free(pool, ptr);
+            return;
+        }
         DEBUG_PRINTF("[my_free_metabuddy]: Pointer deallocation using BuddyAllocator free..\n");
-        BuddyAllocator_free_metabuddy(&buddy_allocator, ptr);
+        size_t block_size = BuddyAllocator_block_size(&pool->buddy, (char*)ptr - sizeof(size_t));
+        if (block_size) {
+            stats_buddy_free(block_size);
+        }
+        PoolArena* owner = pool->arena;
+        pool_arena_lock(owner);
+        pool_arena_free_locked(pool, ptr, 1);
+        pool_arena_unlock(owner);
         return;
     }
 
     // Ptr deallocation with munmap
     DEBUG_PRINTF("[my_free_metabuddy]: Pointer deallocation with munmap..\n");
-    void* metadata_ptr = (char*)ptr - sizeof(size_t);
-
-    // Get the original requested size stored in metadata
-    size_t requested_size = *(size_t*)metadata_ptr;
-
-    // Calculate the total allocated size (rounded to page size)
-    size_t alloc_size = round_to_pages(sizeof(size_t) + requested_size);
-    
-    if (munmap(metadata_ptr, alloc_size) == -1) {
+    if (large_free(ptr) == -1) {
         DEBUG_FPRINTF(stderr, "[my_free_metabuddy]: Error: munmap failed\n");
         return;
     }
 
-    DEBUG_PRINTF("[my_free_metabuddy]: Successfully freed %zu bytes (requested: %zu)\n", alloc_size, requested_size);
-}
\ No newline at end of file
+    DEBUG_PRINTF("[my_free_metabuddy]: Successfully freed %p\n", ptr);
+}
+
+// Slab objects or buddy blocks of one size from the locked arena of the thread, as many as possible up to count
+static size_t arena_malloc_batch_locked(PoolArena* arena, size_t size, size_t count, void** out) {
+    if (size <= SLAB_MAX_SIZE) {
+        int slab_class = slab_class_for_size(size);
+        size_t done = 0;
+        while (done < count && (out[done] = slab_malloc_locked(arena, slab_class)) != NULL) {
+            done++;
+        }
+        return done;
+    }
+    PoolKind kind = size < SMALL_THRESHOLD ? POOL_KIND_BUDDY : POOL_KIND_MID;
+    return pool_arena_malloc_batch_locked(arena, kind, size, count, out);
+}
+
+static size_t malloc_batch(size_t size, size_t count, void** out) {
+
+    if (size == 0 || count == 0) {
+        return 0;
+    }
+
+    // Large size --> one mapping each, nothing to share between them
+    if (size >= MID_THRESHOLD) {
+        size_t done = 0;
+        while (done < count && (out[done] = large_malloc(size, MALLOC_ALIGNMENT, NULL)) != NULL) {
+            done++;
+        }
+        return done;
+    }
+
+    // Cached blocks first, no lock
+    ThreadCache* cache = &thread_cache;
+    int bin = tcache_bin_for_size(size);
+    size_t done = 0;
+    if (bin < TCACHE_BINS) {
+        while (done < count && cache->bins[bin]) {
+            out[done++] = tcache_pop(cache, bin);
+        }
+    }
+
+    // The rest with a single lock: buddy blocks are carved from larger free blocks
+    if (done < count) {
+        PoolArena* arena = pool_arena_for_thread();
+        pool_arena_lock(arena);
+        done += arena_malloc_batch_locked(arena, size, count - done, out + done);
+        if (done < count) {
+            tcache_flush_locked(cache, arena);
+            done += arena_malloc_batch_locked(arena, size, count - done, out + done);
+        }
+        pool_arena_unlock(arena);
+    }
+
+    if (done < count) {
+        stats_failed_malloc();
+        errno = ENOMEM;
+        DEBUG_FPRINTF(stderr, "[my_malloc_batch]: Error: only %zu of %zu blocks allocated\n", done, count);
+    }
+    if (size <= SLAB_MAX_SIZE) {
+        stats_slab_malloc_batch(size, slab_class_size(slab_class_for_size(size)), done);
+    } else {
+        stats_buddy_malloc_batch(size, stats_buddy_block_size(size), done);
+    }
+    return done;
+}
+
+static void free_batch(void** ptrs, size_t count) {
+
+    // Sorted, the blocks of a pool are next to each other and in the order the pool merges them
+    BuddyAllocator_sort_addresses(ptrs, count);
+
+    size_t i = 0;
+    while (i < count) {
+        void* ptr = ptrs[i];
+        BuddyPool* pool = ptr ? pool_arena_lookup(ptr) : NULL;
+        if (!pool) {
+            // NULL or large block
+            if (ptr) {
+                free_block(ptr);
+            }
+            i++;
+            continue;
+        }
+
+        char* pool_end = (char*)pool->buddy.memory_pool + BUDDY_POOL_SIZE;
+        size_t run = 1;
+        while (i + run < count && (char*)ptrs[i + run] < pool_end) {
+            run++;
+        }
+
+        // The whole run goes straight back to its pool (not through the thread cache), with one lock.
+        // Freeing the last object of a slab pool may unmap the pool: its kind is read before, and
+        // each later pointer of the run is looked up again before its slab is read
+        PoolArena* owner = pool->arena;
+        PoolKind kind = pool->kind;
+        pool_arena_lock(owner);
+        for (size_t j = i; j < i + run; j++) {
+            if (kind == POOL_KIND_SLAB && j > i && pool_arena_lookup(ptrs[j]) != pool) {
+                DEBUG_FPRINTF(stderr, "[my_free_batch]: Error: %p is not an allocated block of the pool\n", ptrs[j]);
+                continue;
+            }
+            size_t block_size = kind == POOL_KIND_SLAB ? slab_object_size(ptrs[j])
+                                                       : BuddyAllocator_block_size(&pool->buddy, ptrs[j]);
+            if (block_size == 0) {
+                DEBUG_FPRINTF(stderr, "[my_free_batch]: Error: %p is not an allocated block of the pool\n", ptrs[j]);
+            } else if (kind == POOL_KIND_SLAB) {
+                stats_slab_free(block_size);
+                slab_free_locked(owner, ptrs[j]);
+            } else {
+                stats_buddy_free(block_size);
+            }
+        }
+        if (kind != POOL_KIND_SLAB) {
+            pool_arena_free_batch_locked(pool, ptrs + i, run);
+        }
+        pool_arena_unlock(owner);
+
+        i += run;
+    }
+}
+
+void* my_malloc(size_t size) {
+    void* ptr = malloc_block(size);
+    if (ptr) {
+        trace_event(TRACE_MALLOC, size, ptr, 0);
+    }
+    return ptr;
+}
+
+void my_free(void* ptr) {
+    if (ptr) {
+        trace_event(TRACE_FREE, 0, ptr, 0);
+    }
+    free_block(ptr);
+}
+
+size_t my_malloc_batch(size_t size, size_t count, void** out) {
+    size_t done = malloc_batch(size, count, out);
+    for (size_t i = 0; i < done; i++) {
+        trace_event(TRACE_MALLOC, size, out[i], 0);
+    }
+    return done;
+}
+
+void my_free_batch(void** ptrs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (ptrs[i]) {
+            trace_event(TRACE_FREE, 0, ptrs[i], 0);
+        }
+    }
+    free_batch(ptrs, count);
+}
+
+size_t my_malloc_trim(void) {
+    // The blocks cached by this thread first, so that they can merge before the purge
+    // (the caches of other threads are theirs to flush)
+    PoolArena* arena = pool_arena_for_thread();
+    pool_arena_lock(arena);
+    tcache_flush_locked(&thread_cache, arena);
+    pool_arena_unlock(arena);
+
+    size_t released = pool_arena_trim_all() + large_cache_flush();
+    DEBUG_PRINTF("[my_malloc_trim]: Gave back %zu bytes\n", released);
+    return released;
+}
+
+size_t my_malloc_usable_size(void* ptr) {
+    if (ptr == NULL) {
+        return 0;
+    }
+
+    BuddyPool* pool = pool_arena_lookup(ptr);
+    if (pool) {
+        return pool->kind == POOL_KIND_SLAB ? slab_object_size(ptr)
+                                            : BuddyAllocator_block_size(&pool->buddy, ptr);
+    }
+
+    LargeHeader* header = large_header(ptr);
+    return header->map_size - header->offset;
+}
+
+// Move an allocation into a new one of size bytes
+static void* realloc_move(void* ptr, size_t old_size, size_t size) {
+    void* new_ptr = malloc_block(size);
+    if (new_ptr == NULL) {
+        return NULL; // The old block is left untouched
+    }
+    memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+    free_block(ptr);
+    return new_ptr;
+}
+
+static void* realloc_block(void* ptr, size_t size) {
+
+    // NULL pointer --> plain malloc
+    if (ptr == NULL) {
+        return malloc_block(size);
+    }
+
+    // Zero size --> plain free
+    if (size == 0) {
+        free_block(ptr);
+        return NULL;
+    }
+
+    BuddyPool* pool = pool_arena_lookup(ptr);
+    if (pool) {
+        if (pool->kind == POOL_KIND_SLAB) {
+            size_t object_size = slab_object_size(ptr);
+            // Still fits in the object: nothing to do
+            if (size <= object_size) {
+                return ptr;
+            }
+            return realloc_move(ptr, object_size, size);
+        }
+
+        // Buddy block staying in its tier: merge the free buddies above it or give back its upper halves
+        size_t limit = pool->kind == POOL_KIND_BUDDY ? SMALL_THRESHOLD : MID_THRESHOLD;
+        PoolArena* owner = pool->arena;
+        pool_arena_lock(owner);
+        size_t old_size = BuddyAllocator_block_size(&pool->buddy, ptr);
+        int resized = size < limit && BuddyAllocator_resize(&pool->buddy, ptr, size);
+        pool_arena_unlock(owner);
+
+        if (resized) {
+            stats_buddy_free(old_size);
+            stats_buddy_malloc(size, stats_buddy_block_size(size));
+            DEBUG_PRINTF("[my_realloc]: Resized %p in place to %zu bytes\n", ptr, size);
+            return ptr;
+        }
+        return realloc_move(ptr, old_size, size);
+    }
+
+    LargeHeader* header = large_header(ptr);
+    size_t old_size = header->map_size - header->offset;
+
+    // Large block staying large: let the kernel grow or shrink the mapping, moving its pages if needed
+    // (a mapping keeps its kind of pages: going from small to huge pages or back takes a copy)
+    if (size >= MID_THRESHOLD && size <= SIZE_MAX - header->offset - HUGE_PAGE_SIZE
+        && huge_pages_for(header->map_size) == huge_pages_for(round_to_pages(size + header->offset))) {
+        size_t offset = header->offset;
+        size_t map_size = large_map_size(size + offset);
+        if (map_size == header->map_size) {
+            return ptr;
+        }
+
+        int huge = huge_pages_for(map_size);
+        char* map = mremap((char*)ptr - offset, header->map_size, map_size, MREMAP_MAYMOVE);
+        if (map == MAP_FAILED && !huge) {
+            errno = ENOMEM;
+            DEBUG_FPRINTF(stderr, "[my_realloc]: Error: mremap failed\n");
+            return NULL;
+        }
+
+        // MAP_HUGETLB mappings cannot be resized: those are copied below
+        if (map != MAP_FAILED) {
+            stats_mremap(old_size + offset, map_size); // The old header may be gone with the old mapping
+            if (huge) {
+                stats_huge_remap(old_size + offset, map_size);
+            }
+            stats_large_free(old_size);
+            stats_large_malloc(size, map_size - offset);
+            ptr = map + offset;
+            large_header(ptr)->map_size = map_size;
+            DEBUG_PRINTF("[my_realloc]: Remapped to %p, %zu bytes\n", ptr, map_size);
+            return ptr;
+        }
+    }
+
+    return realloc_move(ptr, old_size, size);
+}
+
+void* my_realloc(void* ptr, size_t size) {
+    // The old block may be given back inside the call, and its address handed to another
+    // thread before this one records anything: named before the call, as a free is
+    if (ptr) {
+        trace_event(TRACE_REALLOC_BEGIN, 0, NULL, (uintptr_t)ptr);
+    }
+    void* new_ptr = realloc_block(ptr, size);
+    if (new_ptr || (ptr && size == 0)) {
+        trace_event(TRACE_REALLOC, size, new_ptr, (uintptr_t)ptr);
+    } else if (ptr) {
+        // Failed: the block stays as it was
+        trace_event(TRACE_REALLOC, 0, ptr, (uintptr_t)ptr);
+    }
+    return new_ptr;
+}
+
+static void* calloc_block(size_t nmemb, size_t size) {
+
+    // Zero size --> return NULL, same as my_malloc
+    if (nmemb == 0 || size == 0) {
+        DEBUG_PRINTF("[my_calloc]: Warning: size is 0, returning NULL\n");
+        return NULL;
+    }
+
+    if (nmemb > SIZE_MAX / size) {
+        errno = ENOMEM;
+        DEBUG_FPRINTF(stderr, "[my_calloc]: Error: %zu * %zu overflows\n", nmemb, size);
+        return NULL;
+    }
+    size_t total = nmemb * size;
+
+    // Large size --> a new mapping is already zero, only a reused one needs clearing
+    if (total >= MID_THRESHOLD) {
+        int fresh = 0;
+        void* ptr = large_malloc(total, MALLOC_ALIGNMENT, &fresh);
+        if (ptr && !fresh) {
+            memset(ptr, 0, total);
+        }
+        return ptr;
+    }
+
+    void* ptr = malloc_block(total);
+    if (ptr) {
+        memset(ptr, 0, total);
+    }
+    return ptr;
+}
+
+void* my_calloc(size_t nmemb, size_t size) {
+    void* ptr = calloc_block(nmemb, size);
+    if (ptr) {
+        trace_event(TRACE_CALLOC, nmemb * size, ptr, 0);
+    }
+    return ptr;
+}
+
+// Allocation of size bytes aligned to alignment (a power of two)
+static void* aligned_malloc(size_t alignment, size_t size) {
+
+    // Every block is 16 bytes aligned except the 8 and 24 bytes slab objects: skip those classes
+    if (alignment <= MALLOC_ALIGNMENT) {
+        return malloc_block(size <= SLAB_MAX_SIZE ? (size + 15) & ~(size_t)15 : size);
+    }
+
+    // Buddy blocks are aligned to their size: ask for one at least as large as the alignment
+    size_t block_size = size > alignment ? size : alignment;
+    if (block_size < MID_THRESHOLD) {
+        return malloc_block(block_size <= SLAB_MAX_SIZE ? MIN_BLOCK_SIZE : block_size);
+    }
+
+    return large_malloc(size, alignment, NULL);
+}
+
+int my_posix_memalign(void** memptr, size_t alignment, size_t size) {
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0) {
+        DEBUG_FPRINTF(stderr, "[my_posix_memalign]: Error: invalid alignment %zu\n", alignment);
+        return EINVAL;
+    }
+
+    if (size == 0) {
+        *memptr = NULL;
+        return 0;
+    }
+
+    void* ptr = aligned_malloc(alignment, size);
+    if (ptr == NULL) {
+        return ENOMEM;
+    }
+    trace_event(TRACE_MEMALIGN, size, ptr, alignment);
+    *memptr = ptr;
+    return 0;
+}
+
+void* my_aligned_alloc(size_t alignment, size_t size) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        errno = EINVAL;
+        DEBUG_FPRINTF(stderr, "[my_aligned_alloc]: Error: invalid alignment %zu\n", alignment);
+        return NULL;
+    }
+
+    if (size == 0) {
+        return NULL;
+    }
+
+    void* ptr = aligned_malloc(alignment, size);
+    if (ptr) {
+        trace_event(TRACE_MEMALIGN, size, ptr, alignment);
+    }
+    return ptr;
+}
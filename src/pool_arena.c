@@ -0,0 +1,449 @@
+#define _GNU_SOURCE
+#include "../include/pool_arena.h"
+#include "../include/malloc_stats.h"
+#include "../include/debug_print.h"
+
+#include <sched.h>
+
+static PoolArena arenas[MAX_ARENAS];
+static int arenas_count = 1; // Arenas in use, set once by arenas_init
+static unsigned int next_arena = 0; // Round robin counter for thread assignment
+
+static pthread_once_t arenas_once = PTHREAD_ONCE_INIT;
+static pthread_once_t fork_handlers_once = PTHREAD_ONCE_INIT;
+
+_Static_assert(((size_t)1 << BUDDY_POOL_ORDER) == BUDDY_POOL_SIZE, "BUDDY_POOL_ORDER must be log2(BUDDY_POOL_SIZE)");
+
+/*
+ * Pool map: two-level radix tree from (address >> BUDDY_POOL_ORDER) to the pool mapped
+ * there. The root is static, leaves are mmap'd the first time a pool lands in their
+ * range and are never released. Readers go through it without a lock
+ */
+#define POOL_MAP_LEAF_SIZE ((size_t)1 << POOL_MAP_LEAF_BITS)
+static BuddyPool** pool_map[(size_t)1 << POOL_MAP_ROOT_BITS];
+static pthread_mutex_t pool_map_lock = PTHREAD_MUTEX_INITIALIZER; // Serializes leaf creation
+
+/*
+ * Pool records live in their own pages so that a pool mapping only holds blocks and
+ * bitmaps. Released records are reused before a new page is mapped
+ */
+static BuddyPool* free_pool_records = NULL; // Released records (linked through next)
+static pthread_mutex_t pool_records_lock = PTHREAD_MUTEX_INITIALIZER; // Protects free_pool_records
+
+// initial-exec: accessing the arena pointer must never allocate (no lazy TLS setup)
+static __thread PoolArena* thread_arena __attribute__((tls_model("initial-exec")));
+
+// The global locks come after the arena locks, the order pool_create takes them in. Heap
+// arenas are not in arenas[] but also take them, from pool_create
+static void fork_prepare(void) {
+    for (int i = 0; i < arenas_count; i++) {
+        pthread_mutex_lock(&arenas[i].lock);
+    }
+    pthread_mutex_lock(&pool_records_lock);
+    pthread_mutex_lock(&pool_map_lock);
+}
+
+static void fork_release(void) {
+    pthread_mutex_unlock(&pool_map_lock);
+    pthread_mutex_unlock(&pool_records_lock);
+    for (int i = arenas_count - 1; i >= 0; i--) {
+        pthread_mutex_unlock(&arenas[i].lock);
+    }
+}
+
+// A fork while another thread holds a lock would leave it locked forever in the child
+static void register_fork_handlers(void) {
+    pthread_atfork(fork_prepare, fork_release, fork_release);
+}
+
+void pool_arena_init(PoolArena* arena) {
+    pthread_mutex_init(&arena->lock, NULL);
+    for (int kind = 0; kind < POOL_KINDS; kind++) {
+        arena->pools[kind] = NULL;
+        arena->current[kind] = NULL;
+    }
+    for (int slab_class = 0; slab_class < SLAB_CLASSES; slab_class++) {
+        arena->slabs[slab_class] = NULL;
+    }
+    arena->remote_frees = NULL;
+    arena->mapped_bytes = 0;
+    arena->mapped_limit = 0;
+    arena->frees_since_purge = 0;
+}
+
+// CPUs the process may run on. One system call, where sysconf(_SC_NPROCESSORS_ONLN) parses
+// /sys (tens of microseconds on the first malloc of every process)
+static long usable_cpus(void) {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        return CPU_COUNT(&set);
+    }
+    // More CPUs than a cpu_set_t holds
+    return sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+static void arenas_init(void) {
+    long cpus = usable_cpus();
+    if (cpus < 1) {
+        cpus = 1;
+    }
+
+    long count = cpus * ARENAS_PER_CPU;
+    if (count > MAX_ARENAS) {
+        count = MAX_ARENAS;
+    }
+
+    for (int i = 0; i < count; i++) {
+        pool_arena_init(&arenas[i]);
+    }
+
+    __atomic_store_n(&arenas_count, (int)count, __ATOMIC_RELEASE);
+
+    DEBUG_PRINTF("[arenas_init]: %d arenas for %ld CPUs\n", arenas_count, cpus);
+}
+
+PoolArena* pool_arena_for_thread(void) {
+    PoolArena* arena = thread_arena;
+    if (arena) {
+        return arena;
+    }
+
+    pthread_once(&arenas_once, arenas_init);
+
+    unsigned int index = __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED) % (unsigned int)arenas_count;
+    thread_arena = &arenas[index];
+
+    // glibc may allocate to record the handlers: done once the thread has its arena, so
+    // that the malloc it calls does not come back here
+    pthread_once(&fork_handlers_once, register_fork_handlers);
+
+    DEBUG_PRINTF("[pool_arena_for_thread]: Thread assigned to arena %u\n", index);
+    return thread_arena;
+}
+
+// Slot of the pool map for a pool address, creating its leaf if needed. NULL if the
+// address is outside the map or the leaf cannot be mapped
+static BuddyPool** pool_map_slot(const void* pool_address) {
+    uintptr_t key = (uintptr_t)pool_address >> BUDDY_POOL_ORDER;
+    if (key >> (POOL_MAP_ROOT_BITS + POOL_MAP_LEAF_BITS)) {
+        DEBUG_FPRINTF(stderr, "[pool_map_slot]: Error: %p is outside the pool map\n", pool_address);
+        return NULL;
+    }
+
+    BuddyPool*** root_slot = &pool_map[key >> POOL_MAP_LEAF_BITS];
+    BuddyPool** leaf = __atomic_load_n(root_slot, __ATOMIC_ACQUIRE);
+    if (!leaf) {
+        pthread_mutex_lock(&pool_map_lock);
+        leaf = *root_slot;
+        if (!leaf) {
+            void* page = mmap(NULL, POOL_MAP_LEAF_SIZE * sizeof(BuddyPool*), PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (page != MAP_FAILED) {
+                stats_mmap(POOL_MAP_LEAF_SIZE * sizeof(BuddyPool*));
+                leaf = page;
+                __atomic_store_n(root_slot, leaf, __ATOMIC_RELEASE);
+            }
+        }
+        pthread_mutex_unlock(&pool_map_lock);
+        if (!leaf) {
+            DEBUG_FPRINTF(stderr, "[pool_map_slot]: Error: mmap of a pool map leaf failed\n");
+            return NULL;
+        }
+    }
+
+    return &leaf[key & (POOL_MAP_LEAF_SIZE - 1)];
+}
+
+static BuddyPool* pool_record_alloc(void) {
+    pthread_mutex_lock(&pool_records_lock);
+    if (!free_pool_records) {
+        // Carve a fresh page into records
+        char* page = mmap(NULL, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (page == MAP_FAILED) {
+            pthread_mutex_unlock(&pool_records_lock);
+            DEBUG_FPRINTF(stderr, "[pool_record_alloc]: Error: mmap failed\n");
+            return NULL;
+        }
+        stats_mmap(PAGE_SIZE);
+        for (size_t i = 0; i < PAGE_SIZE / sizeof(BuddyPool); i++) {
+            BuddyPool* record = (BuddyPool*)page + i;
+            record->next = free_pool_records;
+            free_pool_records = record;
+        }
+    }
+    BuddyPool* pool = free_pool_records;
+    free_pool_records = pool->next;
+    pthread_mutex_unlock(&pool_records_lock);
+    return pool;
+}
+
+static void pool_record_free(BuddyPool* pool) {
+    pthread_mutex_lock(&pool_records_lock);
+    pool->next = free_pool_records;
+    free_pool_records = pool;
+    pthread_mutex_unlock(&pool_records_lock);
+}
+
+// Map a new pool and append it to a chain of the locked arena
+static BuddyPool* pool_create(PoolArena* arena, PoolKind kind) {
+    if (arena->mapped_limit && arena->mapped_bytes + BUDDY_POOL_SIZE > arena->mapped_limit) {
+        DEBUG_FPRINTF(stderr, "[pool_create]: Error: arena limit of %zu bytes reached\n", arena->mapped_limit);
+        return NULL;
+    }
+
+    BuddyPool* pool = pool_record_alloc();
+    if (!pool) {
+        return NULL;
+    }
+
+    pool->buddy.memory_pool = NULL;
+    if (!BuddyAllocator_init(&pool->buddy)) {
+        pool_record_free(pool);
+        return NULL;
+    }
+    pool->arena = arena;
+    pool->kind = kind;
+    pool->next = NULL;
+    pool->dirty = 0;
+
+    BuddyPool** slot = pool_map_slot(pool->buddy.memory_pool);
+    if (!slot) {
+        BuddyAllocator_destroy(&pool->buddy);
+        pool_record_free(pool);
+        return NULL;
+    }
+    // Published last: my_free looks pools up without holding the lock
+    __atomic_store_n(slot, pool, __ATOMIC_RELEASE);
+
+    BuddyPool** link = &arena->pools[kind];
+    while (*link) {
+        link = &(*link)->next;
+    }
+    *link = pool;
+    arena->mapped_bytes += BUDDY_POOL_SIZE;
+
+    DEBUG_PRINTF("[pool_create]: New pool at %p\n", pool->buddy.memory_pool);
+    return pool;
+}
+
+// Unlink an empty pool from its chain in the locked arena and give it back to the OS
+static void pool_release(PoolArena* arena, BuddyPool* pool) {
+    BuddyPool** link = &arena->pools[pool->kind];
+    while (*link != pool) {
+        link = &(*link)->next;
+    }
+    *link = pool->next;
+    if (arena->current[pool->kind] == pool) {
+        arena->current[pool->kind] = arena->pools[pool->kind];
+    }
+
+    __atomic_store_n(pool_map_slot(pool->buddy.memory_pool), NULL, __ATOMIC_RELEASE);
+    arena->mapped_bytes -= BUDDY_POOL_SIZE;
+
+    DEBUG_PRINTF("[pool_release]: Releasing pool at %p\n", pool->buddy.memory_pool);
+    BuddyAllocator_destroy(&pool->buddy);
+    pool_record_free(pool);
+}
+
+void pool_arena_release_all(PoolArena* arena) {
+    for (int kind = 0; kind < POOL_KINDS; kind++) {
+        while (arena->pools[kind]) {
+            pool_release(arena, arena->pools[kind]);
+        }
+        arena->current[kind] = NULL;
+    }
+    // Slabs lived inside the pools
+    for (int slab_class = 0; slab_class < SLAB_CLASSES; slab_class++) {
+        arena->slabs[slab_class] = NULL;
+    }
+    arena->remote_frees = NULL;
+}
+
+BuddyPool* pool_arena_lookup(const void* ptr) {
+    uintptr_t key = (uintptr_t)ptr >> BUDDY_POOL_ORDER;
+    if (key >> (POOL_MAP_ROOT_BITS + POOL_MAP_LEAF_BITS)) {
+        return NULL;
+    }
+
+    BuddyPool** leaf = __atomic_load_n(&pool_map[key >> POOL_MAP_LEAF_BITS], __ATOMIC_ACQUIRE);
+    if (!leaf) {
+        return NULL;
+    }
+    return __atomic_load_n(&leaf[key & (POOL_MAP_LEAF_SIZE - 1)], __ATOMIC_ACQUIRE);
+}
+
+void pool_arena_lock(PoolArena* arena) {
+    pthread_mutex_lock(&arena->lock);
+
+    // Take the whole remote stack at once and give its blocks back to their pools
+    void* block = __atomic_exchange_n(&arena->remote_frees, NULL, __ATOMIC_ACQUIRE);
+    while (block) {
+        void* next = *(void**)block;
+        BuddyPool* pool = pool_arena_lookup(block);
+        if (pool->kind == POOL_KIND_SLAB) {
+            slab_free_locked(arena, block);
+        } else {
+            pool_arena_free_locked(pool, block, 0);
+        }
+        block = next;
+    }
+}
+
+void pool_arena_unlock(PoolArena* arena) {
+    pthread_mutex_unlock(&arena->lock);
+}
+
+void pool_arena_free_remote(PoolArena* arena, void* block) {
+    void* head = __atomic_load_n(&arena->remote_frees, __ATOMIC_RELAXED);
+    do {
+        *(void**)block = head;
+    } while (!__atomic_compare_exchange_n(&arena->remote_frees, &head, block, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static inline void* pool_malloc(BuddyPool* pool, size_t size, int metabuddy) {
+    return metabuddy ? BuddyAllocator_malloc_metabuddy(&pool->buddy, size)
+                     : BuddyAllocator_malloc(&pool->buddy, size);
+}
+
+void* pool_arena_malloc_locked(PoolArena* arena, PoolKind kind, size_t size, int metabuddy) {
+    // Usually the pool that served the previous request still has room
+    BuddyPool* current = arena->current[kind];
+    if (current) {
+        void* ptr = pool_malloc(current, size, metabuddy);
+        if (ptr) {
+            return ptr;
+        }
+    }
+
+    // Oldest pools first, so the newest ones are the likeliest to empty and be released
+    for (BuddyPool* pool = arena->pools[kind]; pool; pool = pool->next) {
+        if (pool == current) {
+            continue;
+        }
+        void* ptr = pool_malloc(pool, size, metabuddy);
+        if (ptr) {
+            arena->current[kind] = pool;
+            return ptr;
+        }
+    }
+
+    // Every pool is full: grow the chain
+    BuddyPool* pool = pool_create(arena, kind);
+    if (!pool) {
+        return NULL;
+    }
+    arena->current[kind] = pool;
+    return pool_malloc(pool, size, metabuddy);
+}
+
+size_t pool_arena_malloc_batch_locked(PoolArena* arena, PoolKind kind, size_t size, size_t count, void** out) {
+    // Same order as pool_arena_malloc_locked: current pool, oldest pools, then new ones
+    size_t done = 0;
+    BuddyPool* current = arena->current[kind];
+    if (current) {
+        done = BuddyAllocator_malloc_batch(&current->buddy, size, count, out);
+    }
+
+    for (BuddyPool* pool = arena->pools[kind]; pool && done < count; pool = pool->next) {
+        if (pool == current) {
+            continue;
+        }
+        size_t taken = BuddyAllocator_malloc_batch(&pool->buddy, size, count - done, out + done);
+        if (taken) {
+            arena->current[kind] = pool;
+            done += taken;
+        }
+    }
+
+    while (done < count) {
+        BuddyPool* pool = pool_create(arena, kind);
+        if (!pool) {
+            break;
+        }
+        arena->current[kind] = pool;
+        done += BuddyAllocator_malloc_batch(&pool->buddy, size, count - done, out + done);
+    }
+    return done;
+}
+
+// Purge the pools freed into since their last purge
+static size_t pool_arena_purge_locked(PoolArena* arena, size_t min_size) {
+    size_t purged = 0;
+    for (int kind = 0; kind < POOL_KINDS; kind++) {
+        for (BuddyPool* pool = arena->pools[kind]; pool; pool = pool->next) {
+            if (pool->dirty) {
+                purged += BuddyAllocator_purge(&pool->buddy, min_size);
+                pool->dirty = 0;
+            }
+        }
+    }
+    arena->frees_since_purge = 0;
+    return purged;
+}
+
+size_t pool_arena_trim_locked(PoolArena* arena) {
+    size_t released = 0;
+    for (int kind = 0; kind < POOL_KINDS; kind++) {
+        BuddyPool* pool = arena->pools[kind];
+        while (pool) {
+            BuddyPool* next = pool->next;
+            if (BuddyAllocator_is_empty(&pool->buddy)) {
+                pool_release(arena, pool);
+                released += BUDDY_POOL_SIZE;
+            }
+            pool = next;
+        }
+    }
+    return released + pool_arena_purge_locked(arena, 0);
+}
+
+size_t pool_arena_trim_all(void) {
+    pthread_once(&arenas_once, arenas_init);
+
+    size_t released = 0;
+    int count = __atomic_load_n(&arenas_count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; i++) {
+        pool_arena_lock(&arenas[i]);
+        released += pool_arena_trim_locked(&arenas[i]);
+        pool_arena_unlock(&arenas[i]);
+    }
+    return released;
+}
+
+// After a free: unmap the pool if it became empty and its chain has another empty pool,
+// and purge the arena once enough frees went by
+static void pool_after_free(BuddyPool* pool) {
+    PoolArena* arena = pool->arena;
+    if (!BuddyAllocator_is_empty(&pool->buddy)) {
+        pool->dirty = 1;
+        if (++arena->frees_since_purge >= POOL_PURGE_INTERVAL) {
+            pool_arena_purge_locked(arena, BUDDY_PURGE_MIN_SIZE);
+        }
+        return;
+    }
+
+    // Keep one empty pool per chain, so a workload going back and forth across a pool
+    // boundary does not map and unmap a pool on every call
+    pool->dirty = 1;
+    for (BuddyPool* other = arena->pools[pool->kind]; other; other = other->next) {
+        if (other != pool && BuddyAllocator_is_empty(&other->buddy)) {
+            pool_release(arena, pool);
+            return;
+        }
+    }
+}
+
+void pool_arena_free_locked(BuddyPool* pool, void* ptr, int metabuddy) {
+    if (metabuddy) {
+        BuddyAllocator_free_metabuddy(&pool->buddy, ptr);
+    } else {
+        BuddyAllocator_free(&pool->buddy, ptr);
+    }
+    pool_after_free(pool);
+}
+
+void pool_arena_free_batch_locked(BuddyPool* pool, void** ptrs, size_t count) {
+    BuddyAllocator_free_batch(&pool->buddy, ptrs, count);
+    pool_after_free(pool);
+}
@@ -0,0 +1,135 @@
+#include "../include/slab.h"
+#include "../include/pool_arena.h"
+#include "../include/debug_print.h"
+
+// Objects start right after the header, rounded to 16 bytes like any other malloc result
+#define SLAB_HEADER_SIZE ((sizeof(Slab) + 15) & ~(size_t)15)
+
+static const uint32_t slab_class_sizes[SLAB_CLASSES] = {8, 16, 24, 32, 48};
+
+// Class of a size by its number of 8-byte units (rounded up)
+static const unsigned char slab_class_by_units[SLAB_MAX_SIZE / 8 + 1] = {0, 0, 1, 2, 3, 4, 4};
+
+_Static_assert(SLAB_MAX_SIZE % 8 == 0, "SLAB_MAX_SIZE must be a multiple of 8");
+_Static_assert(SLAB_SIZE >= MIN_BLOCK_SIZE && (SLAB_SIZE & (SLAB_SIZE - 1)) == 0, "a slab must be a buddy block");
+
+int slab_class_for_size(size_t size) {
+    if (size > SLAB_MAX_SIZE) {
+        return SLAB_CLASSES;
+    }
+    return slab_class_by_units[(size + 7) / 8];
+}
+
+size_t slab_class_size(int slab_class) {
+    return slab_class_sizes[slab_class];
+}
+
+static inline Slab* slab_of(const void* ptr) {
+    return (Slab*)((uintptr_t)ptr & ~((uintptr_t)SLAB_SIZE - 1));
+}
+
+// Index of the object at ptr, BITMAP_NOT_FOUND if ptr is not the start of an object
+static inline size_t slab_object_index(const Slab* slab, const void* ptr) {
+    size_t offset = (size_t)((const char*)ptr - (const char*)slab);
+    if (offset < SLAB_HEADER_SIZE || slab->object_size == 0) {
+        return BITMAP_NOT_FOUND;
+    }
+
+    offset -= SLAB_HEADER_SIZE;
+    size_t index = offset / slab->object_size;
+    if (index * slab->object_size != offset || index >= slab->free_map.size) {
+        return BITMAP_NOT_FOUND;
+    }
+    return index;
+}
+
+static void slab_list_push(PoolArena* arena, int slab_class, Slab* slab) {
+    slab->prev = NULL;
+    slab->next = arena->slabs[slab_class];
+    if (slab->next) {
+        slab->next->prev = slab;
+    }
+    arena->slabs[slab_class] = slab;
+}
+
+static void slab_list_remove(PoolArena* arena, int slab_class, Slab* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        arena->slabs[slab_class] = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+}
+
+// Take a buddy block from the slab pools of the locked arena and carve it into objects of a class
+static Slab* slab_create(PoolArena* arena, int slab_class) {
+    Slab* slab = pool_arena_malloc_locked(arena, POOL_KIND_SLAB, SLAB_SIZE, 0);
+    if (!slab) {
+        DEBUG_FPRINTF(stderr, "[slab_create]: Error: no buddy block for a new slab\n");
+        return NULL;
+    }
+
+    size_t capacity = (SLAB_SIZE - SLAB_HEADER_SIZE) / slab_class_sizes[slab_class];
+    slab->object_size = slab_class_sizes[slab_class];
+    slab->free_count = (uint32_t)capacity;
+    bitmap_init_inplace(&slab->free_map, capacity, slab->free_words);
+    bitmap_set_range(&slab->free_map, 0, capacity);
+    slab_list_push(arena, slab_class, slab);
+
+    DEBUG_PRINTF("[slab_create]: New slab of %zu objects of %u bytes at %p\n", capacity, slab->object_size, (void*)slab);
+    return slab;
+}
+
+void* slab_malloc_locked(PoolArena* arena, int slab_class) {
+    Slab* slab = arena->slabs[slab_class];
+    if (!slab) {
+        slab = slab_create(arena, slab_class);
+        if (!slab) {
+            return NULL;
+        }
+    }
+
+    // Slabs on the list always have a free object
+    size_t index = bitmap_find_first_set(&slab->free_map, 0, slab->free_map.size);
+    bitmap_clear_fast(&slab->free_map, index);
+    if (--slab->free_count == 0) {
+        slab_list_remove(arena, slab_class, slab);
+    }
+
+    return (char*)slab + SLAB_HEADER_SIZE + index * slab->object_size;
+}
+
+void slab_free_locked(PoolArena* arena, void* ptr) {
+    Slab* slab = slab_of(ptr);
+
+    size_t index = slab_object_index(slab, ptr);
+    if (index == BITMAP_NOT_FOUND || bitmap_test_fast(&slab->free_map, index)) {
+        DEBUG_FPRINTF(stderr, "[slab_free_locked]: Error: %p is not an allocated object of its slab\n", ptr);
+        return;
+    }
+
+    bitmap_set_fast(&slab->free_map, index);
+    slab->free_count++;
+
+    int slab_class = slab_class_for_size(slab->object_size);
+    if (slab->free_count == 1) {
+        // Was full, so it was not on the list
+        slab_list_push(arena, slab_class, slab);
+    } else if (slab->free_count == slab->free_map.size && (arena->slabs[slab_class] != slab || slab->next)) {
+        // Empty and not the last slab with room for this class: give the block back
+        slab_list_remove(arena, slab_class, slab);
+        pool_arena_free_locked(pool_arena_lookup(slab), slab, 0);
+    }
+}
+
+size_t slab_object_size(const void* ptr) {
+    const Slab* slab = slab_of(ptr);
+
+    size_t index = slab_object_index(slab, ptr);
+    if (index == BITMAP_NOT_FOUND || bitmap_test_fast(&slab->free_map, index)) {
+        return 0;
+    }
+    return slab->object_size;
+}
@@ -9,13 +9,31 @@
 const char* test_compiled[] = {
     "test/test_bitmap",
     "test/test_buddy_allocator",
-    "test/test_my_malloc"
+    "test/test_pool_arena",
+    "test/test_slab",
+    "test/test_large_cache",
+    "test/test_malloc_stats",
+    "test/test_malloc_trace",
+    "test/test_heap",
+    "test/test_bump_arena",
+    "test/test_huge_pages",
+    "test/test_my_malloc",
+    "test/test_malloc_interpose"
 };
 
 const char* test_descriptions[] = {
     "Bitmap functionality",
     "Buddy allocator",
-    "Main malloc implementation"
+    "Pool arenas",
+    "Slab allocator",
+    "Large mapping cache",
+    "Allocation statistics",
+    "Allocation trace",
+    "Heaps",
+    "Bump arenas",
+    "Huge pages",
+    "Main malloc implementation",
+    "libc malloc interposition"
 };
 
 int run_single_test(const char* compiled, const char* description) {
@@ -52,7 +70,7 @@ int main() {
     DEBUG_PRINTF("Running all tests for pseudo-malloc\n");
     DEBUG_PRINTF("===================================\n");
 
-    int total_tests = 3;
+    int total_tests = sizeof(test_compiled) / sizeof(test_compiled[0]);
     int passed = 0;
     int failed = 0;
     int errors = 0;
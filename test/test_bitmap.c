@@ -82,12 +82,54 @@ void test_edge_cases() {
 
 }
 
+void test_bulk_operations() {
+    DEBUG_PRINTF("\nTesting word at a time operations...\n");
+
+    // Big enough to go through the vector kernels, not a multiple of 64
+    size_t size = 1000;
+    Bitmap* bmp = bitmap_init(size);
+    check(bmp != NULL, "bitmap for bulk operations created");
+
+    check(bitmap_find_first_set(bmp, 0, size) == BITMAP_NOT_FOUND, "empty bitmap has no set bit");
+    check(bitmap_find_first_zero(bmp, 0, size) == 0, "first zero of an empty bitmap is bit 0");
+    check(bitmap_range_all_zero(bmp, 0, size), "empty bitmap is all zero");
+
+    // Set a range crossing several words and check it from every side
+    bitmap_set_range(bmp, 70, 900);
+    check(bitmap_test(bmp, 69) == 0 && bitmap_test(bmp, 70) == 1, "set range starts at the right bit");
+    check(bitmap_test(bmp, 899) == 1 && bitmap_test(bmp, 900) == 0, "set range ends at the right bit");
+    check(bitmap_popcount(bmp, 0, size) == 830, "popcount counts the whole range");
+    check(bitmap_popcount(bmp, 100, 164) == 64, "popcount of one aligned word");
+    check(bitmap_find_first_set(bmp, 0, size) == 70, "first set bit found");
+    check(bitmap_find_first_set(bmp, 500, size) == 500, "first set bit found from a start inside the range");
+    check(bitmap_find_first_zero(bmp, 70, size) == 900, "first zero after a long run of ones");
+    check(bitmap_range_all_zero(bmp, 0, 70), "range before the set bits is all zero");
+    check(!bitmap_range_all_zero(bmp, 0, 71), "range touching a set bit is not all zero");
+
+    // Punch a hole and look for it
+    bitmap_clear_range(bmp, 600, 602);
+    check(bitmap_find_first_zero(bmp, 70, size) == 600, "first zero finds the hole");
+    check(bitmap_popcount(bmp, 0, size) == 828, "popcount after clearing two bits");
+
+    // Ranges are clamped to the bitmap size
+    bitmap_set_range(bmp, 990, 5000);
+    check(bitmap_test(bmp, 999) == 1, "set range clamped to the last bit");
+    check(bitmap_find_first_zero(bmp, 990, 5000) == BITMAP_NOT_FOUND, "no zero left at the end");
+
+    // A single bit lookup inside one word
+    check(bitmap_find_first_set(bmp, 601, 602) == BITMAP_NOT_FOUND, "cleared bit inside one word");
+    check(bitmap_toggle(bmp, 601) == 1, "toggle returns the new value");
+
+    bitmap_free(bmp);
+}
+
 int main() {
 
     DEBUG_PRINTF("Running bitmap tests...\n");
     
     // test_basic_stuff();
     // test_edge_cases();
+    test_bulk_operations();
 
     DEBUG_PRINTF("\nResults: %d passed, %d failed\n", passed, failed);
     
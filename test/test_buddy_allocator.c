@@ -1,6 +1,9 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "../include/buddy_allocator.h"
 #include "../include/debug_print.h"
 
@@ -21,9 +24,7 @@ void check(int condition, const char* msg) {
 
 void cleanup_allocator(BuddyAllocator* allocator) {
     if (allocator) {
-        if (allocator->allocation_bitmap) bitmap_free(allocator->allocation_bitmap);
-        if (allocator->memory_pool) free(allocator->memory_pool);
-        free(allocator);
+        BuddyAllocator_destroy(allocator); // Created by BuddyAllocator_init(NULL): the struct goes with the pool
     }
 }
 
@@ -35,7 +36,7 @@ void test_initialization() {
 
     check(allocator != NULL, "allocator created successfully");
     check(allocator->memory_pool != NULL, "memory pool is allocated");
-    check(allocator->allocation_bitmap != NULL, "bitmap is set up");
+    check(allocator->allocation_bitmap.bits != NULL, "bitmap is set up");
 
     cleanup_allocator(allocator);
 
@@ -146,6 +147,399 @@ void test_edge_cases() {
     
 }
 
+void test_coalescing() {
+    DEBUG_PRINTF("\n--- Testing split and coalesce ---\n");
+
+    BuddyAllocator* allocator = BuddyAllocator_init(NULL);
+    if (!allocator) return;
+
+    // Tree metadata is sized from the number of levels, not from the pool size
+    check(allocator->split_bitmap.size == BUDDY_INTERNAL_NODES, "split bitmap has one bit per internal node");
+    check(allocator->allocation_bitmap.size == BUDDY_INTERNAL_NODES, "allocation bitmap has one bit per buddy pair");
+
+    // Fill the whole pool with minimum size blocks
+    int blocks_count = MAX_BLOCK_SIZE / MIN_BLOCK_SIZE;
+    void** blocks = malloc(blocks_count * sizeof(void*));
+    int successful_allocs = 0;
+
+    for (int i = 0; i < blocks_count; i++) {
+        blocks[i] = BuddyAllocator_malloc(allocator, MIN_BLOCK_SIZE);
+        if (blocks[i] != NULL) {
+            successful_allocs++;
+        }
+    }
+
+    check(successful_allocs == blocks_count, "whole pool split into minimum size blocks");
+    check(BuddyAllocator_malloc(allocator, MIN_BLOCK_SIZE) == NULL, "no block left once the pool is full");
+
+    // Free them in an interleaved order so that merges happen at every level
+    for (int i = 0; i < blocks_count; i += 2) {
+        BuddyAllocator_free(allocator, blocks[i]);
+    }
+    for (int i = 1; i < blocks_count; i += 2) {
+        BuddyAllocator_free(allocator, blocks[i]);
+    }
+
+    // Everything merged back: the whole pool must be available as one block
+    void* whole_pool = BuddyAllocator_malloc(allocator, MAX_BLOCK_SIZE);
+    check(whole_pool == allocator->memory_pool, "freed blocks coalesced back into the whole pool");
+    BuddyAllocator_free(allocator, whole_pool);
+
+    // Freeing a block whose buddy is still in use must not merge them
+    void* first = BuddyAllocator_malloc(allocator, 128);
+    void* second = BuddyAllocator_malloc(allocator, 128);
+    check(second == (char*)first + 128, "second block is the buddy of the first one");
+    BuddyAllocator_free(allocator, first);
+    check(BuddyAllocator_malloc(allocator, 256) != first, "block is not merged with a buddy in use");
+
+    free(blocks);
+    cleanup_allocator(allocator);
+
+}
+
+void test_placement() {
+    DEBUG_PRINTF("\n--- Testing placement of small blocks ---\n");
+
+    BuddyAllocator* allocator = BuddyAllocator_init(NULL);
+    if (!allocator) return;
+
+    void* large_block = BuddyAllocator_malloc(allocator, 512);
+    void* small_block = BuddyAllocator_malloc(allocator, 128);
+    BuddyAllocator_free(allocator, large_block);
+
+    // The low end of the pool is filled first, so the freed 512 bytes block is split
+    // for the next small request instead of taking the block right after small_block
+    void* small_block2 = BuddyAllocator_malloc(allocator, 128);
+    check(small_block2 < small_block, "second small block is before first small block");
+
+    BuddyAllocator_free(allocator, small_block);
+    BuddyAllocator_free(allocator, small_block2);
+
+    cleanup_allocator(allocator);
+}
+
+void test_level_tags() {
+    DEBUG_PRINTF("\n--- Testing level tags ---\n");
+
+    BuddyAllocator* allocator = BuddyAllocator_init(NULL);
+    if (!allocator) return;
+
+    // Every size is found back from the tag of its first unit
+    size_t sizes[] = {MIN_BLOCK_SIZE, 100, 4096, 100000, MAX_BLOCK_SIZE / 2};
+    size_t expected[] = {MIN_BLOCK_SIZE, 128, 4096, 131072, MAX_BLOCK_SIZE / 2};
+    void* blocks[5];
+    int sizes_ok = 1;
+    for (int i = 0; i < 5; i++) {
+        blocks[i] = BuddyAllocator_malloc(allocator, sizes[i]);
+        if (!blocks[i] || ((uintptr_t)blocks[i] % MIN_BLOCK_SIZE) != 0 ||
+            BuddyAllocator_block_size(allocator, blocks[i]) != expected[i]) {
+            sizes_ok = 0;
+        }
+    }
+    check(sizes_ok, "block sizes read back from the level tags, blocks are MIN_BLOCK_SIZE aligned");
+
+    check(BuddyAllocator_block_size(allocator, (char*)blocks[2] + 64) == 0, "pointer inside a block is not a block");
+    check(BuddyAllocator_block_size(allocator, (char*)blocks[0] + 8) == 0, "misaligned pointer is not a block");
+
+    // A freed block loses its tag, so a second free is rejected
+    BuddyAllocator_free(allocator, blocks[1]);
+    check(BuddyAllocator_block_size(allocator, blocks[1]) == 0, "freed block has no tag");
+    BuddyAllocator_free(allocator, blocks[1]);
+
+    // Metabuddy blocks are tagged too
+    void* meta = BuddyAllocator_malloc_metabuddy(allocator, 120);
+    check(BuddyAllocator_block_size(allocator, (char*)meta - sizeof(size_t)) == 128, "metabuddy block is tagged");
+    BuddyAllocator_free_metabuddy(allocator, meta);
+    BuddyAllocator_free_metabuddy(allocator, meta);
+
+    for (int i = 0; i < 5; i++) {
+        if (i != 1) {
+            BuddyAllocator_free(allocator, blocks[i]);
+        }
+    }
+    check(BuddyAllocator_is_empty(allocator), "pool whole again after the double frees were rejected");
+
+    cleanup_allocator(allocator);
+}
+
+void test_resize() {
+    DEBUG_PRINTF("\n--- Testing in place resize ---\n");
+
+    BuddyAllocator* allocator = BuddyAllocator_init(NULL);
+    if (!allocator) return;
+
+    char* block = BuddyAllocator_malloc(allocator, 128);
+    memset(block, 0x3C, 128);
+
+    // The buddies above the block are free: it grows by merging them
+    check(BuddyAllocator_resize(allocator, block, 1000), "block grows in place");
+    check(BuddyAllocator_block_size(allocator, block) == 1024, "grown block has the size of the request");
+    check(block[0] == 0x3C && block[127] == 0x3C, "grown block keeps its data");
+
+    // A block taken right after it blocks any further growth
+    void* neighbour = BuddyAllocator_malloc(allocator, 1024);
+    check(neighbour == block + 1024, "next block follows the grown one");
+    check(!BuddyAllocator_resize(allocator, block, 2048), "block with an allocated buddy cannot grow");
+    check(BuddyAllocator_block_size(allocator, block) == 1024, "failed resize leaves the block as it was");
+
+    // Shrinking gives the upper halves back, where the next allocation lands
+    check(BuddyAllocator_resize(allocator, block, 200), "block shrinks in place");
+    check(BuddyAllocator_block_size(allocator, block) == 256, "shrunk block has the size of the request");
+    void* freed_half = BuddyAllocator_malloc(allocator, 512);
+    check(freed_half == block + 512, "upper half given back by the shrink is reused");
+
+    // A block that is not the lower half of its parent cannot grow
+    check(!BuddyAllocator_resize(allocator, freed_half, 1024), "upper buddy cannot grow");
+
+    BuddyAllocator_free(allocator, freed_half);
+    BuddyAllocator_free(allocator, neighbour);
+    BuddyAllocator_free(allocator, block);
+    check(BuddyAllocator_is_empty(allocator), "pool whole again after resizes");
+
+    cleanup_allocator(allocator);
+}
+
+void test_self_hosted() {
+    DEBUG_PRINTF("\n--- Testing self-hosted initialization ---\n");
+
+    BuddyAllocator* first = BuddyAllocator_init(NULL);
+    BuddyAllocator* second = BuddyAllocator_init(NULL);
+    check(first && second, "allocators created without libc malloc");
+    if (!first || !second) return;
+
+    check((char*)first == (char*)first->memory_pool + BUDDY_REGION_SIZE, "struct lives right after the pool metadata");
+    check(((uintptr_t)first->memory_pool & (MAX_BLOCK_SIZE - 1)) == 0 &&
+          ((uintptr_t)second->memory_pool & (MAX_BLOCK_SIZE - 1)) == 0, "pools are aligned to their size");
+
+    void* block = BuddyAllocator_malloc(second, MAX_BLOCK_SIZE);
+    check(block == second->memory_pool, "whole pool available");
+    BuddyAllocator_free(second, block);
+
+    cleanup_allocator(first);
+    cleanup_allocator(second);
+}
+
+void test_occupancy() {
+    DEBUG_PRINTF("\n--- Testing occupancy ---\n");
+
+    BuddyAllocator* allocator = BuddyAllocator_init(NULL);
+    if (!allocator) return;
+
+    BuddyOccupancy occupancy;
+    BuddyAllocator_occupancy(allocator, &occupancy);
+    check(occupancy.free_blocks[0] == 1 && occupancy.free_bytes == MAX_BLOCK_SIZE, "empty pool is one free block");
+    check(occupancy.largest_free_block == MAX_BLOCK_SIZE, "largest free block of an empty pool is the pool");
+
+    // Every other sixteenth of the pool (64 KB): half the pool free, but no free block larger than that
+    size_t sixteenth = MAX_BLOCK_SIZE / 16;
+    void* blocks[16];
+    for (int i = 0; i < 16; i++) {
+        blocks[i] = BuddyAllocator_malloc(allocator, sixteenth);
+    }
+    for (int i = 1; i < 16; i += 2) {
+        BuddyAllocator_free(allocator, blocks[i]);
+    }
+    void* small = BuddyAllocator_malloc(allocator, 100);
+
+    BuddyAllocator_occupancy(allocator, &occupancy);
+    int level_sixteenth = 4;
+    int level_128 = BUDDY_POOL_ORDER - 7;
+    check(occupancy.used_blocks[level_sixteenth] == 8 && occupancy.used_blocks[level_128] == 1, "allocated blocks by level");
+    check(occupancy.free_blocks[level_sixteenth] == 7, "free blocks by level");
+    check(occupancy.used_bytes == 8 * sixteenth + 128 && occupancy.used_bytes + occupancy.free_bytes == MAX_BLOCK_SIZE,
+          "free and used bytes cover the pool");
+    check(occupancy.largest_free_block == sixteenth, "fragmented pool: largest free block is a sixteenth of the pool");
+
+    char map[17];
+    check(BuddyAllocator_occupancy_map(allocator, map, 16) == 16, "map of 16 cells");
+    int used_cells = 0, partial_cells = 0, free_cells = 0;
+    for (int i = 0; i < 16; i++) {
+        used_cells += map[i] == '#';
+        partial_cells += map[i] == '+';
+        free_cells += map[i] == '.';
+    }
+    check(map[0] == '#' && used_cells == 8 && partial_cells == 1 && free_cells == 7,
+          "map shows the used, partly used and free cells");
+    check(BuddyAllocator_occupancy_map(allocator, map, 12) == 0, "cell count must be a power of two");
+
+    // Blocks spanning several cells
+    char fine_map[65];
+    BuddyAllocator_occupancy_map(allocator, fine_map, 64);
+    used_cells = partial_cells = free_cells = 0;
+    for (int i = 0; i < 64; i++) {
+        used_cells += fine_map[i] == '#';
+        partial_cells += fine_map[i] == '+';
+        free_cells += fine_map[i] == '.';
+    }
+    check(strncmp(fine_map, "####", 4) == 0 && used_cells == 32 && partial_cells == 1 && free_cells == 31,
+          "a block larger than a cell fills each of its cells");
+
+    BuddyAllocator_free(allocator, small);
+    for (int i = 0; i < 16; i += 2) {
+        BuddyAllocator_free(allocator, blocks[i]);
+    }
+    BuddyAllocator_occupancy(allocator, &occupancy);
+    check(occupancy.free_blocks[0] == 1 && occupancy.used_bytes == 0, "pool whole again");
+
+    cleanup_allocator(allocator);
+}
+
+void test_batch() {
+    DEBUG_PRINTF("\n--- Testing batch allocation and free ---\n");
+
+    BuddyAllocator* allocator = BuddyAllocator_init(NULL);
+    if (!allocator) return;
+
+    // 100 = 64 + 32 + 4 blocks: three spans carved whole, one after the other
+    void* blocks[100];
+    check(BuddyAllocator_malloc_batch(allocator, 100, 100, blocks) == 100, "batch of 100 blocks allocated");
+    int distinct = 1;
+    for (int i = 0; i < 100; i++) {
+        if (BuddyAllocator_block_size(allocator, blocks[i]) != 128 || (i && blocks[i] != (char*)blocks[i - 1] + 128)) {
+            distinct = 0;
+        }
+    }
+    check(distinct, "blocks of the batch are allocated and contiguous");
+    check(BuddyAllocator_malloc(allocator, 128) == (char*)blocks[99] + 128, "next single block follows the batch");
+    BuddyAllocator_free(allocator, (char*)blocks[99] + 128);
+
+    BuddyOccupancy occupancy;
+    BuddyAllocator_occupancy(allocator, &occupancy);
+    check(occupancy.used_bytes == 100 * 128, "occupancy counts the carved blocks");
+
+    // Reversed and with holes: the free sorts them, NULL and double frees are skipped
+    void* reversed[103];
+    for (int i = 0; i < 100; i++) {
+        reversed[i] = blocks[99 - i];
+    }
+    reversed[100] = NULL;
+    reversed[101] = blocks[7];
+    reversed[102] = blocks[64];
+    BuddyAllocator_free_batch(allocator, reversed, 103);
+    int sorted = 1;
+    for (int i = 1; i < 103; i++) {
+        if ((uintptr_t)reversed[i - 1] > (uintptr_t)reversed[i]) {
+            sorted = 0;
+        }
+    }
+    check(sorted, "pointers sorted in place");
+    check(BuddyAllocator_is_empty(allocator), "batch free coalesced back into the whole pool");
+
+    // A pool of minimum size blocks in one call, then only part of it back
+    size_t units = MAX_BLOCK_SIZE / MIN_BLOCK_SIZE;
+    void** all = malloc(units * sizeof(void*));
+    check(BuddyAllocator_malloc_batch(allocator, MIN_BLOCK_SIZE, units + 5, all) == units, "batch stops when the pool is full");
+    BuddyAllocator_free_batch(allocator, all + 1, units / 2 - 1);
+    check(BuddyAllocator_malloc(allocator, MAX_BLOCK_SIZE / 4) == (char*)allocator->memory_pool + MAX_BLOCK_SIZE / 4,
+          "freed run merged into larger blocks next to a block in use");
+    BuddyAllocator_free(allocator, (char*)allocator->memory_pool + MAX_BLOCK_SIZE / 4);
+    BuddyAllocator_free_batch(allocator, all, 1);
+    BuddyAllocator_free_batch(allocator, all + units / 2, units / 2);
+    check(BuddyAllocator_is_empty(allocator), "pool whole again");
+
+    free(all);
+    cleanup_allocator(allocator);
+}
+
+// Pages of the pool from offset on that are mapped in (written at least once)
+size_t resident_pages(const BuddyAllocator* allocator, size_t offset) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t pages = MAX_BLOCK_SIZE / page;
+    unsigned char* vector = malloc(pages);
+    size_t resident = 0;
+    if (mincore(allocator->memory_pool, MAX_BLOCK_SIZE, vector) == 0) {
+        for (size_t i = offset / page; i < pages; i++) {
+            resident += vector[i] & 1;
+        }
+    }
+    free(vector);
+    return resident;
+}
+
+void test_untouched_pages() {
+    DEBUG_PRINTF("\n--- Testing untouched pages ---\n");
+
+    BuddyAllocator* allocator = BuddyAllocator_init(NULL);
+    if (!allocator) return;
+
+    check(resident_pages(allocator, 0) == 0, "fresh pool has no page mapped in");
+
+    // Splitting the pool down to small blocks leaves the freed upper halves untouched
+    void* blocks[64];
+    size_t handed_out = 0;
+    for (int i = 0; i < 64; i++) {
+        size_t size = 100 + i * 7 % 300;
+        blocks[i] = BuddyAllocator_malloc(allocator, size);
+        size_t end = (size_t)((char*)blocks[i] - (char*)allocator->memory_pool) + BuddyAllocator_block_size(allocator, blocks[i]);
+        handed_out = end > handed_out ? end : handed_out;
+    }
+    // Only free blocks left behind below the others get a header written
+    check(resident_pages(allocator, 0) < handed_out / (size_t)sysconf(_SC_PAGESIZE) && resident_pages(allocator, handed_out) == 0,
+          "allocating small blocks touches fewer pages than they span, and none past them");
+
+    void* large = BuddyAllocator_malloc(allocator, MAX_BLOCK_SIZE / 4);
+    size_t large_end = (size_t)((char*)large - (char*)allocator->memory_pool) + MAX_BLOCK_SIZE / 4;
+    memset(blocks[0], 1, 100);
+    check(resident_pages(allocator, large_end) == 0, "no page past the blocks handed out is mapped in");
+
+    for (int i = 0; i < 64; i += 2) {
+        BuddyAllocator_free(allocator, blocks[i]);
+    }
+    BuddyAllocator_free(allocator, large);
+    for (int i = 1; i < 64; i += 2) {
+        BuddyAllocator_free(allocator, blocks[i]);
+    }
+    check(BuddyAllocator_is_empty(allocator), "untouched blocks merge back into the whole pool");
+    void* whole = BuddyAllocator_malloc(allocator, MAX_BLOCK_SIZE);
+    check(whole == allocator->memory_pool, "whole pool available again");
+    BuddyAllocator_free(allocator, whole);
+
+    cleanup_allocator(allocator);
+}
+
+void test_purge() {
+    DEBUG_PRINTF("\n--- Testing purge ---\n");
+
+    BuddyAllocator* allocator = BuddyAllocator_init(NULL);
+    if (!allocator) return;
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t quarter = MAX_BLOCK_SIZE / 4;
+    char* quarters[4];
+    for (int i = 0; i < 4; i++) {
+        quarters[i] = BuddyAllocator_malloc(allocator, quarter);
+        memset(quarters[i], 0x33, quarter);
+    }
+    check(resident_pages(allocator, 0) == MAX_BLOCK_SIZE / page, "written pool is resident");
+
+    // The upper two quarters merge into a free half
+    BuddyAllocator_free(allocator, quarters[2]);
+    BuddyAllocator_free(allocator, quarters[3]);
+    check(BuddyAllocator_purge(allocator, 0) == MAX_BLOCK_SIZE / 2 - page, "free half given back but its first page");
+    check(resident_pages(allocator, MAX_BLOCK_SIZE / 2) == 1, "only the page with the links stays resident");
+    check(BuddyAllocator_purge(allocator, 0) == 0, "purged block not purged again");
+
+    char* half = BuddyAllocator_malloc(allocator, MAX_BLOCK_SIZE / 2);
+    check(half == quarters[2] && half[page] == 0 && half[MAX_BLOCK_SIZE / 2 - 1] == 0, "purged block handed out again, zero");
+
+    BuddyAllocator_free(allocator, half);
+    BuddyAllocator_free(allocator, quarters[0]);
+    BuddyAllocator_free(allocator, quarters[1]);
+    check(BuddyAllocator_is_empty(allocator), "pool whole again");
+    check(BuddyAllocator_purge(allocator, 0) == MAX_BLOCK_SIZE - page, "merged block purged as a new one");
+    check(resident_pages(allocator, 0) == 1, "empty pool purged down to one page");
+
+    // Split for a small block and merged back: only the headers written on the way are new
+    char* small = BuddyAllocator_malloc(allocator, 64);
+    memset(small, 0x44, 64);
+    BuddyAllocator_free(allocator, small);
+    size_t resident = resident_pages(allocator, 0);
+    check(resident > 1 && BuddyAllocator_purge(allocator, 0) == (resident - 1) * page, "only pages written again are purged");
+    check(resident_pages(allocator, 0) == 1, "pool back to one page");
+
+    cleanup_allocator(allocator);
+}
+
 /* Metabuddy tests */
 
 void test_initialization_metabuddy() {
@@ -156,7 +550,7 @@ void test_initialization_metabuddy() {
 
     check(allocator != NULL, "allocator created successfully");
     check(allocator->memory_pool != NULL, "memory pool is allocated");
-    check(allocator->allocation_bitmap != NULL, "bitmap is set up");
+    check(allocator->allocation_bitmap.bits != NULL, "bitmap is set up");
 
     cleanup_allocator(allocator);
 
@@ -283,6 +677,16 @@ int main() {
     test_allocation_patterns_metabuddy();
     test_edge_cases_metabuddy();
     */
+
+    test_coalescing();
+    test_placement();
+    test_level_tags();
+    test_resize();
+    test_self_hosted();
+    test_occupancy();
+    test_batch();
+    test_untouched_pages();
+    test_purge();
     
     DEBUG_PRINTF("\nResults: %d passed, %d failed\n", passed, failed);
     
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/my_malloc.h"
+#include "../include/bump_arena.h"
+#include "../include/malloc_stats.h"
+#include "../include/debug_print.h"
+
+// Testing the bump arenas
+
+int passed = 0;
+int failed = 0;
+
+void check(int condition, const char* msg) {
+    if (condition) {
+        DEBUG_PRINTF("✓ %s\n", msg);
+        passed++;
+    } else {
+        DEBUG_PRINTF("✗ %s\n", msg);
+        failed++;
+    }
+}
+
+void test_bump() {
+    DEBUG_PRINTF("\n--- Testing bump allocation ---\n");
+
+    BumpArena* arena = arena_create(0);
+    check(arena != NULL, "arena created");
+    check(arena_footprint(arena) == BUMP_CHUNK_SIZE, "one chunk to begin with");
+
+    char* first = arena_alloc(arena, 10);
+    char* second = arena_alloc(arena, 10);
+    check(first && second == first + MALLOC_ALIGNMENT, "objects follow each other, 16 bytes aligned");
+    check(arena_alloc(arena, 0) == NULL, "0 bytes gives NULL");
+
+    // Many more objects than a chunk holds
+    int ok = 1;
+    char* objects[4000];
+    for (int i = 0; i < 4000; i++) {
+        objects[i] = arena_alloc(arena, 40);
+        if (!objects[i] || (uintptr_t)objects[i] % MALLOC_ALIGNMENT != 0) {
+            ok = 0;
+            continue;
+        }
+        memset(objects[i], i & 0xFF, 40);
+    }
+    check(ok, "objects allocated across chunks");
+    int intact = 1;
+    for (int i = 0; i < 4000; i++) {
+        if (objects[i][0] != (char)(i & 0xFF) || objects[i][39] != (char)(i & 0xFF)) {
+            intact = 0;
+        }
+    }
+    check(intact, "objects do not overlap");
+    check(arena_footprint(arena) >= 3 * BUMP_CHUNK_SIZE, "arena grew by whole chunks");
+
+    arena_reset(arena);
+    check(arena_footprint(arena) == BUMP_CHUNK_SIZE, "reset gives back every chunk but the first");
+    check(arena_alloc(arena, 10) == first, "first chunk reused after reset");
+
+    arena_destroy(arena);
+}
+
+void test_large_objects() {
+    DEBUG_PRINTF("\n--- Testing large objects ---\n");
+
+    BumpArena* arena = arena_create(4096);
+    char* half = arena_alloc(arena, 2048);
+    char* large = arena_alloc(arena, 3000); // No longer fits in the chunk
+    char* after = arena_alloc(arena, 64);
+    check(large != NULL && after == half + 2048, "large object gets a chunk of its own, the current one stays in use");
+    memset(large, 0x5A, 3000);
+
+    char* huge = arena_alloc(arena, 2 * MID_THRESHOLD);
+    check(huge != NULL, "object beyond MID_THRESHOLD from a mapped chunk");
+    memset(huge, 0x5A, 2 * MID_THRESHOLD);
+    check(arena_footprint(arena) >= 4096 + 3000 + 2 * MID_THRESHOLD, "footprint counts the large chunks");
+
+    arena_destroy(arena);
+}
+
+void test_chunks_returned() {
+    DEBUG_PRINTF("\n--- Testing chunks given back ---\n");
+
+    MallocStats before, after;
+    my_malloc_stats(&before);
+
+    BumpArena* arena = arena_create(0);
+    for (int round = 0; round < 10; round++) {
+        for (int i = 0; i < 10000; i++) {
+            arena_alloc(arena, 24 + i % 100);
+        }
+        arena_reset(arena);
+    }
+    arena_destroy(arena);
+
+    my_malloc_stats(&after);
+    check(after.bytes_in_use == before.bytes_in_use, "every chunk back after destroy");
+    size_t mallocs = 0;
+    for (int level = 0; level < MAX_LEVELS; level++) {
+        mallocs += after.buddy_mallocs[level] - before.buddy_mallocs[level];
+    }
+    check(mallocs < 10 * 10000 / 100, "chunks taken, not objects");
+}
+
+int main() {
+
+    DEBUG_PRINTF("Running bump arena tests...\n");
+
+    test_bump();
+    test_large_objects();
+    test_chunks_returned();
+
+    DEBUG_PRINTF("\nResults: %d passed, %d failed\n", passed, failed);
+
+    if (failed == 0) {
+        DEBUG_PRINTF("All tests passed! 🎉\n");
+        return 0;
+    } else {
+        DEBUG_PRINTF("Some tests failed 😞\n");
+        return 1;
+    }
+
+}
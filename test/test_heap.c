@@ -0,0 +1,261 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../include/my_malloc.h"
+#include "../include/heap.h"
+#include "../include/pool_arena.h"
+#include "../include/debug_print.h"
+
+// Testing the heaps
+
+int passed = 0;
+int failed = 0;
+
+void check(int condition, const char* msg) {
+    if (condition) {
+        DEBUG_PRINTF("✓ %s\n", msg);
+        passed++;
+    } else {
+        DEBUG_PRINTF("✗ %s\n", msg);
+        failed++;
+    }
+}
+
+void test_tiers() {
+    DEBUG_PRINTF("\n--- Testing blocks of every size ---\n");
+
+    Heap* heap = heap_create(NULL);
+    check(heap != NULL, "heap created");
+
+    size_t sizes[] = {8, 40, 100, 900, 4000, 64 * 1024, MID_THRESHOLD, 3 * MID_THRESHOLD};
+    size_t count = sizeof(sizes) / sizeof(sizes[0]);
+    void* blocks[sizeof(sizes) / sizeof(sizes[0])];
+    int all_ok = 1;
+    for (size_t i = 0; i < count; i++) {
+        blocks[i] = heap_malloc(heap, sizes[i]);
+        if (!blocks[i] || (sizes[i] >= MALLOC_ALIGNMENT && (uintptr_t)blocks[i] % MALLOC_ALIGNMENT != 0)) {
+            all_ok = 0;
+            continue;
+        }
+        memset(blocks[i], (int)i + 1, sizes[i]);
+    }
+    check(all_ok, "slab, small, mid and large blocks allocated and aligned");
+
+    int intact = 1;
+    for (size_t i = 0; i < count; i++) {
+        unsigned char* bytes = blocks[i];
+        if (bytes && (bytes[0] != i + 1 || bytes[sizes[i] - 1] != i + 1)) {
+            intact = 0;
+        }
+    }
+    check(intact, "blocks do not overlap");
+
+    BuddyPool* pool = pool_arena_lookup(blocks[2]);
+    check(pool && pool->arena != pool_arena_for_thread(), "pools of the heap are not in a shared arena");
+
+    HeapStats stats;
+    heap_stats(heap, &stats);
+    check(stats.mallocs == count && stats.frees == 0, "mallocs counted");
+    check(stats.bytes_in_use >= 8 + 40 + 100 + 900 + 4000 + 64 * 1024 + 4 * MID_THRESHOLD, "bytes in use counted");
+    check(stats.bytes_mapped >= 2 * BUDDY_POOL_SIZE && stats.peak_mapped >= stats.bytes_mapped, "mapped bytes counted");
+
+    for (size_t i = 0; i < count; i++) {
+        heap_free(heap, blocks[i]);
+    }
+    heap_stats(heap, &stats);
+    check(stats.frees == count && stats.bytes_in_use == 0, "frees counted");
+    check(stats.bytes_mapped < stats.peak_mapped, "large blocks unmapped on free");
+
+    heap_destroy(heap);
+}
+
+void test_isolation() {
+    DEBUG_PRINTF("\n--- Testing isolation ---\n");
+
+    Heap* first = heap_create(NULL);
+    Heap* second = heap_create(NULL);
+    void* a = heap_malloc(first, 200);
+    void* b = heap_malloc(second, 200);
+    void* c = my_malloc(200);
+    BuddyPool* pool_a = pool_arena_lookup(a);
+    BuddyPool* pool_b = pool_arena_lookup(b);
+    BuddyPool* pool_c = pool_arena_lookup(c);
+    check(pool_a && pool_b && pool_c, "blocks come from pools");
+    check(pool_a != pool_b && pool_a->arena != pool_b->arena, "heaps do not share pools");
+    check(pool_a->arena != pool_c->arena && pool_b->arena != pool_c->arena, "heaps do not share pools with my_malloc");
+
+    heap_free(second, a);
+    HeapStats stats;
+    heap_stats(second, &stats);
+    check(stats.frees == 0, "block of another heap refused");
+
+    heap_free(first, a);
+    heap_free(second, b);
+    my_free(c);
+    heap_destroy(first);
+    heap_destroy(second);
+}
+
+void test_limit() {
+    DEBUG_PRINTF("\n--- Testing limits ---\n");
+
+    HeapConfig config = {.limit = BUDDY_POOL_SIZE + 4 * MID_THRESHOLD};
+    Heap* heap = heap_create(&config);
+
+    void* small = heap_malloc(heap, 100);
+    check(small != NULL, "first pool fits the limit");
+    void* mid = heap_malloc(heap, 2000);
+    check(mid == NULL, "second pool refused past the limit");
+
+    void* large = heap_malloc(heap, 2 * MID_THRESHOLD);
+    check(large != NULL, "large block fits the limit");
+    void* too_large = heap_malloc(heap, 2 * MID_THRESHOLD);
+    check(too_large == NULL, "large block refused past the limit");
+
+    HeapStats stats;
+    heap_stats(heap, &stats);
+    check(stats.failed_mallocs == 2, "refused mallocs counted");
+    check(stats.bytes_mapped <= config.limit, "mapped bytes within the limit");
+
+    heap_free(heap, large);
+    too_large = heap_malloc(heap, 2 * MID_THRESHOLD);
+    check(too_large != NULL, "room given back by a free is usable again");
+
+    heap_free(heap, too_large);
+    heap_free(heap, small);
+    heap_destroy(heap);
+}
+
+void test_destroy() {
+    DEBUG_PRINTF("\n--- Testing destroy ---\n");
+
+    Heap* heap = heap_create(NULL);
+    void* blocks[256];
+    for (int i = 0; i < 256; i++) {
+        blocks[i] = heap_malloc(heap, (size_t)(i % 8 + 1) * 600);
+    }
+    void* tiny = heap_malloc(heap, 16);
+    void* large = heap_malloc(heap, 4 * MID_THRESHOLD);
+    check(blocks[255] && tiny && large, "blocks allocated");
+    check(pool_arena_lookup(blocks[0]) && pool_arena_lookup(tiny), "pools registered");
+
+    // Nothing freed: destroy takes everything down at once
+    heap_destroy(heap);
+    check(pool_arena_lookup(blocks[0]) == NULL && pool_arena_lookup(tiny) == NULL, "pools gone after destroy");
+
+    void* ptr = my_malloc(100);
+    check(ptr != NULL, "my_malloc unaffected");
+    my_free(ptr);
+}
+
+typedef struct {
+    Heap* heap;
+    int ok;
+} WorkerArgs;
+
+void* heap_worker(void* arg) {
+    WorkerArgs* args = arg;
+    void* blocks[64];
+    args->ok = 1;
+    for (int round = 0; round < 100; round++) {
+        for (int i = 0; i < 64; i++) {
+            blocks[i] = heap_malloc(args->heap, (size_t)(i * 37 % 3000 + 1));
+            if (!blocks[i]) {
+                args->ok = 0;
+            }
+        }
+        for (int i = 0; i < 64; i++) {
+            heap_free(args->heap, blocks[i]);
+        }
+    }
+    return NULL;
+}
+
+void test_threads() {
+    DEBUG_PRINTF("\n--- Testing a heap shared by threads ---\n");
+
+    Heap* heap = heap_create(NULL);
+    pthread_t threads[4];
+    WorkerArgs args[4];
+    for (int i = 0; i < 4; i++) {
+        args[i].heap = heap;
+        pthread_create(&threads[i], NULL, heap_worker, &args[i]);
+    }
+    int ok = 1;
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+        ok &= args[i].ok;
+    }
+    check(ok, "threads allocate from one heap");
+
+    HeapStats stats;
+    heap_stats(heap, &stats);
+    check(stats.mallocs == 4 * 100 * 64 && stats.frees == stats.mallocs && stats.bytes_in_use == 0,
+          "statistics consistent across threads");
+    heap_destroy(heap);
+}
+
+static int stop_churn = 0;
+
+// Creates and destroys heap pools until told to stop: the global pool locks are taken all along
+static void* heap_churn(void* arg) {
+    (void)arg;
+    while (!__atomic_load_n(&stop_churn, __ATOMIC_RELAXED)) {
+        Heap* heap = heap_create(NULL);
+        heap_free(heap, heap_malloc(heap, 100));
+        heap_destroy(heap);
+    }
+    return NULL;
+}
+
+void test_fork() {
+    DEBUG_PRINTF("\n--- Testing fork while a heap maps pools ---\n");
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, heap_churn, NULL);
+    int ok = 1;
+    for (int i = 0; i < 200 && ok; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            // A lock left held by the churning thread would hang the child: killed by the alarm
+            alarm(10);
+            Heap* heap = heap_create(NULL);
+            void* block = heap_malloc(heap, 100);
+            heap_destroy(heap);
+            _exit(block ? 0 : 1);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        ok = pid > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    __atomic_store_n(&stop_churn, 1, __ATOMIC_RELAXED);
+    pthread_join(thread, NULL);
+    check(ok, "child maps pools after a fork during heap calls");
+}
+
+int main() {
+
+    DEBUG_PRINTF("Running heap tests...\n");
+
+    test_tiers();
+    test_isolation();
+    test_limit();
+    test_destroy();
+    test_threads();
+    test_fork();
+
+    DEBUG_PRINTF("\nResults: %d passed, %d failed\n", passed, failed);
+
+    if (failed == 0) {
+        DEBUG_PRINTF("All tests passed! 🎉\n");
+        return 0;
+    } else {
+        DEBUG_PRINTF("Some tests failed 😞\n");
+        return 1;
+    }
+
+}
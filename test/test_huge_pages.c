@@ -0,0 +1,215 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../include/my_malloc.h"
+#include "../include/huge_pages.h"
+#include "../include/large_cache.h"
+#include "../include/pool_arena.h"
+#include "../include/malloc_stats.h"
+#include "../include/debug_print.h"
+
+// Testing the huge page mode
+
+int passed = 0;
+int failed = 0;
+
+void check(int condition, const char* msg) {
+    if (condition) {
+        DEBUG_PRINTF("✓ %s\n", msg);
+        passed++;
+    } else {
+        DEBUG_PRINTF("✗ %s\n", msg);
+        failed++;
+    }
+}
+
+// Whether the kernel hands out transparent huge pages to madvised mappings
+static int thp_available(void) {
+    char mode[64] = "";
+    FILE* file = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    if (!file) {
+        return 0;
+    }
+    if (!fgets(mode, sizeof(mode), file)) {
+        mode[0] = '\0';
+    }
+    fclose(file);
+    return strstr(mode, "[never]") == NULL && mode[0] != '\0';
+}
+
+void test_mode() {
+    DEBUG_PRINTF("\n--- Testing the mode switch ---\n");
+
+    check(my_malloc_huge_pages((HugePageMode)7) == -1 && errno == EINVAL, "unknown mode refused");
+    check(my_malloc_huge_pages(HUGE_PAGES_THP) == 0, "THP mode set before the first allocation");
+}
+
+void test_large_blocks() {
+    DEBUG_PRINTF("\n--- Testing large blocks ---\n");
+
+    MallocStats before, after;
+    my_malloc_stats(&before);
+
+    size_t size = 4 * HUGE_PAGE_SIZE;
+    char* block = my_malloc(size);
+    check(block != NULL, "large block allocated");
+    check(((uintptr_t)block & (HUGE_PAGE_SIZE - 1)) == LARGE_HEADER_SIZE, "mapping aligned to a huge page");
+    check(my_malloc_usable_size(block) >= size, "whole huge pages handed out");
+    memset(block, 0x5A, size);
+
+    my_malloc_stats(&after);
+    check(after.huge_mappings == before.huge_mappings + 1, "huge mapping counted");
+    check(after.huge_bytes_reserved >= before.huge_bytes_reserved + size, "huge bytes counted");
+    check(after.thp_hit_rate >= 0.0 && after.thp_hit_rate <= 1.0, "hit rate is a share");
+    if (thp_available()) {
+        check(after.huge_page_bytes >= HUGE_PAGE_SIZE, "written block backed by huge pages");
+    }
+
+    // Below a huge page: ordinary pages
+    char* small = my_malloc(MID_THRESHOLD + 1);
+    my_malloc_stats(&before);
+    check(small && before.huge_mappings == after.huge_mappings, "large block below a huge page left on small pages");
+
+    // Grown by mremap, the data follows
+    block = my_realloc(block, 2 * size);
+    check(block && block[0] == 0x5A && block[size - 1] == 0x5A, "huge block grown, data kept");
+    my_malloc_stats(&after);
+    check(after.huge_bytes_reserved >= before.huge_bytes_reserved + size, "growth counted");
+
+    // Small pages to huge pages: copied into a new mapping
+    small[0] = 0x11;
+    small = my_realloc(small, size);
+    check(small && small[0] == 0x11 && ((uintptr_t)small & (HUGE_PAGE_SIZE - 1)) == LARGE_HEADER_SIZE,
+          "block outgrowing small pages moved to a huge mapping");
+
+    my_free(block);
+    my_free(small);
+    large_cache_flush();
+    my_malloc_stats(&after);
+    check(after.huge_bytes_reserved < before.huge_bytes_reserved, "unmapped huge blocks counted");
+}
+
+void test_aging() {
+    DEBUG_PRINTF("\n--- Testing aged huge mappings ---\n");
+
+    size_t size = 2 * HUGE_PAGE_SIZE;
+    char* old = large_cache_map(size, NULL);
+    check(old != NULL, "huge mapping from the cache");
+    memset(old, 0x5A, size);
+    large_cache_unmap(old, size);
+
+    MallocStats before, after;
+    my_malloc_stats(&before);
+
+    // Enough frees of another size to make the huge mapping too old
+    for (int i = 0; i <= LARGE_CACHE_MAX_AGE; i++) {
+        void* ptr = large_cache_map(8 * PAGE_SIZE, NULL);
+        large_cache_unmap(ptr, 8 * PAGE_SIZE);
+    }
+
+    my_malloc_stats(&after);
+    check(after.huge_bytes_reserved + size == before.huge_bytes_reserved, "aged huge mapping unmapped, not split");
+    check(after.madvise_calls == before.madvise_calls, "no madvise on an aged huge mapping");
+    large_cache_flush();
+}
+
+// Resident bytes of the process, -1 if unknown
+static long resident_bytes(void) {
+    long size, resident = -1;
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file) {
+        return -1;
+    }
+    if (fscanf(file, "%ld %ld", &size, &resident) != 2) {
+        resident = -1;
+    }
+    fclose(file);
+    return resident < 0 ? -1 : resident * (long)PAGE_SIZE;
+}
+
+#define POOL_THREADS 8
+
+// One small, one mid and one slab block: a pool of each kind in the arena of the thread
+static void* allocate_in_arena(void* arg) {
+    void** ptrs = arg;
+    ptrs[0] = my_malloc(100);
+    ptrs[1] = my_malloc(SMALL_THRESHOLD * 4);
+    ptrs[2] = my_malloc(16);
+    return NULL;
+}
+
+void test_pools() {
+    DEBUG_PRINTF("\n--- Testing pools ---\n");
+
+    MallocStats before, after;
+    my_malloc_stats(&before);
+    long resident = resident_bytes();
+
+    void* ptrs[POOL_THREADS][3];
+    pthread_t threads[POOL_THREADS];
+    for (int i = 0; i < POOL_THREADS; i++) {
+        pthread_create(&threads[i], NULL, allocate_in_arena, ptrs[i]);
+    }
+    for (int i = 0; i < POOL_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    int all = 1;
+    for (int i = 0; i < POOL_THREADS; i++) {
+        for (int j = 0; j < 3; j++) {
+            all = all && ptrs[i][j] && pool_arena_lookup(ptrs[i][j]);
+        }
+    }
+    check(all, "blocks from pools");
+
+    my_malloc_stats(&after);
+    size_t pool_bytes = after.huge_bytes_reserved - before.huge_bytes_reserved;
+    if (MAX_BLOCK_SIZE >= HUGE_PAGE_SIZE) {
+        BuddyPool* pool = pool_arena_lookup(ptrs[0][0]);
+        check(((uintptr_t)pool->buddy.memory_pool & (HUGE_PAGE_SIZE - 1)) == 0, "pool aligned to a huge page");
+        check(pool_bytes >= MAX_BLOCK_SIZE, "pool counted as a huge mapping");
+    } else {
+        // Pools smaller than a huge page stay on small pages: a few blocks keep a few pages
+        // resident, not a huge page per pool
+        check(pool_bytes == 0, "pool smaller than a huge page left on small pages");
+        long grown = resident_bytes() - resident;
+        check(resident < 0 || grown < (long)HUGE_PAGE_SIZE, "pools of a few blocks stay small in memory");
+    }
+
+    for (int i = 0; i < POOL_THREADS; i++) {
+        for (int j = 0; j < 3; j++) {
+            my_free(ptrs[i][j]);
+        }
+    }
+}
+
+void test_frozen() {
+    DEBUG_PRINTF("\n--- Testing the mode once memory is mapped ---\n");
+
+    check(my_malloc_huge_pages(HUGE_PAGES_OFF) == -1 && errno == EBUSY, "mode fixed once memory was mapped");
+    check(huge_page_mode() == HUGE_PAGES_THP, "mode unchanged");
+}
+
+int main() {
+
+    DEBUG_PRINTF("Running huge page tests...\n");
+
+    test_mode();
+    test_large_blocks();
+    test_aging();
+    test_pools();
+    test_frozen();
+
+    DEBUG_PRINTF("\nResults: %d passed, %d failed\n", passed, failed);
+
+    if (failed == 0) {
+        DEBUG_PRINTF("All tests passed! 🎉\n");
+        return 0;
+    } else {
+        DEBUG_PRINTF("Some tests failed 😞\n");
+        return 1;
+    }
+
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/large_cache.h"
+#include "../include/debug_print.h"
+
+// Testing the cache of freed large mappings
+
+int passed = 0;
+int failed = 0;
+
+void check(int condition, const char* msg) {
+    if (condition) {
+        DEBUG_PRINTF("✓ %s\n", msg);
+        passed++;
+    } else {
+        DEBUG_PRINTF("✗ %s\n", msg);
+        failed++;
+    }
+}
+
+void test_reuse() {
+    DEBUG_PRINTF("\n--- Testing mapping reuse ---\n");
+
+    size_t size = 64 * PAGE_SIZE;
+    char* first = large_cache_map(size, NULL);
+    check(first != NULL, "mapping created");
+    memset(first, 0x11, size);
+
+    check(large_cache_unmap(first, size) == 0, "mapping given back");
+    check(large_cache_size() == size, "mapping kept in the cache");
+
+    char* other = large_cache_map(size + PAGE_SIZE, NULL);
+    check(other != NULL && other != first, "a different size does not reuse the mapping");
+
+    char* second = large_cache_map(size, NULL);
+    check(second == first, "same size reuses the mapping");
+    check(second[size - 1] == 0x11, "reused mapping keeps its pages while young");
+    check(large_cache_size() == 0, "reused mapping left the cache");
+
+    large_cache_unmap(other, size + PAGE_SIZE);
+    large_cache_unmap(second, size);
+}
+
+void test_aging() {
+    DEBUG_PRINTF("\n--- Testing mapping aging ---\n");
+
+    size_t size = 48 * PAGE_SIZE;
+    char* old = large_cache_map(size, NULL);
+    memset(old, 0x22, size);
+    large_cache_unmap(old, size);
+
+    // Enough frees of another size to make the first mapping too old
+    for (int i = 0; i <= LARGE_CACHE_MAX_AGE; i++) {
+        void* ptr = large_cache_map(8 * PAGE_SIZE, NULL);
+        large_cache_unmap(ptr, 8 * PAGE_SIZE);
+    }
+
+    char* again = large_cache_map(size, NULL);
+    check(again == old, "old mapping is still reused");
+    check(again[PAGE_SIZE] == 0 && again[size - 1] == 0, "pages of an old mapping were dropped");
+    large_cache_unmap(again, size);
+}
+
+void test_budget() {
+    DEBUG_PRINTF("\n--- Testing cache budget ---\n");
+
+    // Twice the budget of distinct mappings freed in a row
+    size_t size = LARGE_CACHE_MAX_SIZE;
+    int count = 2 * LARGE_CACHE_BUDGET / LARGE_CACHE_MAX_SIZE;
+    void* ptrs[2 * LARGE_CACHE_BUDGET / LARGE_CACHE_MAX_SIZE];
+    for (int i = 0; i < count; i++) {
+        ptrs[i] = large_cache_map(size, NULL);
+    }
+    for (int i = 0; i < count; i++) {
+        large_cache_unmap(ptrs[i], size);
+    }
+    check(large_cache_size() <= LARGE_CACHE_BUDGET, "cache stays within its budget");
+
+    void* huge = large_cache_map(LARGE_CACHE_MAX_SIZE + PAGE_SIZE, NULL);
+    size_t before = large_cache_size();
+    large_cache_unmap(huge, LARGE_CACHE_MAX_SIZE + PAGE_SIZE);
+    check(large_cache_size() == before, "mappings over LARGE_CACHE_MAX_SIZE are not cached");
+}
+
+int main() {
+
+    DEBUG_PRINTF("Running large mapping cache tests...\n");
+
+    test_reuse();
+    test_aging();
+    test_budget();
+
+    DEBUG_PRINTF("\nResults: %d passed, %d failed\n", passed, failed);
+
+    if (failed == 0) {
+        DEBUG_PRINTF("All tests passed! 🎉\n");
+        return 0;
+    } else {
+        DEBUG_PRINTF("Some tests failed 😞\n");
+        return 1;
+    }
+
+}
@@ -0,0 +1,172 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../include/my_malloc.h"
+#include "../include/pool_arena.h"
+#include "../include/debug_print.h"
+
+// Testing the libc malloc family of libpseudo_malloc.so (this test is linked against it)
+
+int passed = 0;
+int failed = 0;
+
+void check(int condition, const char* msg) {
+    if (condition) {
+        DEBUG_PRINTF("✓ %s\n", msg);
+        passed++;
+    } else {
+        DEBUG_PRINTF("✗ %s\n", msg);
+        failed++;
+    }
+}
+
+void test_interposed() {
+    DEBUG_PRINTF("\n--- Testing interposition ---\n");
+
+    void* ptr = malloc(100);
+    if (ptr) {
+        memset(ptr, 0, 100);
+    }
+    check(ptr != NULL && pool_arena_lookup(ptr) != NULL, "malloc comes from the pools");
+    check(malloc_usable_size(ptr) >= 100, "malloc_usable_size covers the request");
+    free(ptr);
+
+    // libc allocating on its own behalf goes through the same malloc
+    char* copy = strdup("pseudo-malloc");
+    check(copy != NULL && pool_arena_lookup(copy) != NULL, "strdup memory comes from the pools");
+    free(copy);
+
+    FILE* file = fopen("/dev/null", "w");
+    check(file != NULL && fprintf(file, "%d\n", 42) > 0, "stdio buffers work");
+    if (file) {
+        fclose(file);
+    }
+
+    void* empty = malloc(0);
+    check(empty != NULL, "malloc(0) returns a pointer that can be freed");
+    free(empty);
+
+    void* large = malloc(4 * MID_THRESHOLD);
+    check(large != NULL && pool_arena_lookup(large) == NULL, "large malloc is mapped");
+    free(large);
+}
+
+void test_realloc_calloc() {
+    DEBUG_PRINTF("\n--- Testing realloc and calloc ---\n");
+
+    char* ptr = realloc(NULL, 50);
+    check(ptr != NULL, "realloc of NULL allocates");
+    memset(ptr, 0x61, 50);
+    ptr = realloc(ptr, 300000);
+    check(ptr != NULL && ptr[0] == 0x61 && ptr[49] == 0x61, "realloc keeps the data");
+    check(realloc(ptr, 0) == NULL, "realloc to 0 bytes frees");
+
+    unsigned char* zeroed = calloc(1000, 4);
+    int zero = zeroed != NULL;
+    for (int i = 0; zeroed && i < 4000; i++) {
+        if (zeroed[i]) {
+            zero = 0;
+        }
+    }
+    check(zero, "calloc memory is zeroed");
+    free(zeroed);
+
+    volatile size_t count = SIZE_MAX / 4; // Hidden from the compiler, it warns about the overflow
+    errno = 0;
+    check(calloc(count, 8) == NULL && errno == ENOMEM, "overflowing calloc fails with ENOMEM");
+}
+
+void test_aligned() {
+    DEBUG_PRINTF("\n--- Testing aligned entry points ---\n");
+
+    void* ptr = NULL;
+    check(posix_memalign(&ptr, 4096, 100) == 0 && ((uintptr_t)ptr & 4095) == 0, "posix_memalign");
+    free(ptr);
+
+    void* ptr2 = memalign(100, 10);
+    check(ptr2 != NULL && ((uintptr_t)ptr2 & 127) == 0, "memalign rounds the alignment to a power of two");
+    free(ptr2);
+
+    void* ptr3 = aligned_alloc(256, 512);
+    check(ptr3 != NULL && ((uintptr_t)ptr3 & 255) == 0, "aligned_alloc");
+    free(ptr3);
+
+    void* ptr4 = valloc(10);
+    check(ptr4 != NULL && ((uintptr_t)ptr4 & (PAGE_SIZE - 1)) == 0, "valloc is page aligned");
+    free(ptr4);
+
+    void* ptr5 = pvalloc(PAGE_SIZE + 1);
+    check(ptr5 != NULL && malloc_usable_size(ptr5) >= 2 * PAGE_SIZE, "pvalloc rounds to whole pages");
+    free(ptr5);
+}
+
+static void* thread_work(void* arg) {
+    (void)arg;
+    for (int i = 0; i < 10000; i++) {
+        char* ptr = malloc((size_t)(i % 700) + 1);
+        if (!ptr) {
+            return (void*)1;
+        }
+        ptr[0] = (char)i;
+        free(ptr);
+    }
+    // Thread exit frees its TLS and cached blocks through the same allocator
+    return strdup("done");
+}
+
+void test_threads_and_fork() {
+    DEBUG_PRINTF("\n--- Testing threads and fork ---\n");
+
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++) {
+        pthread_create(&threads[i], NULL, thread_work, NULL);
+    }
+    int joined = 1;
+    for (int i = 0; i < 4; i++) {
+        void* result = NULL;
+        pthread_join(threads[i], &result);
+        if (result == NULL || result == (void*)1 || strcmp(result, "done") != 0) {
+            joined = 0;
+        }
+        if (result != (void*)1) {
+            free(result);
+        }
+    }
+    check(joined, "threads allocate and exit cleanly");
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        void* ptr = malloc(64);
+        free(ptr);
+        _exit(ptr == NULL);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    check(pid > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0, "child allocates after fork");
+}
+
+int main() {
+
+    DEBUG_PRINTF("Running libc malloc interposition tests...\n");
+
+    test_interposed();
+    test_realloc_calloc();
+    test_aligned();
+    test_threads_and_fork();
+
+    DEBUG_PRINTF("\nResults: %d passed, %d failed\n", passed, failed);
+
+    if (failed == 0) {
+        DEBUG_PRINTF("All tests passed! 🎉\n");
+        return 0;
+    } else {
+        DEBUG_PRINTF("Some tests failed 😞\n");
+        return 1;
+    }
+
+}
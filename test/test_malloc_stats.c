@@ -0,0 +1,175 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <limits.h>
+#include <unistd.h>
+#include "../include/my_malloc.h"
+#include "../include/malloc_stats.h"
+#include "../include/debug_print.h"
+
+// Testing the allocation statistics
+
+int passed = 0;
+int failed = 0;
+
+void check(int condition, const char* msg) {
+    if (condition) {
+        DEBUG_PRINTF("✓ %s\n", msg);
+        passed++;
+    } else {
+        DEBUG_PRINTF("✗ %s\n", msg);
+        failed++;
+    }
+}
+
+void test_counters() {
+    DEBUG_PRINTF("\n--- Testing counters ---\n");
+
+    MallocStats before, after;
+    my_malloc_stats(&before);
+
+    void* small = my_malloc(100);
+    void* tiny = my_malloc(20);
+    my_malloc_stats(&after);
+    int level = stats_buddy_level(128);
+    check(after.buddy_mallocs[level] == before.buddy_mallocs[level] + 1, "small malloc counted at the level of its block");
+    check(after.slab_mallocs == before.slab_mallocs + 1, "tiny malloc counted as a slab object");
+    check(after.bytes_requested - before.bytes_requested == 120, "requested bytes counted");
+    check(after.bytes_allocated - before.bytes_allocated == 128 + 24, "block bytes counted");
+    check(after.bytes_in_use >= 128 + 24, "blocks are in use");
+
+    my_free(small);
+    my_free(tiny);
+    my_malloc_stats(&after);
+    check(after.buddy_frees[level] == before.buddy_frees[level] + 1 && after.slab_frees == before.slab_frees + 1,
+          "frees counted");
+    check(after.bytes_in_use == before.bytes_in_use, "bytes in use back where they were");
+
+    // A large block maps memory (or takes a cached mapping)
+    void* large = my_malloc(3 * MID_THRESHOLD);
+    my_malloc_stats(&after);
+    check(after.large_mallocs == before.large_mallocs + 1, "large malloc counted");
+    check(after.bytes_reserved >= after.bytes_in_use && after.mmap_calls > 0, "mapped memory covers the blocks in use");
+    my_free(large);
+
+    void* failing = my_malloc(SIZE_MAX - PAGE_SIZE);
+    my_malloc_stats(&after);
+    check(failing == NULL && after.failed_mallocs == before.failed_mallocs + 1, "failed malloc counted");
+
+    check(after.internal_fragmentation >= 0.0 && after.internal_fragmentation < 1.0, "fragmentation is a share of the block bytes");
+}
+
+static void* thread_work(void* arg) {
+    (void)arg;
+    for (int i = 0; i < 100; i++) {
+        my_free(my_malloc(300));
+    }
+    return NULL;
+}
+
+void test_exited_threads() {
+    DEBUG_PRINTF("\n--- Testing counters of exited threads ---\n");
+
+    MallocStats before, after;
+    my_malloc_stats(&before);
+
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++) {
+        pthread_create(&threads[i], NULL, thread_work, NULL);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    my_malloc_stats(&after);
+    int level = stats_buddy_level(512);
+    check(after.buddy_mallocs[level] - before.buddy_mallocs[level] == 400, "counters of exited threads are kept");
+    check(after.buddy_frees[level] - before.buddy_frees[level] == 400, "frees of exited threads are kept");
+}
+
+static pthread_key_t late_key;
+static __thread int late_passes;
+
+// Keeps itself set until the last destructor pass, and only then counts for the first time
+static void late_destructor(void* value) {
+    if (++late_passes < PTHREAD_DESTRUCTOR_ITERATIONS) {
+        pthread_setspecific(late_key, value);
+        return;
+    }
+    my_free(my_malloc(300));
+}
+
+static void* late_work(void* arg) {
+    pthread_setspecific(late_key, arg);
+    return NULL;
+}
+
+void test_late_threads() {
+    DEBUG_PRINTF("\n--- Testing a thread counting during its last destructor pass ---\n");
+
+    MallocStats before, after;
+    my_malloc_stats(&before);
+
+    pthread_key_create(&late_key, late_destructor);
+    pthread_t thread;
+    pthread_create(&thread, NULL, late_work, &late_key);
+    pthread_join(thread, NULL);
+
+    // The next thread likely gets the same TLS block
+    pthread_create(&thread, NULL, thread_work, NULL);
+    pthread_join(thread, NULL);
+
+    // A list walk that never ends is the failure here
+    alarm(10);
+    my_malloc_stats(&after);
+    alarm(0);
+    int level = stats_buddy_level(512);
+    check(after.buddy_mallocs[level] - before.buddy_mallocs[level] == 101, "count of a thread registered during its exit kept");
+    pthread_key_delete(late_key);
+}
+
+void test_print() {
+    DEBUG_PRINTF("\n--- Testing dumps ---\n");
+
+    char text[8192];
+    FILE* stream = fmemopen(text, sizeof(text), "w");
+    check(stream && my_malloc_stats_print(stream, 0) == 0, "text dump written");
+    if (stream) {
+        fclose(stream);
+        check(strstr(text, "internal fragmentation:") != NULL, "text dump has the fragmentation");
+    }
+
+    char json[8192];
+    stream = fmemopen(json, sizeof(json), "w");
+    check(stream && my_malloc_stats_print(stream, 1) == 0, "JSON dump written");
+    if (stream) {
+        fclose(stream);
+        char first_level[64];
+        snprintf(first_level, sizeof(first_level), "\"buddy_levels\": [{\"block_size\": %zu", (size_t)MAX_BLOCK_SIZE);
+        check(json[0] == '{' && strstr(json, first_level) && strstr(json, "\"mmap_calls\": "),
+              "JSON dump has the levels and the system calls");
+    }
+}
+
+int main() {
+
+    DEBUG_PRINTF("Running allocation statistics tests...\n");
+
+    test_counters();
+    test_exited_threads();
+    test_late_threads();
+    test_print();
+
+    DEBUG_PRINTF("\nResults: %d passed, %d failed\n", passed, failed);
+
+    if (failed == 0) {
+        DEBUG_PRINTF("All tests passed! 🎉\n");
+        return 0;
+    } else {
+        DEBUG_PRINTF("Some tests failed 😞\n");
+        return 1;
+    }
+
+}
@@ -0,0 +1,201 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "../include/my_malloc.h"
+#include "../include/malloc_trace.h"
+#include "../include/debug_print.h"
+
+// Testing the allocation trace
+
+int passed = 0;
+int failed = 0;
+
+void check(int condition, const char* msg) {
+    if (condition) {
+        DEBUG_PRINTF("✓ %s\n", msg);
+        passed++;
+    } else {
+        DEBUG_PRINTF("✗ %s\n", msg);
+        failed++;
+    }
+}
+
+// Whole trace file in memory (records after the header), NULL on error
+static TraceRecord* read_trace(const char* path, size_t* count, TraceFileHeader* header) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    size_t bytes = (size_t)st.st_size > sizeof(*header) ? (size_t)st.st_size - sizeof(*header) : 0;
+    TraceRecord* records = malloc(bytes ? bytes : 1);
+    int ok = read(fd, header, sizeof(*header)) == (ssize_t)sizeof(*header) &&
+             read(fd, records, bytes) == (ssize_t)bytes;
+    close(fd);
+    if (!ok) {
+        free(records);
+        return NULL;
+    }
+    *count = bytes / sizeof(TraceRecord);
+    return records;
+}
+
+static int count_op(TraceRecord* records, size_t count, TraceOp op) {
+    int found = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (records[i].op == (uint32_t)op) {
+            found++;
+        }
+    }
+    return found;
+}
+
+void test_single_thread() {
+    DEBUG_PRINTF("\n--- Testing a single thread trace ---\n");
+
+    char path[] = "/tmp/pseudo_malloc_traceXXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+
+    check(my_malloc_trace_start(path) == 0, "trace starts");
+    check(my_malloc_trace_start(path) == -1, "a second trace is refused");
+
+    void* a = my_malloc(100);
+    void* b = my_calloc(10, 30);
+    void* c = my_aligned_alloc(256, 1000);
+    void* d = my_realloc(a, 5000);
+    my_free(b);
+    my_free(c);
+    my_free(d);
+    my_free(NULL);
+    check(my_malloc(0) == NULL, "zero malloc");
+
+    check(my_malloc_trace_stop() == 0, "trace stops");
+    check(my_malloc_trace_stop() == -1, "stopping twice fails");
+
+    // Not recorded any more
+    my_free(my_malloc(10));
+
+    TraceFileHeader header;
+    size_t count = 0;
+    TraceRecord* records = read_trace(path, &count, &header);
+    check(records != NULL, "trace file can be read");
+    if (!records) {
+        unlink(path);
+        return;
+    }
+    check(memcmp(header.magic, TRACE_MAGIC, 8) == 0 && header.version == TRACE_VERSION &&
+          header.record_size == sizeof(TraceRecord), "header");
+    check(count == 8, "one record per successful call, two per realloc");
+    if (count == 8) {
+        check(records[0].op == TRACE_MALLOC && records[0].size == 100 && records[0].id == (uintptr_t)a, "malloc record");
+        check(records[1].op == TRACE_CALLOC && records[1].size == 300 && records[1].id == (uintptr_t)b, "calloc record");
+        check(records[2].op == TRACE_MEMALIGN && records[2].old_id == 256 && records[2].id == (uintptr_t)c,
+              "aligned allocation record with its alignment");
+        check(records[3].op == TRACE_REALLOC_BEGIN && records[3].old_id == (uintptr_t)a && records[3].id == 0,
+              "realloc names its old block first");
+        check(records[4].op == TRACE_REALLOC && records[4].old_id == (uintptr_t)a && records[4].id == (uintptr_t)d &&
+              records[4].size == 5000, "realloc record");
+        check(records[7].op == TRACE_FREE && records[7].id == (uintptr_t)d, "free record");
+    }
+    int ordered = 1;
+    for (size_t i = 1; i < count; i++) {
+        if (records[i].timestamp < records[i - 1].timestamp || records[i].thread != records[0].thread) {
+            ordered = 0;
+        }
+    }
+    check(ordered, "timestamps of a thread never go back");
+
+    free(records);
+    unlink(path);
+}
+
+#define THREAD_OPS 20000 // Several rings worth of records per thread
+
+static void* thread_work(void* arg) {
+    (void)arg;
+    for (int i = 0; i < THREAD_OPS; i++) {
+        my_free(my_malloc((size_t)(i % 2000) + 1));
+    }
+    return NULL;
+}
+
+void test_threads() {
+    DEBUG_PRINTF("\n--- Testing a multithreaded trace ---\n");
+
+    char path[] = "/tmp/pseudo_malloc_traceXXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+
+    check(my_malloc_trace_start(path) == 0, "trace starts");
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++) {
+        pthread_create(&threads[i], NULL, thread_work, NULL);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    // A live thread keeps records in its ring until the trace stops
+    void* live = my_malloc(64);
+    check(my_malloc_trace_stop() == 0, "trace stops");
+    my_free(live);
+
+    TraceFileHeader header;
+    size_t count = 0;
+    TraceRecord* records = read_trace(path, &count, &header);
+    check(records != NULL && count == 4 * 2 * THREAD_OPS + 1, "every record reaches the file");
+    if (!records) {
+        unlink(path);
+        return;
+    }
+    check(count_op(records, count, TRACE_MALLOC) == 4 * THREAD_OPS + 1, "mallocs of all threads");
+    check(count_op(records, count, TRACE_FREE) == 4 * THREAD_OPS, "frees of all threads");
+
+    // Within a thread every free follows the malloc of its block
+    int paired = 1;
+    uint32_t threads_seen = 0;
+    uint64_t last_malloc[64] = {0};
+    for (size_t i = 0; i < count; i++) {
+        uint32_t thread = records[i].thread;
+        if (thread >= 64) {
+            paired = 0;
+            break;
+        }
+        threads_seen |= 1u << (thread % 32);
+        if (records[i].op == TRACE_MALLOC) {
+            last_malloc[thread] = records[i].id;
+        } else if (records[i].op == TRACE_FREE && records[i].id != last_malloc[thread]) {
+            paired = 0;
+        }
+    }
+    check(paired, "records of a thread stay in order");
+    check(__builtin_popcount(threads_seen) == 5, "each thread has a number of its own");
+
+    free(records);
+    unlink(path);
+}
+
+int main() {
+
+    DEBUG_PRINTF("Running allocation trace tests...\n");
+
+    test_single_thread();
+    test_threads();
+
+    DEBUG_PRINTF("\nResults: %d passed, %d failed\n", passed, failed);
+
+    if (failed == 0) {
+        DEBUG_PRINTF("All tests passed! 🎉\n");
+        return 0;
+    } else {
+        DEBUG_PRINTF("Some tests failed 😞\n");
+        return 1;
+    }
+
+}
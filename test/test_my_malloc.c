@@ -1,8 +1,10 @@
-#include <sys/time.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "../include/my_malloc.h"
+#include "../include/pool_arena.h"
+#include "../include/malloc_stats.h"
 #include "../include/debug_print.h"
 
 // Testing pseudo malloc implementation
@@ -47,14 +49,14 @@ void test_different_sizes() {
     void* tiny = my_malloc(1);
     void* small = my_malloc(64);
     void* medium = my_malloc(512);
-    void* large = my_malloc(4096); // This should use mmap
-    void* huge = my_malloc(8192);  // This should use mmap
+    void* large = my_malloc(4096); // This should use a mid pool
+    void* huge = my_malloc(8192);  // This should use a mid pool
 
     check(tiny != NULL, "1 byte allocation");
     check(small != NULL, "64 byte allocation");
     check(medium != NULL, "512 byte allocation");
-    check(large != NULL, "4KB allocation (should use mmap)");
-    check(huge != NULL, "8KB allocation (should use mmap)");
+    check(large != NULL, "4KB allocation (should use a mid pool)");
+    check(huge != NULL, "8KB allocation (should use a mid pool)");
 
     // Make sure they're all different
     int all_different = (tiny != small && small != medium && 
@@ -144,7 +146,7 @@ void test_small_allocation_after_free_big_block() {
     void* small_block = my_malloc(128);
     check(small_block != NULL, "Allocated 128 bytes block");
 
-    // Free the large block
+    // Free the large block (it stays in the thread cache, ready for the next 512 bytes request)
     my_free(large_block);
 
     // Now allocate another small block
@@ -152,8 +154,10 @@ void test_small_allocation_after_free_big_block() {
 
     check(small_block2 != NULL, "Allocated another 128 bytes block");
 
-    // check that the index of the second small block is before the first block
-    check(small_block2 < small_block, "Second small block is before first small block");
+    // The freed block is handed out again to the next request of the same size
+    // (placement inside the pool is tested on the buddy allocator itself)
+    void* large_block2 = my_malloc(512);
+    check(large_block2 == large_block, "Freed 512 bytes block is reused");
 
     // Free the small block
     my_free(small_block2);
@@ -161,6 +165,8 @@ void test_small_allocation_after_free_big_block() {
     // Free the first small block
     my_free(small_block);
 
+    my_free(large_block2);
+
 }
 
 void test_full_allocation_of_buddy_pool_512() {
@@ -172,9 +178,10 @@ void test_full_allocation_of_buddy_pool_512() {
         blocks[i] = my_malloc(512);
     }
 
-    // Try to allocate one more block (should fail)
+    // One more block still works: the arena maps another pool instead of failing
     void* extra = my_malloc(128);
-    check(extra == NULL, "Extra allocation fails when pool is full");
+    check(extra != NULL, "Extra allocation succeeds when pool is full");
+    my_free(extra);
 
     // Free all blocks
     for (int i = 0; i < 2048; i++) {
@@ -192,9 +199,10 @@ void test_full_allocation_of_buddy_pool_1023() {
         blocks[i] = my_malloc(1023);
     }
 
-    // Try to allocate one more block (should fail)
+    // One more block still works: the arena maps another pool instead of failing
     void* extra = my_malloc(128);
-    check(extra == NULL, "Extra allocation fails when pool is full");
+    check(extra != NULL, "Extra allocation succeeds when pool is full");
+    my_free(extra);
 
     // Free all blocks
     for (int i = 0; i < 1024; i++) {
@@ -203,6 +211,109 @@ void test_full_allocation_of_buddy_pool_1023() {
 
 }
 
+/* Multithreaded tests */
+
+#define THREADS_COUNT 4
+#define THREAD_ITERATIONS 20000
+#define THREAD_SLOTS 64
+
+// Blocks allocated by the main thread and freed by the workers
+void* shared_blocks[THREADS_COUNT][THREAD_SLOTS];
+
+int thread_errors = 0;
+
+void* thread_worker(void* arg) {
+    int id = (int)(long)arg;
+    unsigned int seed = (unsigned int)id + 1;
+    void* slots[THREAD_SLOTS] = {0};
+    size_t sizes[THREAD_SLOTS] = {0};
+    int errors = 0;
+
+    // Free what another thread allocated for us
+    for (int i = 0; i < THREAD_SLOTS; i++) {
+        if (*(int*)shared_blocks[id][i] != id * THREAD_SLOTS + i) {
+            errors++;
+        }
+        my_free(shared_blocks[id][i]);
+    }
+
+    // Random churn, mostly sizes served by the thread cache
+    for (int i = 0; i < THREAD_ITERATIONS; i++) {
+        int slot = rand_r(&seed) % THREAD_SLOTS;
+
+        if (slots[slot]) {
+            // Check that nobody else wrote in our block
+            unsigned char* bytes = slots[slot];
+            for (size_t j = 0; j < sizes[slot]; j++) {
+                if (bytes[j] != (unsigned char)(id + slot)) {
+                    errors++;
+                    break;
+                }
+            }
+            my_free(slots[slot]);
+            slots[slot] = NULL;
+        } else {
+            size_t size = 1 + rand_r(&seed) % ((rand_r(&seed) % 8) ? 512 : 2048);
+            slots[slot] = my_malloc(size);
+            if (slots[slot]) {
+                sizes[slot] = size;
+                memset(slots[slot], id + slot, size);
+            }
+        }
+    }
+
+    for (int i = 0; i < THREAD_SLOTS; i++) {
+        my_free(slots[i]);
+    }
+
+    __atomic_add_fetch(&thread_errors, errors, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+void test_multithreaded_malloc_free() {
+    DEBUG_PRINTF("\n--- Testing concurrent malloc/free ---\n");
+
+    int allocated = 1;
+    for (int t = 0; t < THREADS_COUNT; t++) {
+        for (int i = 0; i < THREAD_SLOTS; i++) {
+            shared_blocks[t][i] = my_malloc(64 + (i % 4) * 100);
+            if (!shared_blocks[t][i]) {
+                allocated = 0;
+                continue;
+            }
+            *(int*)shared_blocks[t][i] = t * THREAD_SLOTS + i;
+        }
+    }
+    check(allocated, "blocks for cross-thread frees allocated");
+    if (!allocated) {
+        return;
+    }
+
+    pthread_t threads[THREADS_COUNT];
+    for (int t = 0; t < THREADS_COUNT; t++) {
+        pthread_create(&threads[t], NULL, thread_worker, (void*)(long)t);
+    }
+    for (int t = 0; t < THREADS_COUNT; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    check(thread_errors == 0, "no corruption with concurrent malloc/free");
+
+    // Exited threads gave their cached blocks back, so the whole pool is usable again
+    void* blocks[1024];
+    int successful = 0;
+    for (int i = 0; i < 1024; i++) {
+        blocks[i] = my_malloc(1023);
+        if (blocks[i]) {
+            successful++;
+        }
+    }
+    check(successful == 1024, "whole pool available after the threads exited");
+    for (int i = 0; i < 1024; i++) {
+        my_free(blocks[i]);
+    }
+}
+
 /* Metabuddy tests */
 
 void test_basic_malloc_free_metabuddy() {
@@ -231,14 +342,14 @@ void test_different_sizes_metabuddy() {
     void* tiny = my_malloc_metabuddy(1);
     void* small = my_malloc_metabuddy(64);
     void* medium = my_malloc_metabuddy(512);
-    void* large = my_malloc_metabuddy(4096); // This should use mmap
-    void* huge = my_malloc_metabuddy(8192);  // This should use mmap
+    void* large = my_malloc_metabuddy(4096); // This should use a mid pool
+    void* huge = my_malloc_metabuddy(8192);  // This should use a mid pool
 
     check(tiny != NULL, "1 byte allocation");
     check(small != NULL, "64 byte allocation");
     check(medium != NULL, "512 byte allocation");
-    check(large != NULL, "4KB allocation (should use mmap)");
-    check(huge != NULL, "8KB allocation (should use mmap)");
+    check(large != NULL, "4KB allocation (should use a mid pool)");
+    check(huge != NULL, "8KB allocation (should use a mid pool)");
 
     // Make sure they're all different
     int all_different = (tiny != small && small != medium && 
@@ -336,8 +447,9 @@ void test_small_allocation_after_free_big_block_metabuddy() {
 
     check(small_block2 != NULL, "Allocated another 128 bytes block");
 
-    // check that the index of the second small block is before the first block
-    check(small_block2 < small_block, "Second small block is before first small block");
+    // The lowest free block is taken: the freed block, or a hole below it left by earlier tests
+    // in the same pool (the pools of the arena are shared with the cached blocks of my_malloc)
+    check((char*)small_block2 <= (char*)large_block, "Second small block is not after the freed block");
 
     // Free the small block
     my_free_metabuddy(small_block2);
@@ -358,9 +470,10 @@ void test_full_allocation_of_buddy_pool_504_metabuddy() {
         blocks[i] = my_malloc_metabuddy(504);
     }
 
-    // Try to allocate one more block (should fail)
+    // One more block still works: the arena maps another pool instead of failing
     void* extra = my_malloc_metabuddy(128);
-    check(extra == NULL, "Extra allocation fails when pool is full");
+    check(extra != NULL, "Extra allocation succeeds when pool is full");
+    my_free_metabuddy(extra);
 
     // Free all blocks
     for (int i = 0; i < 2048; i++) {
@@ -381,9 +494,10 @@ void test_full_allocation_of_buddy_pool_1015_metabuddy() {
         blocks[i] = my_malloc_metabuddy(1015);
     }
 
-    // Try to allocate one more block (should fail)
+    // One more block still works: the arena maps another pool instead of failing
     void* extra = my_malloc_metabuddy(128);
-    check(extra == NULL, "Extra allocation fails when pool is full");
+    check(extra != NULL, "Extra allocation succeeds when pool is full");
+    my_free_metabuddy(extra);
 
     // Free all blocks
     for (int i = 0; i < 1024; i++) {
@@ -392,55 +506,310 @@ void test_full_allocation_of_buddy_pool_1015_metabuddy() {
     
 }
 
-int main() {
+void test_tiny_objects() {
+    DEBUG_PRINTF("\n--- Testing tiny objects ---\n");
 
-    DEBUG_PRINTF("Running pseudo malloc tests...\n");
-    
-    int runs = 1000;
-    struct timeval t0, t1;
-    long long sum_standard = 0;
-    long long sum_metabuddy = 0;
+    // Tiny requests are served by slabs: no 64 bytes block and no header per object
+    void* objects[64];
+    int successful = 0;
+    for (int i = 0; i < 64; i++) {
+        objects[i] = my_malloc(8);
+        if (objects[i]) {
+            memset(objects[i], i, 8);
+            successful++;
+        }
+    }
+    check(successful == 64, "64 tiny allocations");
+
+    // The thread cache hands them out in any order, but neighbours are 8 bytes apart
+    long closest = -1;
+    for (int i = 0; i < 64; i++) {
+        for (int j = 0; j < 64; j++) {
+            long distance = (char*)objects[j] - (char*)objects[i];
+            if (distance > 0 && (closest < 0 || distance < closest)) {
+                closest = distance;
+            }
+        }
+    }
+    check(closest == 8, "tiny objects are packed");
+    check(pool_arena_lookup(objects[0])->kind == POOL_KIND_SLAB, "tiny objects come from a slab");
 
-    for (int i = 0; i < runs; i++) {
-        gettimeofday(&t0, NULL);
-        
-        test_basic_malloc_free();
-        test_different_sizes();
-        test_multiple_allocations();
-        test_edge_cases();
-        test_small_allocation_after_free_big_block();
-        test_full_allocation_of_buddy_pool_512();
-        test_full_allocation_of_buddy_pool_1023();
-        
-        gettimeofday(&t1, NULL);
+    // Metabuddy needs no metadata for them either
+    void* meta = my_malloc_metabuddy(24);
+    check(meta && pool_arena_lookup(meta)->kind == POOL_KIND_SLAB, "metabuddy tiny object comes from a slab");
+    my_free_metabuddy(meta);
+
+    int data_ok = 1;
+    for (int i = 0; i < 64; i++) {
+        unsigned char* bytes = objects[i];
+        for (int k = 0; k < 8; k++) {
+            if (bytes[k] != (unsigned char)i) {
+                data_ok = 0;
+            }
+        }
+        my_free(objects[i]);
+    }
+    check(data_ok, "tiny objects do not overlap");
+}
+
+void test_medium_allocations() {
+    DEBUG_PRINTF("\n--- Testing medium allocations ---\n");
+
+    // From SMALL_THRESHOLD up to MID_THRESHOLD blocks come from the mid pools, no syscall
+    size_t sizes[] = {SMALL_THRESHOLD, 2048, 64 * 1024, MID_THRESHOLD - 1};
+    for (int i = 0; i < 4; i++) {
+        char* ptr = my_malloc(sizes[i]);
+        char* meta = my_malloc_metabuddy(sizes[i]);
+        BuddyPool* pool = ptr ? pool_arena_lookup(ptr) : NULL;
+        BuddyPool* meta_pool = meta ? pool_arena_lookup(meta) : NULL;
+        check(pool && pool->kind == POOL_KIND_MID, "medium allocation comes from a mid pool");
+        check(meta_pool && meta_pool->kind == POOL_KIND_MID, "medium metabuddy allocation comes from a mid pool");
+        if (ptr && meta) {
+            memset(ptr, 0x5A, sizes[i]);
+            memset(meta, 0xA5, sizes[i]);
+            check(ptr[sizes[i] - 1] == 0x5A && meta[0] == (char)0xA5, "medium blocks are writable and do not overlap");
+        }
+        my_free(ptr);
+        my_free_metabuddy(meta);
+    }
+
+    // From MID_THRESHOLD on it is mmap
+    void* large = my_malloc(MID_THRESHOLD);
+    check(large != NULL && pool_arena_lookup(large) == NULL, "MID_THRESHOLD bytes use mmap");
+    my_free(large);
+
+    // The freed mapping is cached and handed out again for the same size
+    void* large2 = my_malloc(MID_THRESHOLD);
+    check(large2 == large, "freed large mapping is reused");
+    my_free(large2);
+}
+
+void test_realloc() {
+    DEBUG_PRINTF("\n--- Testing realloc ---\n");
+
+    check(my_realloc(NULL, 0) == NULL, "realloc of NULL to 0 bytes returns NULL");
+
+    // Small block with free buddies above it: grows where it is
+    char* ptr = my_realloc(NULL, 300);
+    check(ptr != NULL && my_malloc_usable_size(ptr) >= 300, "realloc of NULL allocates");
+    memset(ptr, 0x42, 300);
+    char* grown = my_realloc(ptr, 1000);
+    check(grown != NULL && my_malloc_usable_size(grown) >= 1000, "realloc grows a small block");
+    check(grown[0] == 0x42 && grown[299] == 0x42, "grown block keeps its data");
+
+    // Out of the small tier: moved to a mid pool
+    char* medium = my_realloc(grown, 10000);
+    BuddyPool* pool = medium ? pool_arena_lookup(medium) : NULL;
+    check(pool && pool->kind == POOL_KIND_MID, "small block grown past SMALL_THRESHOLD moves to a mid pool");
+    check(medium && medium[0] == 0x42 && medium[299] == 0x42, "moved block keeps its data");
+
+    // Shrinking a medium block stays in place
+    char* shrunk = my_realloc(medium, 5000);
+    check(shrunk == medium, "medium block shrinks in place");
+
+    // Large blocks are remapped
+    char* large = my_realloc(shrunk, 2 * MID_THRESHOLD);
+    check(large != NULL && pool_arena_lookup(large) == NULL, "block grown past MID_THRESHOLD is mapped");
+    check(large && large[299] == 0x42, "mapped block keeps its data");
+    memset(large, 0x17, 2 * MID_THRESHOLD);
+    char* larger = my_realloc(large, 40 * MID_THRESHOLD);
+    check(larger != NULL && my_malloc_usable_size(larger) >= 40 * MID_THRESHOLD, "large block grows with mremap");
+    check(larger && larger[2 * MID_THRESHOLD - 1] == 0x17, "remapped block keeps its data");
+    larger[40 * MID_THRESHOLD - 1] = 1;
+
+    // Tiny objects stay in their slab while they fit
+    char* tiny = my_malloc(20);
+    check(my_realloc(tiny, 24) == tiny, "tiny object that still fits stays in place");
+
+    check(my_realloc(larger, 0) == NULL, "realloc to 0 bytes frees");
+    my_free(tiny);
+}
+
+void test_calloc() {
+    DEBUG_PRINTF("\n--- Testing calloc ---\n");
+
+    // Dirty a block first so the zeroing is not just fresh memory
+    char* dirty = my_malloc(256);
+    memset(dirty, 0xFF, 256);
+    my_free(dirty);
+
+    size_t sizes[] = {10, 256, 20000, 4 * MID_THRESHOLD};
+    for (int i = 0; i < 4; i++) {
+        unsigned char* ptr = my_calloc(sizes[i], 1);
+        int zero = ptr != NULL;
+        for (size_t k = 0; ptr && k < sizes[i]; k++) {
+            if (ptr[k] != 0) {
+                zero = 0;
+            }
+        }
+        check(zero, "calloc memory is zeroed");
+        if (ptr) {
+            memset(ptr, 0xEE, sizes[i]);
+        }
+        my_free(ptr);
+    }
+
+    // The large mapping comes back from the cache dirty and must be cleared
+    unsigned char* reused = my_calloc(4, MID_THRESHOLD);
+    check(reused && reused[0] == 0 && reused[4 * MID_THRESHOLD - 1] == 0, "reused large mapping is zeroed");
+    my_free(reused);
 
-        long long diff = (long long)(t1.tv_sec - t0.tv_sec) * 1000000LL + (long long)(t1.tv_usec - t0.tv_usec);
-        sum_standard += diff;
+    errno = 0;
+    check(my_calloc(SIZE_MAX / 2, 3) == NULL && errno == ENOMEM, "overflowing calloc fails with ENOMEM");
+}
+
+void test_aligned_allocations() {
+    DEBUG_PRINTF("\n--- Testing aligned allocations ---\n");
+
+    size_t alignments[] = {8, 16, 64, 4096, 65536, 2 * 1024 * 1024};
+    size_t sizes[] = {1, 24, 100, 5000, 3 * MID_THRESHOLD};
+    int aligned = 1;
+    for (int a = 0; a < 6; a++) {
+        for (int s = 0; s < 5; s++) {
+            void* ptr = NULL;
+            if (my_posix_memalign(&ptr, alignments[a], sizes[s]) != 0 || ptr == NULL ||
+                ((uintptr_t)ptr & (alignments[a] - 1)) != 0 || my_malloc_usable_size(ptr) < sizes[s]) {
+                aligned = 0;
+            }
+            if (ptr) {
+                memset(ptr, 0x77, sizes[s]);
+            }
+            my_free(ptr);
+
+            void* ptr2 = my_aligned_alloc(alignments[a], sizes[s]);
+            if (ptr2 == NULL || ((uintptr_t)ptr2 & (alignments[a] - 1)) != 0) {
+                aligned = 0;
+            }
+            my_free(ptr2);
+        }
     }
+    check(aligned, "posix_memalign and aligned_alloc honour the alignment");
 
-    for (int i = 0; i < runs; i++) {
-        gettimeofday(&t0, NULL);
+    void* ptr = NULL;
+    check(my_posix_memalign(&ptr, 24, 100) == EINVAL, "alignment not a power of two is rejected");
+    check(my_posix_memalign(&ptr, 4, 100) == EINVAL, "alignment below sizeof(void*) is rejected");
+    check(my_aligned_alloc(48, 100) == NULL && errno == EINVAL, "aligned_alloc rejects an invalid alignment");
+}
 
-        test_basic_malloc_free_metabuddy();
-        test_different_sizes_metabuddy();
-        test_multiple_allocations_metabuddy();
-        test_edge_cases_metabuddy();
-        test_small_allocation_after_free_big_block_metabuddy();
-        test_full_allocation_of_buddy_pool_504_metabuddy();
-        test_full_allocation_of_buddy_pool_1015_metabuddy();
+void test_batch() {
+    DEBUG_PRINTF("\n--- Testing batch allocation and free ---\n");
+
+    // Slab objects, cached and uncached buddy blocks, mid blocks and large mappings
+    size_t sizes[] = {24, 200, 700, 3000, 2 * MID_THRESHOLD};
+    size_t counts[] = {300, 300, 300, 300, 4};
+    void* blocks[5 * 300 + 1];
+    size_t total = 0;
+    int ok = 1;
+    for (int s = 0; s < 5; s++) {
+        size_t got = my_malloc_batch(sizes[s], counts[s], blocks + total);
+        if (got != counts[s]) {
+            ok = 0;
+        }
+        for (size_t i = 0; i < got; i++) {
+            if (my_malloc_usable_size(blocks[total + i]) < sizes[s]) {
+                ok = 0;
+            }
+            memset(blocks[total + i], (int)(total + i) & 0xFF, sizes[s]);
+        }
+        total += got;
+    }
+    check(ok, "batches of every size allocated");
+
+    int intact = 1;
+    size_t index = 0;
+    for (int s = 0; s < 5; s++) {
+        for (size_t i = 0; i < counts[s]; i++, index++) {
+            unsigned char* bytes = blocks[index];
+            if (bytes[0] != (index & 0xFF) || bytes[sizes[s] - 1] != (index & 0xFF)) {
+                intact = 0;
+            }
+        }
+    }
+    check(intact, "blocks of the batches do not overlap");
+
+    // One block freed on its own, one from my_malloc freed with the batch
+    my_free(blocks[0]);
+    blocks[0] = NULL;
+    blocks[total++] = my_malloc(500);
+    my_free_batch(blocks, total);
+    int freed = blocks[0] == NULL;
+    for (size_t i = 1; i < total; i++) {
+        // Large mappings are gone, pool blocks must no longer be allocated
+        if ((uintptr_t)blocks[i - 1] > (uintptr_t)blocks[i] ||
+            (pool_arena_lookup(blocks[i]) && my_malloc_usable_size(blocks[i]) != 0)) {
+            freed = 0;
+        }
+    }
+    check(freed, "every block of the batch freed, in address order");
+
+    // A pointer freed twice in a slab run is refused, whether or not its pool is still there
+    void* objects[301];
+    size_t got = my_malloc_batch(16, 300, objects);
+    objects[got] = objects[got / 2];
+    MallocStats before, after;
+    my_malloc_stats(&before);
+    my_free_batch(objects, got + 1);
+    my_malloc_stats(&after);
+    check(got == 300 && after.slab_frees - before.slab_frees == got, "repeated pointer in a slab batch freed once");
+
+    void* out[4];
+    check(my_malloc_batch(0, 4, out) == 0 && my_malloc_batch(100, 0, out) == 0, "empty batches allocate nothing");
+    my_free_batch(NULL, 0);
+}
 
-        gettimeofday(&t1, NULL);
+void test_trim() {
+    DEBUG_PRINTF("\n--- Testing trim ---\n");
 
-        long long diff = (long long)(t1.tv_sec - t0.tv_sec) * 1000000LL + (long long)(t1.tv_usec - t0.tv_usec);
-        sum_metabuddy += diff;
+    // A spike of mid blocks, all gone but one
+    enum { SPIKE = 600 };
+    void* blocks[SPIKE];
+    for (int i = 0; i < SPIKE; i++) {
+        blocks[i] = my_malloc(3000);
+        if (blocks[i]) {
+            memset(blocks[i], 0x44, 3000);
+        }
     }
+    for (int i = 1; i < SPIKE; i++) {
+        my_free(blocks[i]);
+    }
+    check(my_malloc_trim() > 0, "trim gives memory back after a spike");
+
+    char* survivor = blocks[0];
+    check(survivor[0] == 0x44 && survivor[2999] == 0x44, "blocks in use are left alone");
+    void* again = my_malloc(3000);
+    check(again != NULL, "allocations go on after a trim");
+    my_free(again);
+    my_free(survivor);
+}
 
-    long long avg_standard = sum_standard / runs;
-    long long avg_metabuddy = sum_metabuddy / runs;
+int main() {
+
+    DEBUG_PRINTF("Running pseudo malloc tests...\n");
     
-    printf("Benchmark runs: %d\n", runs);
-    printf("Standard buddy allocator: avg %lld us\n", avg_standard);
-    printf("Metabuddy allocator:      avg %lld us\n", avg_metabuddy);
+    test_basic_malloc_free();
+    test_different_sizes();
+    test_multiple_allocations();
+    test_edge_cases();
+    test_small_allocation_after_free_big_block();
+    test_full_allocation_of_buddy_pool_512();
+    test_full_allocation_of_buddy_pool_1023();
+
+    test_basic_malloc_free_metabuddy();
+    test_different_sizes_metabuddy();
+    test_multiple_allocations_metabuddy();
+    test_edge_cases_metabuddy();
+    test_small_allocation_after_free_big_block_metabuddy();
+    test_full_allocation_of_buddy_pool_504_metabuddy();
+    test_full_allocation_of_buddy_pool_1015_metabuddy();
+
+    test_multithreaded_malloc_free();
+    test_tiny_objects();
+    test_medium_allocations();
+    test_realloc();
+    test_calloc();
+    test_aligned_allocations();
+    test_batch();
+    test_trim();
 
     DEBUG_PRINTF("\nResults: %d passed, %d failed\n", passed, failed);
     
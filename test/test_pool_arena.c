@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../include/pool_arena.h"
+#include "../include/malloc_stats.h"
+#include "../include/debug_print.h"
+
+// Testing the arenas spread over the threads
+
+int passed = 0;
+int failed = 0;
+
+void check(int condition, const char* msg) {
+    if (condition) {
+        DEBUG_PRINTF("✓ %s\n", msg);
+        passed++;
+    } else {
+        DEBUG_PRINTF("✗ %s\n", msg);
+        failed++;
+    }
+}
+
+// Allocates a block from the arena of a new thread
+void* thread_allocate(void* out) {
+    PoolArena* arena = pool_arena_for_thread();
+
+    pool_arena_lock(arena);
+    *(void**)out = pool_arena_malloc_locked(arena, POOL_KIND_BUDDY, 1000, 0);
+    pool_arena_unlock(arena);
+
+    return arena;
+}
+
+void test_thread_arenas() {
+    DEBUG_PRINTF("\n--- Testing arena assignment ---\n");
+
+    PoolArena* main_arena = pool_arena_for_thread();
+    check(main_arena != NULL, "main thread has an arena");
+    check(pool_arena_for_thread() == main_arena, "thread keeps its arena");
+
+    pool_arena_lock(main_arena);
+    void* main_block = pool_arena_malloc_locked(main_arena, POOL_KIND_BUDDY, 1000, 0);
+    pool_arena_unlock(main_arena);
+
+    check(pool_arena_lookup(main_block)->arena == main_arena, "block found in the main arena");
+    check(pool_arena_lookup(&main_block) == NULL, "pointer outside every pool has no arena");
+
+    // A second thread gets the next arena (there are always at least ARENAS_PER_CPU)
+    pthread_t thread;
+    void* thread_block = NULL;
+    void* thread_arena = NULL;
+    pthread_create(&thread, NULL, thread_allocate, &thread_block);
+    pthread_join(thread, &thread_arena);
+
+    check(thread_arena != main_arena, "second thread has its own arena");
+    check(pool_arena_lookup(thread_block)->arena == thread_arena, "block found in the thread arena");
+
+    // Free from the main thread: goes on the remote stack, the pool is untouched until the next lock
+    BuddyPool* pool = pool_arena_lookup(thread_block);
+    pool_arena_free_remote(pool->arena, thread_block);
+    check(BuddyAllocator_block_size(&pool->buddy, thread_block) == 1024, "remote free does not touch the pool");
+
+    pool_arena_lock(pool->arena);
+    pool_arena_unlock(pool->arena);
+    check(BuddyAllocator_block_size(&pool->buddy, thread_block) == 0, "remote free applied on the next lock");
+
+    pool_arena_lock(main_arena);
+    pool_arena_free_locked(pool_arena_lookup(main_block), main_block, 0);
+    pool_arena_unlock(main_arena);
+}
+
+void test_pool_growth() {
+    DEBUG_PRINTF("\n--- Testing pool growth and release ---\n");
+
+    // Three pools worth of 1 KB blocks
+    enum { BLOCKS = 3 * BUDDY_POOL_SIZE / 1024 };
+    static void* blocks[BLOCKS];
+
+    PoolArena* arena = pool_arena_for_thread();
+    pool_arena_lock(arena);
+
+    int successful = 0;
+    for (int i = 0; i < BLOCKS; i++) {
+        blocks[i] = pool_arena_malloc_locked(arena, POOL_KIND_BUDDY, 1024, 0);
+        if (blocks[i]) {
+            successful++;
+        }
+    }
+    check(successful == BLOCKS, "arena grows past a single pool");
+
+    BuddyPool* first = pool_arena_lookup(blocks[0]);
+    BuddyPool* last = pool_arena_lookup(blocks[BLOCKS - 1]);
+    check(first != last && first->arena == arena && last->arena == arena, "blocks spread over several pools of the arena");
+    check(((uintptr_t)last->buddy.memory_pool & (BUDDY_POOL_SIZE - 1)) == 0, "pools are aligned to their size");
+    check(pool_arena_lookup((char*)last->buddy.memory_pool + BUDDY_POOL_SIZE - 1) == last, "last byte of a pool maps to the pool");
+
+    for (int i = 0; i < BLOCKS; i++) {
+        pool_arena_free_locked(pool_arena_lookup(blocks[i]), blocks[i], 0);
+    }
+
+    // The first pool emptied first and is kept as the spare, the others went back to the OS
+    check(pool_arena_lookup(blocks[0]) == first && BuddyAllocator_is_empty(&first->buddy), "one empty pool is kept");
+    check(pool_arena_lookup(blocks[BLOCKS - 1]) == NULL, "other empty pools are unmapped");
+
+    pool_arena_unlock(arena);
+}
+
+void test_purge() {
+    DEBUG_PRINTF("\n--- Testing purge and trim ---\n");
+
+    PoolArena* arena = pool_arena_for_thread();
+    pool_arena_lock(arena);
+
+    // A written mid block freed next to one still in use
+    void* kept = pool_arena_malloc_locked(arena, POOL_KIND_MID, 128 * 1024, 0);
+    void* freed = pool_arena_malloc_locked(arena, POOL_KIND_MID, 128 * 1024, 0);
+    memset(kept, 1, 128 * 1024);
+    memset(freed, 1, 128 * 1024);
+    BuddyPool* mid = pool_arena_lookup(kept);
+    pool_arena_free_locked(mid, freed, 0);
+    check(mid->dirty, "pool freed into is dirty");
+
+    MallocStats before, after;
+    my_malloc_stats(&before);
+    // Enough frees to reach the next purge, whatever earlier tests left on the counter
+    while (arena->frees_since_purge > 0) {
+        pool_arena_free_locked(mid, pool_arena_malloc_locked(arena, POOL_KIND_MID, 2048, 0), 0);
+    }
+    my_malloc_stats(&after);
+    check(after.madvise_calls > before.madvise_calls && !mid->dirty, "dirty pools purged every POOL_PURGE_INTERVAL frees");
+
+    // The empty pool kept by test_pool_growth goes back, the one in use stays
+    BuddyPool* spare = arena->pools[POOL_KIND_BUDDY];
+    check(spare && BuddyAllocator_is_empty(&spare->buddy), "arena has a spare empty pool");
+    void* spare_memory = spare->buddy.memory_pool;
+    check(pool_arena_trim_locked(arena) >= BUDDY_POOL_SIZE, "trim gives back the empty pool");
+    check(pool_arena_lookup(spare_memory) == NULL && pool_arena_lookup(kept) == mid, "only empty pools are unmapped");
+
+    pool_arena_free_locked(mid, kept, 0);
+    pool_arena_unlock(arena);
+}
+
+int main() {
+
+    DEBUG_PRINTF("Running pool arena tests...\n");
+
+    test_thread_arenas();
+    test_pool_growth();
+    test_purge();
+
+    DEBUG_PRINTF("\nResults: %d passed, %d failed\n", passed, failed);
+
+    if (failed == 0) {
+        DEBUG_PRINTF("All tests passed! 🎉\n");
+        return 0;
+    } else {
+        DEBUG_PRINTF("Some tests failed 😞\n");
+        return 1;
+    }
+
+}
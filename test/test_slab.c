@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/slab.h"
+#include "../include/pool_arena.h"
+#include "../include/debug_print.h"
+
+// Testing the slab layer for tiny objects
+
+int passed = 0;
+int failed = 0;
+
+void check(int condition, const char* msg) {
+    if (condition) {
+        DEBUG_PRINTF("✓ %s\n", msg);
+        passed++;
+    } else {
+        DEBUG_PRINTF("✗ %s\n", msg);
+        failed++;
+    }
+}
+
+void test_size_classes() {
+    DEBUG_PRINTF("\n--- Testing size classes ---\n");
+
+    check(slab_class_size(slab_class_for_size(1)) == 8, "1 byte goes to the 8 bytes class");
+    check(slab_class_size(slab_class_for_size(8)) == 8, "8 bytes go to the 8 bytes class");
+    check(slab_class_size(slab_class_for_size(9)) == 16, "9 bytes go to the 16 bytes class");
+    check(slab_class_size(slab_class_for_size(17)) == 24, "17 bytes go to the 24 bytes class");
+    check(slab_class_size(slab_class_for_size(32)) == 32, "32 bytes go to the 32 bytes class");
+    check(slab_class_size(slab_class_for_size(33)) == 48, "33 bytes go to the 48 bytes class");
+    check(slab_class_size(slab_class_for_size(SLAB_MAX_SIZE)) == SLAB_MAX_SIZE, "largest class");
+    check(slab_class_for_size(SLAB_MAX_SIZE + 1) == SLAB_CLASSES, "bigger sizes have no class");
+}
+
+void test_slab_objects() {
+    DEBUG_PRINTF("\n--- Testing slab objects ---\n");
+
+    PoolArena* arena = pool_arena_for_thread();
+    pool_arena_lock(arena);
+
+    // A page of 8 bytes objects and then some: needs a second slab
+    enum { OBJECTS = SLAB_SIZE / 8 };
+    static void* objects[OBJECTS];
+    int successful = 0;
+    for (int i = 0; i < OBJECTS; i++) {
+        objects[i] = slab_malloc_locked(arena, slab_class_for_size(8));
+        if (objects[i]) {
+            memset(objects[i], 0xAB, 8);
+            successful++;
+        }
+    }
+    check(successful == OBJECTS, "allocated more 8 bytes objects than fit in a slab");
+
+    BuddyPool* pool = pool_arena_lookup(objects[0]);
+    check(pool && pool->kind == POOL_KIND_SLAB && pool->arena == arena, "objects come from a slab pool of the arena");
+    check((char*)objects[1] - (char*)objects[0] == 8, "no per-object header between objects");
+    check(slab_object_size(objects[0]) == 8, "object size read back from the slab");
+
+    Slab* first_slab = (Slab*)((uintptr_t)objects[0] & ~((uintptr_t)SLAB_SIZE - 1));
+    Slab* last_slab = (Slab*)((uintptr_t)objects[OBJECTS - 1] & ~((uintptr_t)SLAB_SIZE - 1));
+    check(first_slab != last_slab, "a full slab is followed by a new one");
+
+    void* wide = slab_malloc_locked(arena, slab_class_for_size(48));
+    check(((uintptr_t)wide & 15) == 0, "48 bytes objects are 16 bytes aligned");
+    slab_free_locked(arena, wide);
+
+    slab_free_locked(arena, objects[0]);
+    check(slab_object_size(objects[0]) == 0, "freed object has no size");
+    slab_free_locked(arena, objects[0]);
+    check(slab_object_size(objects[0]) == 0, "double free is ignored");
+
+    for (int i = 1; i < OBJECTS; i++) {
+        slab_free_locked(arena, objects[i]);
+    }
+
+    // The first slab emptied while the second still had objects, so its block went back to the pool
+    // (the lowest free block, handed out again first); the second slab is kept for the next allocations
+    void* reused = BuddyAllocator_malloc(&pool->buddy, SLAB_SIZE);
+    check(reused == (void*)first_slab, "empty slab given back to its pool");
+    BuddyAllocator_free(&pool->buddy, reused);
+    check(BuddyAllocator_block_size(&pool->buddy, last_slab) == SLAB_SIZE, "last slab of the class is kept");
+
+    pool_arena_unlock(arena);
+}
+
+int main() {
+
+    DEBUG_PRINTF("Running slab tests...\n");
+
+    test_size_classes();
+    test_slab_objects();
+
+    DEBUG_PRINTF("\nResults: %d passed, %d failed\n", passed, failed);
+
+    if (failed == 0) {
+        DEBUG_PRINTF("All tests passed! 🎉\n");
+        return 0;
+    } else {
+        DEBUG_PRINTF("Some tests failed 😞\n");
+        return 1;
+    }
+
+}
@@ -0,0 +1,535 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "../include/my_malloc.h"
+#include "../include/malloc_trace.h"
+
+/*
+ * Replay of an allocation trace (my_malloc_trace_start, or PSEUDO_MALLOC_TRACE with
+ * the shared library) against pseudo-malloc and glibc malloc:
+ *
+ *     ./tools/replay trace.bin
+ *
+ * Records are sorted by timestamp and every recorded block gets a slot; each trace
+ * thread is replayed by a thread of its own (trace threads beyond MAX_REPLAY_THREADS
+ * share them), which frees or resizes a block once the thread that allocated it has
+ * done so. Every allocation touches one byte per page, as a program writing its
+ * memory would. Threads only wait for the blocks they give back, not for the order of
+ * the trace: trace threads that ran one after another replay at the same time.
+ *
+ * Each allocator runs in a child process. It reports the replay time, the peak footprint
+ * (peak RSS of the child minus its RSS before the replay), the peak of the bytes
+ * requested and not yet freed during the replay, which may be above the one of the
+ * trace, and the fragmentation (1 - that peak / peak footprint)
+ */
+
+#define MAX_REPLAY_THREADS 64
+#define NO_SLOT UINT32_MAX
+#define FAILED_BLOCK ((void*)1) // Slot of an allocation that returned NULL
+
+typedef struct {
+    const char* name;
+    void* (*malloc_fn)(size_t);
+    void (*free_fn)(void*);
+    void* (*realloc_fn)(void*, size_t);
+    void* (*calloc_fn)(size_t, size_t);
+    void* (*aligned_alloc_fn)(size_t, size_t);
+} Allocator;
+
+static const Allocator allocators[] = {
+    {"pseudo", my_malloc, my_free, my_realloc, my_calloc, my_aligned_alloc},
+    {"glibc", malloc, free, realloc, calloc, aligned_alloc},
+};
+
+// One operation of the trace, with its blocks turned into slots
+typedef struct {
+    uint64_t size; // Bytes requested
+    uint64_t alignment; // memalign only
+    uint32_t slot; // Slot of the block the operation hands out, NO_SLOT if none
+    uint32_t old_slot; // Slot of the block it gives back or resizes, NO_SLOT if none
+    uint32_t op; // TraceOp
+} ReplayOp;
+
+typedef struct {
+    ReplayOp* ops; // Operations of the thread, in order
+    size_t count;
+} ReplayThread;
+
+typedef struct {
+    double seconds; // Replay time
+    long footprint_kb; // Peak RSS during the replay minus RSS before it
+    uint64_t peak_live; // Peak of the bytes requested and not yet freed during the replay
+} Result;
+
+static const Allocator* allocator; // Allocator of the running child
+static void** slots; // Block of each slot, NULL until allocated
+static uint64_t* slot_size; // Bytes requested for each slot
+static uint64_t replay_live; // Bytes requested and not yet freed by the replay threads
+static uint64_t replay_peak_live; // Peak of replay_live
+static ReplayThread replay_threads[MAX_REPLAY_THREADS];
+static int replay_thread_count = 0;
+static pthread_barrier_t start_barrier;
+
+/* Trace loading */
+
+typedef struct {
+    TraceRecord record;
+    size_t position; // Index in the file, orders records with the same timestamp
+} SortedRecord;
+
+static int compare_records(const void* a, const void* b) {
+    const SortedRecord* x = a;
+    const SortedRecord* y = b;
+    if (x->record.timestamp != y->record.timestamp) {
+        return x->record.timestamp < y->record.timestamp ? -1 : 1;
+    }
+    return (x->position > y->position) - (x->position < y->position);
+}
+
+// Live blocks of the trace: id -> slot, open addressing with linear probing
+typedef struct {
+    uint64_t* ids; // 0 marks an empty entry (no block has id 0)
+    uint32_t* slot_of;
+    size_t capacity; // Power of two
+    size_t count;
+} IdMap;
+
+static inline size_t id_hash(uint64_t id, size_t capacity) {
+    return (size_t)((id >> 4) * 0x9E3779B97F4A7C15ULL >> 16) & (capacity - 1);
+}
+
+static int id_map_put(IdMap* map, uint64_t id, uint32_t slot, uint32_t* replaced);
+
+// Twice the capacity. 0, or -1 when out of memory (the map is left as it was)
+static int id_map_grow(IdMap* map) {
+    IdMap bigger = {calloc(map->capacity * 2, sizeof(uint64_t)), malloc(map->capacity * 2 * sizeof(uint32_t)),
+                    map->capacity * 2, 0};
+    if (!bigger.ids || !bigger.slot_of) {
+        free(bigger.ids);
+        free(bigger.slot_of);
+        return -1;
+    }
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (map->ids[i]) {
+            id_map_put(&bigger, map->ids[i], map->slot_of[i], NULL);
+        }
+    }
+    free(map->ids);
+    free(map->slot_of);
+    *map = bigger;
+    return 0;
+}
+
+// Map id to slot. The slot of a block already live under this id goes to *replaced (NO_SLOT if
+// none): its free was not recorded. 0, or -1 when out of memory
+static int id_map_put(IdMap* map, uint64_t id, uint32_t slot, uint32_t* replaced) {
+    if (2 * (map->count + 1) > map->capacity && id_map_grow(map) != 0) {
+        return -1;
+    }
+    size_t i = id_hash(id, map->capacity);
+    while (map->ids[i] && map->ids[i] != id) {
+        i = (i + 1) & (map->capacity - 1);
+    }
+    if (replaced) {
+        *replaced = map->ids[i] ? map->slot_of[i] : NO_SLOT;
+    }
+    if (!map->ids[i]) {
+        map->count++;
+    }
+    map->ids[i] = id;
+    map->slot_of[i] = slot;
+    return 0;
+}
+
+// Remove id and return its slot, NO_SLOT if it is not live
+static uint32_t id_map_take(IdMap* map, uint64_t id) {
+    size_t i = id_hash(id, map->capacity);
+    while (map->ids[i] && map->ids[i] != id) {
+        i = (i + 1) & (map->capacity - 1);
+    }
+    if (!map->ids[i]) {
+        return NO_SLOT;
+    }
+    uint32_t slot = map->slot_of[i];
+
+    // Backward shift: move up the entries of the run that hashed before the hole
+    size_t hole = i;
+    for (size_t j = (i + 1) & (map->capacity - 1); map->ids[j]; j = (j + 1) & (map->capacity - 1)) {
+        size_t home = id_hash(map->ids[j], map->capacity);
+        if (((j - home) & (map->capacity - 1)) >= ((j - hole) & (map->capacity - 1))) {
+            map->ids[hole] = map->ids[j];
+            map->slot_of[hole] = map->slot_of[j];
+            hole = j;
+        }
+    }
+    map->ids[hole] = 0;
+    map->count--;
+    return slot;
+}
+
+typedef struct {
+    size_t records; // Records in the file
+    size_t skipped; // Frees and reallocs of blocks the trace never handed out
+    size_t unfreed; // Blocks whose id was handed out again while they were live (their free was not recorded)
+    uint32_t slots; // Blocks handed out
+    uint32_t trace_threads; // Distinct thread numbers
+    uint64_t peak_live; // Peak of the bytes requested and not yet given back
+} TraceSummary;
+
+static int load_trace(const char* path, TraceSummary* summary) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    TraceFileHeader header;
+    if (fstat(fd, &st) != 0 || read(fd, &header, sizeof(header)) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 || header.version != TRACE_VERSION ||
+        header.record_size != sizeof(TraceRecord)) {
+        fprintf(stderr, "%s: not a pseudo-malloc trace\n", path);
+        close(fd);
+        return -1;
+    }
+
+    size_t count = ((size_t)st.st_size - sizeof(header)) / sizeof(TraceRecord);
+    SortedRecord* sorted = malloc((count ? count : 1) * sizeof(SortedRecord));
+    if (!sorted) {
+        fprintf(stderr, "%s: out of memory for %zu records\n", path, count);
+        close(fd);
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (read(fd, &sorted[i].record, sizeof(TraceRecord)) != (ssize_t)sizeof(TraceRecord)) {
+            count = i; // Truncated trace: replay what is there
+            break;
+        }
+        sorted[i].position = i;
+    }
+    close(fd);
+    qsort(sorted, count, sizeof(SortedRecord), compare_records);
+
+    memset(summary, 0, sizeof(*summary));
+    summary->records = count;
+
+    // Trace thread numbers -> replay threads, in the order threads show up
+    size_t thread_numbers = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (sorted[i].record.thread >= thread_numbers) {
+            thread_numbers = sorted[i].record.thread + 1;
+        }
+    }
+    uint32_t* replay_thread_of = malloc((thread_numbers ? thread_numbers : 1) * sizeof(uint32_t));
+    // Old block of the realloc each trace thread is in, between its two records
+    uint32_t* realloc_slot_of = malloc((thread_numbers ? thread_numbers : 1) * sizeof(uint32_t));
+    IdMap live = {calloc(1024, sizeof(uint64_t)), malloc(1024 * sizeof(uint32_t)), 1024, 0};
+    size_t slot_capacity = 1024;
+    slot_size = malloc(slot_capacity * sizeof(uint64_t));
+    int ok = replay_thread_of && realloc_slot_of && live.ids && live.slot_of && slot_size;
+    for (size_t i = 0; ok && i < thread_numbers; i++) {
+        replay_thread_of[i] = NO_SLOT;
+        realloc_slot_of[i] = NO_SLOT;
+    }
+    for (size_t i = 0; ok && i < count; i++) {
+        uint32_t thread = sorted[i].record.thread;
+        if (replay_thread_of[thread] == NO_SLOT) {
+            replay_thread_of[thread] = summary->trace_threads++ % MAX_REPLAY_THREADS;
+        }
+        replay_threads[replay_thread_of[thread]].count++;
+    }
+    replay_thread_count = summary->trace_threads < MAX_REPLAY_THREADS ? (int)summary->trace_threads : MAX_REPLAY_THREADS;
+    for (int t = 0; ok && t < replay_thread_count; t++) {
+        replay_threads[t].ops = malloc((replay_threads[t].count ? replay_threads[t].count : 1) * sizeof(ReplayOp));
+        replay_threads[t].count = 0;
+        ok = replay_threads[t].ops != NULL;
+    }
+
+    // Blocks -> slots, and the live bytes of the program along the way
+    uint64_t live_bytes = 0;
+    for (size_t i = 0; ok && i < count; i++) {
+        TraceRecord* record = &sorted[i].record;
+        ReplayOp op = {record->size, 0, NO_SLOT, NO_SLOT, record->op};
+
+        // The old block of a realloc is given back at its first record, and resized at the second
+        if (record->op == TRACE_REALLOC_BEGIN) {
+            realloc_slot_of[record->thread] = id_map_take(&live, record->old_id);
+            if (realloc_slot_of[record->thread] == NO_SLOT) {
+                summary->skipped++;
+            } else {
+                live_bytes -= slot_size[realloc_slot_of[record->thread]];
+            }
+            continue;
+        }
+        if (record->op == TRACE_REALLOC && record->old_id) {
+            op.old_slot = realloc_slot_of[record->thread];
+            realloc_slot_of[record->thread] = NO_SLOT;
+            if (record->size == 0 && record->id) {
+                // Failed: the block is live again, untouched
+                if (op.old_slot != NO_SLOT) {
+                    ok = id_map_put(&live, record->old_id, op.old_slot, NULL) == 0;
+                    live_bytes += slot_size[op.old_slot];
+                }
+                continue;
+            }
+            // Of an unknown block: nothing to free, and a new block replayed as an allocation
+            if (op.old_slot == NO_SLOT && !record->id) {
+                continue;
+            }
+        }
+        if (record->op == TRACE_FREE) {
+            op.old_slot = id_map_take(&live, record->id);
+            if (op.old_slot == NO_SLOT) {
+                summary->skipped++;
+                continue;
+            }
+            live_bytes -= slot_size[op.old_slot];
+        }
+        if (record->op == TRACE_MEMALIGN) {
+            op.alignment = record->old_id;
+        }
+        if (record->op != TRACE_FREE && record->id) {
+            if (summary->slots == slot_capacity) {
+                uint64_t* bigger = realloc(slot_size, 2 * slot_capacity * sizeof(uint64_t));
+                if (!bigger) {
+                    ok = 0;
+                    break;
+                }
+                slot_size = bigger;
+                slot_capacity *= 2;
+            }
+            op.slot = summary->slots++;
+            slot_size[op.slot] = record->size;
+            uint32_t replaced;
+            if (id_map_put(&live, record->id, op.slot, &replaced) != 0) {
+                ok = 0;
+                break;
+            }
+            if (replaced != NO_SLOT) {
+                summary->unfreed++;
+                live_bytes -= slot_size[replaced];
+            }
+            live_bytes += record->size;
+            if (live_bytes > summary->peak_live) {
+                summary->peak_live = live_bytes;
+            }
+        }
+
+        ReplayThread* thread = &replay_threads[replay_thread_of[record->thread]];
+        thread->ops[thread->count++] = op;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "%s: out of memory while loading the trace\n", path);
+    }
+    free(live.ids);
+    free(live.slot_of);
+    free(realloc_slot_of);
+    free(replay_thread_of);
+    free(sorted);
+    return ok ? 0 : -1;
+}
+
+/* Replay */
+
+static inline void touch(void* ptr, uint64_t size) {
+    for (uint64_t offset = 0; offset < size; offset += PAGE_SIZE) {
+        ((volatile char*)ptr)[offset] = 1;
+    }
+}
+
+// Block of a slot, once the thread allocating it got there
+static inline void* wait_for_block(uint32_t slot) {
+    void* ptr;
+    while ((ptr = __atomic_load_n(&slots[slot], __ATOMIC_ACQUIRE)) == NULL) {
+        sched_yield();
+    }
+    return ptr;
+}
+
+// A block of the slot is handed out, or about to be given back
+static inline void count_live(uint32_t slot, int handed_out) {
+    if (!handed_out) {
+        __atomic_fetch_sub(&replay_live, slot_size[slot], __ATOMIC_RELAXED);
+        return;
+    }
+    uint64_t live = __atomic_add_fetch(&replay_live, slot_size[slot], __ATOMIC_RELAXED);
+    uint64_t peak = __atomic_load_n(&replay_peak_live, __ATOMIC_RELAXED);
+    while (live > peak && !__atomic_compare_exchange_n(&replay_peak_live, &peak, live, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static inline void publish_block(uint32_t slot, void* ptr, uint64_t size) {
+    if (ptr) {
+        touch(ptr, size);
+        count_live(slot, 1);
+    }
+    __atomic_store_n(&slots[slot], ptr ? ptr : FAILED_BLOCK, __ATOMIC_RELEASE);
+}
+
+static void* replay_work(void* arg) {
+    ReplayThread* thread = arg;
+    pthread_barrier_wait(&start_barrier);
+
+    for (size_t i = 0; i < thread->count; i++) {
+        ReplayOp* op = &thread->ops[i];
+        void* old = op->old_slot == NO_SLOT ? NULL : wait_for_block(op->old_slot);
+        if (old == FAILED_BLOCK) {
+            old = NULL;
+            if (op->op == TRACE_FREE) {
+                continue;
+            }
+        }
+        if (old) {
+            count_live(op->old_slot, 0);
+        }
+
+        switch (op->op) {
+            case TRACE_MALLOC:
+                publish_block(op->slot, allocator->malloc_fn(op->size), op->size);
+                break;
+            case TRACE_CALLOC:
+                publish_block(op->slot, allocator->calloc_fn(1, op->size), op->size);
+                break;
+            case TRACE_MEMALIGN:
+                publish_block(op->slot, allocator->aligned_alloc_fn(op->alignment, op->size), op->size);
+                break;
+            case TRACE_FREE:
+                allocator->free_fn(old);
+                break;
+            case TRACE_REALLOC:
+                if (op->size == 0) {
+                    allocator->free_fn(old);
+                } else {
+                    void* ptr = allocator->realloc_fn(old, op->size);
+                    if (!ptr && old) {
+                        allocator->free_fn(old); // Failed here, not in the trace: the block is dropped
+                    }
+                    if (op->slot != NO_SLOT) {
+                        publish_block(op->slot, ptr, op->size);
+                    }
+                }
+                break;
+        }
+    }
+    return NULL;
+}
+
+static inline double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static long resident_kb(void) {
+    long pages = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm) {
+        if (fscanf(statm, "%*d %ld", &pages) != 1) {
+            pages = 0;
+        }
+        fclose(statm);
+    }
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Replay the trace with one allocator in a child process. 0 on success
+static int replay_in_child(const Allocator* chosen, const TraceSummary* summary, Result* result) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        return -1;
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        allocator = chosen;
+        slots = mmap(NULL, ((size_t)summary->slots + 1) * sizeof(void*), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        long baseline_kb = resident_kb();
+
+        pthread_t handles[MAX_REPLAY_THREADS];
+        pthread_barrier_init(&start_barrier, NULL, (unsigned int)replay_thread_count + 1);
+        for (int t = 0; t < replay_thread_count; t++) {
+            pthread_create(&handles[t], NULL, replay_work, &replay_threads[t]);
+        }
+        pthread_barrier_wait(&start_barrier);
+        double start = now_seconds();
+        for (int t = 0; t < replay_thread_count; t++) {
+            pthread_join(handles[t], NULL);
+        }
+
+        Result child_result;
+        child_result.seconds = now_seconds() - start;
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        child_result.footprint_kb = usage.ru_maxrss - baseline_kb;
+        child_result.peak_live = replay_peak_live;
+
+        ssize_t written = write(fds[1], &child_result, sizeof(child_result));
+        _exit(written == (ssize_t)sizeof(child_result) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    ssize_t got = read(fds[0], result, sizeof(*result));
+    close(fds[0]);
+
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+        got != (ssize_t)sizeof(*result)) {
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s trace.bin\n", argv[0]);
+        return 1;
+    }
+
+    TraceSummary summary;
+    if (load_trace(argv[1], &summary) != 0) {
+        return 1;
+    }
+
+    printf("%zu records, %u threads, %u blocks, peak %llu KB requested and live",
+           summary.records, summary.trace_threads, summary.slots, (unsigned long long)(summary.peak_live / 1024));
+    if (summary.skipped) {
+        printf(", %zu frees of unknown blocks skipped", summary.skipped);
+    }
+    if (summary.unfreed) {
+        printf(", %zu blocks never freed", summary.unfreed);
+    }
+    printf("\n%-7s %12s %20s %16s %14s\n", "malloc", "time ms", "peak footprint KB", "peak live KB", "fragmentation");
+
+    int failures = 0;
+    for (size_t a = 0; a < sizeof(allocators) / sizeof(allocators[0]); a++) {
+        Result result;
+        if (replay_in_child(&allocators[a], &summary, &result) != 0) {
+            printf("%-7s failed\n", allocators[a].name);
+            failures++;
+            continue;
+        }
+        double footprint = (double)result.footprint_kb * 1024.0;
+        double fragmentation = footprint > (double)result.peak_live ? 1.0 - (double)result.peak_live / footprint : 0.0;
+        printf("%-7s %12.2f %20ld %16llu %13.1f%%\n", allocators[a].name, result.seconds * 1000.0, result.footprint_kb,
+               (unsigned long long)(result.peak_live / 1024), 100.0 * fragmentation);
+    }
+
+    return failures ? 1 : 0;
+}